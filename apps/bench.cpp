@@ -0,0 +1,685 @@
+#include "../include/core/Identification.h"
+#include "../include/core/MaxFreqExtractor.h"
+#include "../include/core/SpectralExtractor.h"
+#include "../include/core/SpectralKernels.h"
+#include "../include/core/ThreadPool.h"
+#include "../include/core/WAVStream.h"
+#include "../include/utils/CompressorWrapper.h"
+#include "../include/utils/json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using json = nlohmann::json;
+
+void printUsage() {
+    cout << "Usage: bench [OPTIONS]\n";
+    cout << "Time the hot paths (FFT, binning, peak picking, WAV decoding, compression) and an\n";
+    cout << "end-to-end identification on a synthetic database for every config/*.json preset,\n";
+    cout << "and write the results as JSON.\n";
+    cout << "Options:\n";
+    cout << "  --output <file>       JSON results file [default: bench_results.json]\n";
+    cout << "  --config-dir <dir>    Directory with the extraction presets [default: config]\n";
+    cout << "  --compressors <list>  Comma-separated compressor specs to time; the first one is used\n";
+    cout << "                        for identification [default: gzip,bzip2,lzma,zstd,fcm]\n";
+    cout << "  --db-size <n>         Tracks in the synthetic database [default: 20]\n";
+    cout << "  --track-seconds <s>   Length of each synthetic track [default: 10]\n";
+    cout << "  --query-seconds <s>   Length of the noisy query excerpt [default: 4]\n";
+    cout << "  --min-time <ms>       Minimum measuring time per benchmark [default: 200]\n";
+    cout << "  --filter <text>       Only run benchmarks whose name contains the text\n";
+    cout << "  --threads <n>         Threads for the identification scan [default: all available]\n";
+    cout << "  --baseline <file>     Compare with an earlier results file and fail on regressions\n";
+    cout << "  --tolerance <pct>     Allowed slowdown against the baseline [default: 10]\n";
+    cout << "  -h, --help            Show this help message\n";
+    cout << endl;
+}
+
+namespace {
+
+constexpr int SAMPLE_RATE = 44100;
+const size_t COMPRESS_SIZES[] = {16 * 1024, 128 * 1024, 1024 * 1024};
+
+string compressName(const string& compressor, size_t size) {
+    return "compress/" + compressor + "/" + to_string(size / 1024) + "k";
+}
+
+/**
+ * @brief Extraction settings of one JSON preset from config/ (same keys as extract_features)
+ */
+struct Preset {
+    string name;
+    string method;
+    int numFrequencies;
+    int numBins;
+    int frameSize;
+    int hopSize;
+    int peakSpacing = 0;
+};
+
+/**
+ * @brief Timing summary of one benchmark; times are per call
+ */
+struct Result {
+    string name;
+    string preset;
+    size_t iterations = 0;
+    double meanNs = 0, medianNs = 0, minNs = 0, maxNs = 0;
+    size_t bytes = 0;  // Input bytes per call, 0 if not meaningful
+    json extra = json::object();
+};
+
+/**
+ * @brief Runs benchmark bodies until they were measured for long enough
+ */
+class Runner {
+public:
+    Runner(double minMillis, const string& filter) : minMillis(minMillis), filter(filter) {}
+
+    bool wanted(const string& name) const {
+        return filter.empty() || name.find(filter) != string::npos;
+    }
+
+    /**
+     * @brief Time a body; fast bodies are run in batches so the clock does not dominate
+     * @return The recorded result, or nullptr if the name is filtered out
+     */
+    Result* run(const string& name, const string& preset, size_t bytes, const function<void()>& body) {
+        if (!wanted(name)) return nullptr;
+        using clock = chrono::steady_clock;
+
+        // Warm-up call, also used to size the batches (about 20 us per sample)
+        auto start = clock::now();
+        body();
+        double first = chrono::duration<double, nano>(clock::now() - start).count();
+        size_t batch = first > 0 ? max<size_t>(1, static_cast<size_t>(20000.0 / first)) : 1000;
+
+        vector<double> samples;
+        double elapsedMillis = 0;
+        while ((elapsedMillis < minMillis || samples.size() < 3) && elapsedMillis < 5 * minMillis &&
+               samples.size() < 100000) {
+            start = clock::now();
+            for (size_t i = 0; i < batch; i++) body();
+            double ns = chrono::duration<double, nano>(clock::now() - start).count();
+            samples.push_back(ns / batch);
+            elapsedMillis += ns / 1e6;
+        }
+
+        Result result;
+        result.name = name;
+        result.preset = preset;
+        result.iterations = samples.size() * batch;
+        result.bytes = bytes;
+        sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double s : samples) sum += s;
+        result.meanNs = sum / samples.size();
+        result.medianNs = samples[samples.size() / 2];
+        result.minNs = samples.front();
+        result.maxNs = samples.back();
+
+        cout << "  " << left << setw(44) << name << right << setw(14) << fixed << setprecision(0)
+             << result.medianNs << " ns";
+        if (bytes > 0) {
+            cout << setw(10) << setprecision(1) << bytes / result.medianNs * 1e3 << " MB/s";
+        }
+        cout << endl;
+        results.push_back(move(result));
+        return &results.back();
+    }
+
+    vector<Result> results;
+
+private:
+    double minMillis;
+    string filter;
+};
+
+// Results of benchmark bodies are folded into this so the calls cannot be optimized away
+volatile size_t sink = 0;
+
+bool loadPresets(const string& dir, vector<Preset>& presets) {
+    vector<string> files;
+    try {
+        for (auto& entry : filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                files.push_back(entry.path().string());
+            }
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error reading config directory: " << e.what() << endl;
+        return false;
+    }
+    sort(files.begin(), files.end());
+
+    for (const auto& file : files) {
+        ifstream in(file);
+        try {
+            json config;
+            in >> config;
+            Preset preset;
+            preset.name = filesystem::path(file).stem().string();
+            preset.method = config.value("method", "spectral");
+            preset.numFrequencies = config.value("frequencies", config.value("numFrequencies", 4));
+            preset.numBins = config.value("bins", config.value("numBins", 32));
+            preset.frameSize = config.value("frameSize", 1024);
+            preset.hopSize = config.value("hopSize", 512);
+            preset.peakSpacing = config.value("peakSpacing", 0);
+            if (preset.method != "spectral" && preset.method != "maxfreq") {
+                cerr << "Warning: Skipping " << file << " (unknown method " << preset.method << ")" << endl;
+                continue;
+            }
+            presets.push_back(preset);
+        } catch (const exception& e) {
+            cerr << "Error parsing config file " << file << ": " << e.what() << endl;
+            return false;
+        }
+    }
+    if (presets.empty()) {
+        cerr << "Error: No extraction presets found in " << dir << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Synthetic stereo track (interleaved): quarter-second notes of a few random partials
+ */
+vector<int16_t> synthTrack(unsigned int seed, double seconds) {
+    mt19937 gen(seed);
+    uniform_real_distribution<double> freq(110.0, 4000.0);
+    uniform_real_distribution<double> gain(0.1, 0.3);
+    size_t frames = static_cast<size_t>(seconds * SAMPLE_RATE);
+    size_t noteLength = SAMPLE_RATE / 4;
+    vector<int16_t> samples(frames * 2);
+
+    double partials[3] = {0, 0, 0};
+    double gains[3] = {0, 0, 0};
+    for (size_t i = 0; i < frames; i++) {
+        if (i % noteLength == 0) {
+            for (int p = 0; p < 3; p++) {
+                partials[p] = freq(gen);
+                gains[p] = gain(gen);
+            }
+        }
+        double t = static_cast<double>(i) / SAMPLE_RATE;
+        double envelope = 1.0 - 0.5 * static_cast<double>(i % noteLength) / noteLength;
+        double left = 0, right = 0;
+        for (int p = 0; p < 3; p++) {
+            double s = gains[p] * sin(2.0 * M_PI * partials[p] * t);
+            left += s;
+            right += p == 0 ? 0.8 * s : s;
+        }
+        samples[2 * i] = static_cast<int16_t>(lround(left * envelope * 32767.0 / 1.2));
+        samples[2 * i + 1] = static_cast<int16_t>(lround(right * envelope * 32767.0 / 1.2));
+    }
+    return samples;
+}
+
+/**
+ * @brief Write interleaved stereo 16-bit samples as a PCM WAV file with the given bit depth
+ */
+bool writeWav(const string& path, const vector<int16_t>& samples, int bitsPerSample) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Error: Could not create " << path << endl;
+        return false;
+    }
+    const uint16_t channels = 2;
+    const uint16_t bytesPerSample = static_cast<uint16_t>(bitsPerSample / 8);
+    const uint32_t dataSize = static_cast<uint32_t>(samples.size() * bytesPerSample);
+    auto put16 = [&out](uint16_t v) { out.write(reinterpret_cast<const char*>(&v), 2); };
+    auto put32 = [&out](uint32_t v) { out.write(reinterpret_cast<const char*>(&v), 4); };
+
+    out.write("RIFF", 4);
+    put32(36 + dataSize);
+    out.write("WAVEfmt ", 8);
+    put32(16);
+    put16(1);  // PCM
+    put16(channels);
+    put32(SAMPLE_RATE);
+    put32(SAMPLE_RATE * channels * bytesPerSample);
+    put16(static_cast<uint16_t>(channels * bytesPerSample));
+    put16(static_cast<uint16_t>(bitsPerSample));
+    out.write("data", 4);
+    put32(dataSize);
+
+    vector<uint8_t> bytes(dataSize);
+    uint8_t* p = bytes.data();
+    for (int16_t s : samples) {
+        int32_t value = bitsPerSample == 8 ? (s >> 8) + 128 : static_cast<int32_t>(s) << (bitsPerSample - 16);
+        for (int b = 0; b < bytesPerSample; b++) *p++ = static_cast<uint8_t>(value >> (8 * b));
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return out.good();
+}
+
+/**
+ * @brief Extract the text features of a WAV file the way extract_features does
+ */
+string extractText(const string& wavFile, const Preset& preset) {
+    WAVStream stream;
+    if (!stream.open(wavFile, false)) return "";
+    if (preset.method == "spectral") {
+        SpectralExtractor extractor(preset.numBins);
+        return extractor.extractFeatures(stream, preset.frameSize, preset.hopSize);
+    }
+    MaxFreqExtractor extractor(preset.numFrequencies, preset.peakSpacing);
+    return extractor.extractFeatures(stream, preset.frameSize, preset.hopSize);
+}
+
+Buffer toBuffer(const string& text) {
+    return Buffer::fromBytes(vector<uint8_t>(text.begin(), text.end()));
+}
+
+size_t fileSize(const string& path) {
+    error_code ec;
+    uintmax_t size = filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<size_t>(size);
+}
+
+/**
+ * @brief Synthetic frame in the 16-bit range (as produced by WAVStream)
+ */
+vector<float> synthFrame(int size) {
+    vector<int16_t> track = synthTrack(7, static_cast<double>(size) / SAMPLE_RATE + 0.01);
+    vector<float> frame(size);
+    for (int i = 0; i < size; i++) frame[i] = static_cast<float>(track[2 * i]);
+    return frame;
+}
+
+void benchFFT(Runner& runner) {
+    cout << "FFT per frame size:" << endl;
+    for (int size : {256, 512, 1024, 2048, 4096, 8192}) {
+        vector<float> frame = synthFrame(size);
+
+        SpectralExtractor spectral(64);
+        vector<float> spectralMagnitudes;
+        spectral.applyWindow(frame.data(), size);
+        runner.run("fft/spectral/" + to_string(size), "", 0, [&]() {
+            spectral.computeFFT(spectralMagnitudes);
+            sink += spectralMagnitudes.size();
+        });
+
+        MaxFreqExtractor maxfreq(4);
+        vector<double> maxfreqMagnitudes;
+        maxfreq.applyWindow(frame.data(), size);
+        runner.run("fft/maxfreq/" + to_string(size), "", 0, [&]() {
+            maxfreq.computeFFT(maxfreqMagnitudes);
+            sink += maxfreqMagnitudes.size();
+        });
+    }
+}
+
+void benchStages(Runner& runner, const Preset& preset) {
+    const int n = preset.frameSize;
+    vector<float> frame = synthFrame(n);
+    const string& p = preset.name;
+
+    if (preset.method == "spectral") {
+        SpectralExtractor extractor(preset.numBins);
+        vector<float> magnitudes;
+        runner.run("window/" + p, p, 0, [&]() { extractor.applyWindow(frame.data(), n); });
+        extractor.applyWindow(frame.data(), n);
+        runner.run("fft/" + p, p, 0, [&]() { extractor.computeFFT(magnitudes); });
+        extractor.computeFFT(magnitudes);
+        runner.run("bins/" + p, p, 0, [&]() { sink += extractor.getBinnedSpectrum(magnitudes).size(); });
+        runner.run("frame/" + p, p, 0, [&]() { sink += extractor.extractFrame(frame.data(), n).size(); });
+    } else {
+        MaxFreqExtractor extractor(preset.numFrequencies, preset.peakSpacing);
+        vector<double> magnitudes;
+        runner.run("window/" + p, p, 0, [&]() { extractor.applyWindow(frame.data(), n); });
+        extractor.applyWindow(frame.data(), n);
+        runner.run("fft/" + p, p, 0, [&]() { extractor.computeFFT(magnitudes); });
+        extractor.computeFFT(magnitudes);
+        runner.run("peaks/" + p, p, 0, [&]() { sink += extractor.getTopFreqIndices(magnitudes).size(); });
+        runner.run("frame/" + p, p, 0, [&]() { sink += extractor.extractFrame(frame.data(), n).size(); });
+    }
+}
+
+bool benchDecode(Runner& runner, const string& workDir, const vector<int16_t>& track) {
+    cout << "WAV decoding:" << endl;
+    for (int bits : {8, 16, 24, 32}) {
+        string name = "wav_decode/" + to_string(bits) + "bit";
+        if (!runner.wanted(name)) continue;
+        string path = workDir + "/decode_" + to_string(bits) + ".wav";
+        if (!writeWav(path, track, bits)) return false;
+        runner.run(name, "", fileSize(path), [&]() {
+            WAVStream stream;
+            if (!stream.open(path, false) || !stream.setFraming(4096, 4096)) return;
+            const float* frame;
+            while (stream.nextFrame(frame)) sink += 1;
+        });
+    }
+    return true;
+}
+
+bool benchCompression(Runner& runner, const string& workDir, const vector<string>& compressors,
+                      const string& features) {
+    cout << "Compression (compressAndGetSize):" << endl;
+    CompressorWrapper cw;
+    for (size_t size : COMPRESS_SIZES) {
+        string path = workDir + "/compress_" + to_string(size) + ".feat";
+        {
+            ofstream out(path, ios::binary);
+            for (size_t written = 0; written < size; written += features.size()) {
+                out.write(features.data(), min(features.size(), size - written));
+            }
+            if (!out) {
+                cerr << "Error: Could not write " << path << endl;
+                return false;
+            }
+        }
+        for (const auto& compressor : compressors) {
+            runner.run(compressName(compressor, size), "", size, [&]() {
+                sink += static_cast<size_t>(cw.compressAndGetSize(compressor, path));
+            });
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief End-to-end identification of a noisy excerpt against the synthetic database,
+ * through the ranking code of music_id: the database folder is loaded once (C(y) from the
+ * sidecar cache), then every call extracts the query, compresses it and ranks it with
+ * Identification::rankQuery, plain (early abort against the top K) and primed
+ */
+bool benchIdentify(Runner& runner, const Preset& preset, const string& workDir, const vector<string>& tracks,
+                   const string& queryWav, size_t expected, const string& compressor, ThreadPool& pool) {
+    string name = "identify/" + preset.name;
+    string primedName = name + "/primed";
+    if (!runner.wanted(name) && !runner.wanted(primedName)) return true;
+
+    string dbDir = workDir + "/db_" + preset.name;
+    error_code ec;
+    filesystem::create_directories(dbDir, ec);
+    for (size_t i = 0; i < tracks.size(); i++) {
+        string text = extractText(tracks[i], preset);
+        string path = dbDir + "/track" + to_string(i) + ".feat";
+        ofstream out(path, ios::binary);
+        out << text;
+        if (text.empty() || !out) {
+            cerr << "Error: Could not prepare database entry " << path << endl;
+            return false;
+        }
+    }
+    Identification::Database db;
+    if (!Identification::loadDatabase(dbDir, false, compressor, true, false, db)) {
+        return false;
+    }
+
+    for (bool usePriming : {false, true}) {
+        string best;
+        Result* result = runner.run(usePriming ? primedName : name, preset.name, fileSize(queryWav), [&]() {
+            Buffer query = toBuffer(extractText(queryWav, preset));
+            long Cx = CompressorWrapper().compressedSize(compressor, query);
+            vector<pair<string, double>> ranking =
+                Identification::rankQuery(query, Cx, db, compressor, 10, pool, usePriming);
+            best = ranking.empty() ? "" : ranking.front().first;
+        });
+        if (result) {
+            result->extra["db_size"] = tracks.size();
+            result->extra["compressor"] = compressor;
+            result->extra["correct"] = best == "track" + to_string(expected) + ".feat";
+        }
+    }
+    return true;
+}
+
+json toJson(const Result& result) {
+    json entry = {{"name", result.name},
+                  {"iterations", result.iterations},
+                  {"mean_ns", result.meanNs},
+                  {"median_ns", result.medianNs},
+                  {"min_ns", result.minNs},
+                  {"max_ns", result.maxNs}};
+    if (!result.preset.empty()) entry["preset"] = result.preset;
+    if (result.bytes > 0) {
+        entry["bytes"] = result.bytes;
+        entry["mb_per_s"] = result.bytes / result.medianNs * 1e3;
+    }
+    for (auto& [key, value] : result.extra.items()) entry[key] = value;
+    return entry;
+}
+
+/**
+ * @brief Compare medians with an earlier results file
+ * @return Number of benchmarks slower than the baseline by more than the tolerance
+ */
+int compareBaseline(const string& baselineFile, const vector<Result>& results, double tolerance) {
+    ifstream in(baselineFile);
+    json baseline;
+    try {
+        in >> baseline;
+    } catch (const exception& e) {
+        cerr << "Error parsing baseline file " << baselineFile << ": " << e.what() << endl;
+        return -1;
+    }
+    map<string, double> previous;
+    for (const auto& entry : baseline.value("results", json::array())) {
+        previous[entry.value("name", "")] = entry.value("median_ns", 0.0);
+    }
+
+    int regressions = 0;
+    for (const auto& result : results) {
+        auto it = previous.find(result.name);
+        if (it == previous.end() || it->second <= 0) continue;
+        double change = (result.medianNs / it->second - 1.0) * 100.0;
+        if (change > tolerance) {
+            cout << "Regression: " << result.name << " " << fixed << setprecision(0) << result.medianNs
+                 << " ns vs " << it->second << " ns (+" << setprecision(1) << change << "%)" << endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+}
+
+/**
+ * @brief Benchmark suite.
+ * Usage: bench [--output bench_results.json] [--baseline previous.json]
+ */
+int main(int argc, char* argv[]) {
+    string outputFile = "bench_results.json";
+    string configDir = "config";
+    string compressorList = "gzip,bzip2,lzma,zstd,fcm";
+    size_t dbSize = 20;
+    double trackSeconds = 10.0;
+    double querySeconds = 4.0;
+    double minMillis = 200.0;
+    string filter;
+    unsigned int userThreadCount = 0;
+    string baselineFile;
+    double tolerance = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg == "--config-dir" && i + 1 < argc) {
+            configDir = argv[++i];
+        } else if (arg == "--compressors" && i + 1 < argc) {
+            compressorList = argv[++i];
+        } else if (arg == "--db-size" && i + 1 < argc) {
+            dbSize = static_cast<size_t>(max(1, stoi(argv[++i])));
+        } else if (arg == "--track-seconds" && i + 1 < argc) {
+            trackSeconds = stod(argv[++i]);
+        } else if (arg == "--query-seconds" && i + 1 < argc) {
+            querySeconds = stod(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minMillis = stod(argv[++i]);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            userThreadCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = stod(argv[++i]);
+        } else {
+            cerr << "Error: Unknown argument: " << arg << endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (trackSeconds < 1.0 || querySeconds <= 0.0 || querySeconds > trackSeconds - 0.5) {
+        cerr << "Error: Need --track-seconds >= 1 and 0 < --query-seconds <= track length - 0.5" << endl;
+        return 1;
+    }
+
+    vector<string> compressors;
+    stringstream list(compressorList);
+    string spec;
+    while (getline(list, spec, ',')) {
+        CompressorSpec parsed;
+        if (spec.empty()) continue;
+        if (!CompressorSpec::parse(spec, parsed)) return 1;
+        compressors.push_back(spec);
+    }
+    if (compressors.empty()) {
+        cerr << "Error: No compressors given" << endl;
+        return 1;
+    }
+
+    vector<Preset> presets;
+    if (!loadPresets(configDir, presets)) {
+        return 1;
+    }
+
+    string workDir = (filesystem::temp_directory_path() / ("bench_" + to_string(getpid()))).string();
+    error_code ec;
+    filesystem::create_directories(workDir, ec);
+    if (ec) {
+        cerr << "Error: Could not create " << workDir << ": " << ec.message() << endl;
+        return 1;
+    }
+
+    Runner runner(minMillis, filter);
+    ThreadPool pool(ThreadPool::threadCountFor(userThreadCount, dbSize));
+    cout << "Kernels: " << SpectralKernels::active().name << ", threads: " << pool.size() << endl;
+
+    bool ok = true;
+    benchFFT(runner);
+    for (const auto& preset : presets) {
+        cout << "Frame stages (" << preset.name << "):" << endl;
+        benchStages(runner, preset);
+    }
+
+    vector<int16_t> track = synthTrack(1, trackSeconds);
+    ok = ok && benchDecode(runner, workDir, track);
+
+    // Compression input: text features of distinct synthetic tracks, like the files in a database
+    bool compressWanted = false;
+    for (const auto& compressor : compressors) {
+        for (size_t size : COMPRESS_SIZES) compressWanted = compressWanted || runner.wanted(compressName(compressor, size));
+    }
+    if (ok && compressWanted) {
+        string trackWav = workDir + "/features_source.wav";
+        Preset spectral{"", "spectral", 4, 64, 1024, 512};
+        string features;
+        for (unsigned int seed = 1; ok && features.size() < 1024 * 1024; seed++) {
+            ok = writeWav(trackWav, synthTrack(seed, trackSeconds), 16);
+            string text = ok ? extractText(trackWav, spectral) : "";
+            ok = ok && !text.empty();
+            features += text;
+        }
+        ok = ok && benchCompression(runner, workDir, compressors, features);
+    }
+
+    // Synthetic database plus a noisy excerpt of one of its tracks as the query
+    bool identifyWanted = false;
+    for (const auto& preset : presets) {
+        identifyWanted = identifyWanted || runner.wanted("identify/" + preset.name) ||
+                         runner.wanted("identify/" + preset.name + "/primed");
+    }
+    if (ok && identifyWanted) {
+        cout << "Identification (" << dbSize << " tracks, " << compressors.front() << "):" << endl;
+        vector<string> tracks(dbSize);
+        for (size_t i = 0; ok && i < dbSize; i++) {
+            tracks[i] = workDir + "/track" + to_string(i) + ".wav";
+            ok = writeWav(tracks[i], synthTrack(static_cast<unsigned int>(100 + i), trackSeconds), 16);
+        }
+        size_t expected = dbSize / 2;
+        vector<int16_t> source = synthTrack(static_cast<unsigned int>(100 + expected), trackSeconds);
+        size_t offset = static_cast<size_t>(0.5 * SAMPLE_RATE) * 2;
+        size_t length = static_cast<size_t>(querySeconds * SAMPLE_RATE) * 2;
+        vector<int16_t> excerpt(source.begin() + offset, source.begin() + offset + length);
+        mt19937 gen(42);
+        uniform_int_distribution<int> noise(-800, 800);
+        for (auto& s : excerpt) s = static_cast<int16_t>(max(-32768, min(32767, s + noise(gen))));
+        string queryWav = workDir + "/query.wav";
+        ok = ok && writeWav(queryWav, excerpt, 16);
+
+        for (size_t p = 0; ok && p < presets.size(); p++) {
+            ok = benchIdentify(runner, presets[p], workDir, tracks, queryWav, expected, compressors.front(), pool);
+        }
+    }
+    filesystem::remove_all(workDir, ec);
+    if (!ok) {
+        return 1;
+    }
+
+    json output;
+    output["version"] = 1;
+    output["kernels"] = SpectralKernels::active().name;
+    output["threads"] = pool.size();
+    output["settings"] = {{"min_time_ms", minMillis},
+                          {"db_size", dbSize},
+                          {"track_seconds", trackSeconds},
+                          {"query_seconds", querySeconds},
+                          {"compressors", compressors}};
+    output["presets"] = json::array();
+    for (const auto& preset : presets) {
+        output["presets"].push_back({{"name", preset.name},
+                                     {"method", preset.method},
+                                     {"frequencies", preset.numFrequencies},
+                                     {"bins", preset.numBins},
+                                     {"frameSize", preset.frameSize},
+                                     {"hopSize", preset.hopSize},
+                                     {"peakSpacing", preset.peakSpacing}});
+    }
+    output["results"] = json::array();
+    for (const auto& result : runner.results) {
+        output["results"].push_back(toJson(result));
+    }
+
+    ofstream out(outputFile);
+    out << output.dump(2) << endl;
+    if (!out) {
+        cerr << "Error: Could not write " << outputFile << endl;
+        return 1;
+    }
+    cout << "Results written to " << outputFile << endl;
+
+    if (!baselineFile.empty()) {
+        int regressions = compareBaseline(baselineFile, runner.results, tolerance);
+        if (regressions < 0) return 1;
+        if (regressions > 0) {
+            cout << regressions << " benchmark(s) slower than " << baselineFile << " by more than "
+                 << tolerance << "%" << endl;
+            return 2;
+        }
+        cout << "No regressions against " << baselineFile << " (tolerance " << tolerance << "%)" << endl;
+    }
+    return 0;
+}
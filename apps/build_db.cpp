@@ -0,0 +1,266 @@
+#include "../include/core/FeatureDatabase.h"
+#include "../include/core/FeatureFile.h"
+#include "../include/utils/CompressionCache.h"
+#include "../include/utils/CompressorWrapper.h"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void printUsage() {
+    cout << "Usage: build_db [OPTIONS] <features_dir> <output_file>\n";
+    cout << "Pack the feature files of an extract_features output folder into one database file\n";
+    cout << "(with an index and precomputed compressed sizes) that music_id accepts as <database_dir>.\n";
+    cout << "Options:\n";
+    cout << "  --binary              Pack binary feature files (.featbin) instead of text (.feat)\n";
+    cout << "  --compressors <list>  Comma-separated compressors to store sizes for, each as\n";
+    cout << "                        name[:level][:w<window log>][:t<threads>] (e.g. gzip,zstd:3)\n";
+    cout << "                        [default: every in-process backend among gzip, bzip2, lzma, zstd, fcm]\n";
+    cout << "  --threads <n>         Number of threads to compress with [default: all available]\n";
+    cout << "  --shards <n>          Split the database into n shards, <output>.shard<i><extension>, for\n";
+    cout << "                        music_id --shards (tracks are dealt out in name order)\n";
+    cout << "  --segment <seconds>   Store overlapping segments of this length instead of whole tracks; a\n";
+    cout << "                        query is then ranked by the best segment of each track (about the query\n";
+    cout << "                        length, e.g. 10 for extract_sample.sh samples) [default: 0, whole tracks]\n";
+    cout << "  --segment-hop <s>     Distance between segment starts [default: half the segment length]\n";
+    cout << "  --no-cache            Do not read or update the compressed size cache (<features_dir>/.ncd_cache.json)\n";
+    cout << "  -h, --help            Show this help message\n";
+    cout << endl;
+}
+
+/**
+ * @brief Pack a feature folder into a database file
+ * Usage: build_db [--binary] features_dir output_file
+ */
+int main(int argc, char* argv[]) {
+    string featuresDir;
+    string outputFile;
+    bool useBinary = false;
+    bool useCache = true;
+    string compressorList;
+    unsigned int userThreadCount = 0;
+    int shardCount = 1;
+    double segmentSeconds = 0;
+    double segmentHop = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg == "--binary") {
+            useBinary = true;
+        } else if (arg == "--compressors" && i + 1 < argc) {
+            compressorList = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            userThreadCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shardCount = stoi(argv[++i]);
+        } else if (arg == "--segment" && i + 1 < argc) {
+            segmentSeconds = stod(argv[++i]);
+        } else if (arg == "--segment-hop" && i + 1 < argc) {
+            segmentHop = stod(argv[++i]);
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (featuresDir.empty()) {
+            featuresDir = arg;
+        } else if (outputFile.empty()) {
+            outputFile = arg;
+        }
+    }
+
+    if (featuresDir.empty() || outputFile.empty()) {
+        printUsage();
+        return 1;
+    }
+    if (shardCount < 1) {
+        cerr << "Error: Invalid shard count: " << shardCount << endl;
+        return 1;
+    }
+    if (segmentSeconds < 0 || segmentHop < 0) {
+        cerr << "Error: Invalid segment length" << endl;
+        return 1;
+    }
+    if (segmentHop == 0) {
+        segmentHop = segmentSeconds / 2;
+    }
+    bool segmented = segmentSeconds > 0;
+    if (!filesystem::is_directory(featuresDir)) {
+        cerr << "Error: Features directory does not exist: " << featuresDir << endl;
+        return 1;
+    }
+
+    vector<string> compressors;
+    if (compressorList.empty()) {
+        for (const char* name : {"gzip", "bzip2", "lzma", "zstd", "fcm"}) {
+            if (CompressorWrapper::hasBackend(name)) compressors.push_back(name);
+        }
+    } else {
+        stringstream list(compressorList);
+        string name;
+        while (getline(list, name, ',')) {
+            CompressorSpec spec;
+            if (name.empty()) continue;
+            if (!CompressorSpec::parse(name, spec)) return 1;
+            compressors.push_back(name);
+        }
+    }
+
+    // Gather the feature files, sorted so the database does not depend on directory order
+    string extension = useBinary ? ".featbin" : ".feat";
+    vector<string> files;
+    try {
+        for (auto& entry : filesystem::directory_iterator(featuresDir)) {
+            if (entry.is_regular_file() && entry.path().extension() == extension) {
+                files.push_back(entry.path().string());
+            }
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error reading features directory: " << e.what() << endl;
+        return 1;
+    }
+    if (files.empty()) {
+        cerr << "Error: No " << extension << " files found in " << featuresDir << endl;
+        return 1;
+    }
+    sort(files.begin(), files.end());
+    if (static_cast<size_t>(shardCount) > files.size()) {
+        cerr << "Error: Cannot split " << files.size() << " files into " << shardCount << " shards" << endl;
+        return 1;
+    }
+
+    vector<string> names(files.size());
+    vector<Buffer> contents(files.size());
+    vector<Buffer> ncdContents(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        names[i] = filesystem::path(files[i]).filename().string();
+        if (!Buffer::fromFile(files[i], contents[i]) ||
+            !FeatureFile::contentOf(contents[i], files[i], ncdContents[i])) {
+            return 1;
+        }
+    }
+    cout << "Packing " << files.size() << " " << extension << " files from " << featuresDir << endl;
+
+    // Entry e belongs to track entryTrack[e] (one entry per track unless segmented)
+    vector<size_t> entryTrack(files.size());
+    for (size_t i = 0; i < files.size(); i++) entryTrack[i] = i;
+    if (segmented) {
+        vector<string> segmentNames;
+        vector<Buffer> segmentContents;
+        vector<Buffer> segmentNcdContents;
+        entryTrack.clear();
+        for (size_t i = 0; i < files.size(); i++) {
+            vector<Buffer> segments;
+            vector<uint64_t> starts;
+            if (!FeatureFile::segment(contents[i], files[i], segmentSeconds, segmentHop, segments, starts)) {
+                return 1;
+            }
+            for (size_t s = 0; s < segments.size(); s++) {
+                Buffer content;
+                if (!FeatureFile::contentOf(segments[s], files[i], content)) {
+                    return 1;
+                }
+                segmentNames.push_back(FeatureDatabase::segmentName(names[i], starts[s]));
+                segmentContents.push_back(move(segments[s]));
+                segmentNcdContents.push_back(move(content));
+                entryTrack.push_back(i);
+            }
+        }
+        names = move(segmentNames);
+        contents = move(segmentContents);
+        ncdContents = move(segmentNcdContents);
+        useCache = false;  // The cache is keyed by file, so segments are always compressed
+        cout << "Split into " << names.size() << " segments of " << segmentSeconds << " s every "
+             << segmentHop << " s" << endl;
+    }
+    size_t entryCount = names.size();
+
+    // Compressed sizes of the NCD content of each entry, for each compressor
+    CompressionCache cache(CompressionCache::defaultPath(featuresDir));
+    if (useCache) {
+        cache.load();
+    }
+    unsigned int threadCount = userThreadCount > 0 ? userThreadCount : thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 2;  // Default if detection fails
+    threadCount = min(threadCount, static_cast<unsigned int>(entryCount));
+
+    vector<string> sizeKeys;
+    vector<vector<long>> sizes;
+    for (const auto& compressor : compressors) {
+        string sizeKey = CompressorWrapper::sizeKey(compressor);
+        vector<long> column(entryCount, 0);
+        atomic<size_t> nextEntry(0);
+        atomic<bool> failed(false);
+
+        auto worker = [&]() {
+            CompressorWrapper cw;
+            for (size_t i = nextEntry++; i < entryCount; i = nextEntry++) {
+                column[i] = useCache ? cache.compressedSize(files[i], ncdContents[i], compressor)
+                                     : cw.compressedSize(compressor, ncdContents[i]);
+                if (column[i] <= 0) failed = true;
+            }
+        };
+        vector<thread> workers;
+        for (unsigned int t = 0; t < threadCount; t++) {
+            workers.emplace_back(worker);
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+
+        if (failed) {
+            cerr << "Warning: Could not compress every entry with " << compressor << ", skipping its sizes" << endl;
+            continue;
+        }
+        cout << "  Compressed sizes computed for " << sizeKey << endl;
+        sizeKeys.push_back(sizeKey);
+        sizes.push_back(move(column));
+    }
+
+    if (useCache) {
+        cout << "Compressed size cache: " << cache.hits() << " hits, " << cache.misses() << " misses" << endl;
+        cache.save();
+    }
+
+    if (shardCount == 1) {
+        if (!FeatureDatabase::write(outputFile, names, contents, useBinary, sizeKeys, sizes, segmented)) {
+            return 1;
+        }
+        cout << "Database written to " << outputFile << " (" << filesystem::file_size(outputFile) << " bytes)" << endl;
+        return 0;
+    }
+
+    // Track i goes to shard i % n, so every shard gets a similar share of the catalog (and
+    // all segments of a track end up in the same shard)
+    filesystem::path output(outputFile);
+    for (int s = 0; s < shardCount; s++) {
+        vector<string> shardNames;
+        vector<Buffer> shardContents;
+        vector<vector<long>> shardSizes(sizeKeys.size());
+        for (size_t i = 0; i < entryCount; i++) {
+            if (entryTrack[i] % shardCount != static_cast<size_t>(s)) continue;
+            shardNames.push_back(names[i]);
+            shardContents.push_back(move(contents[i]));
+            for (size_t k = 0; k < sizeKeys.size(); k++) {
+                shardSizes[k].push_back(sizes[k][i]);
+            }
+        }
+        filesystem::path shardFile = output.parent_path() /
+            (output.stem().string() + ".shard" + to_string(s) + output.extension().string());
+        if (!FeatureDatabase::write(shardFile.string(), shardNames, shardContents, useBinary, sizeKeys, shardSizes,
+                                    segmented)) {
+            return 1;
+        }
+        cout << "Shard " << s << " written to " << shardFile.string() << " (" << shardNames.size() << " entries, "
+             << filesystem::file_size(shardFile) << " bytes)" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include "../include/core/NCDMatrix.h"
+#include "../include/utils/CompressorWrapper.h"
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+void printUsage() {
+    cout << "Usage: compute_ncd [OPTIONS] <features_dir|file_list> <output_file>\n";
+    cout << "Compute the NCD between every pair of feature files in a directory (or listed one\n";
+    cout << "per line in a file) and write the matrix as CSV (.csv) or binary (anything else).\n";
+    cout << "Options:\n";
+    cout << "  --compressor <comp>   Compressor to use (gzip, bzip2, lzma, zstd, fcm) [default: gzip]\n";
+    cout << "                        as name[:level][:w<window log>][:t<threads>], e.g. zstd:3 or lzma:6:w20\n";
+    cout << "  --binary              Use binary feature files (.featbin) instead of text (.feat)\n";
+    cout << "  --format <fmt>        Output format (csv, bin) [default: from the output extension]\n";
+    cout << "  --threads <n>         Number of threads to use [default: all available]\n";
+    cout << "  --tile <n>            Files per tile side of the pair grid [default: 32]\n";
+    cout << "  --prime               Compress each row file once per tile and continue from a copy\n";
+    cout << "                        of that state for every column (gzip: exact)\n";
+    cout << "  -h, --help            Show this help message\n";
+    cout << endl;
+}
+
+/**
+ * Collect feature files from a directory (sorted by name) or from a list file
+ */
+bool collectFiles(const string& input, bool useBinary, vector<string>& files) {
+    string extension = useBinary ? ".featbin" : ".feat";
+    try {
+        if (filesystem::is_directory(input)) {
+            for (auto& entry : filesystem::directory_iterator(input)) {
+                if (entry.is_regular_file() && entry.path().extension() == extension) {
+                    files.push_back(entry.path().string());
+                }
+            }
+            sort(files.begin(), files.end());
+        } else {
+            ifstream list(input);
+            if (!list) {
+                cerr << "Error: Could not open file list: " << input << endl;
+                return false;
+            }
+            string line;
+            while (getline(list, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) files.push_back(line);
+            }
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error reading features directory: " << e.what() << endl;
+        return false;
+    }
+
+    if (files.empty()) {
+        cerr << "Error: No " << extension << " files found in " << input << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compute an all-pairs NCD matrix.
+ * Usage: compute_ncd [--compressor gzip] features_dir matrix.csv
+ */
+int main(int argc, char* argv[]) {
+    string input;
+    string outputFile;
+    string compressor = "gzip";
+    string format;
+    bool useBinary = false;
+    NCDMatrix::Options options;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg == "--compressor" && i + 1 < argc) {
+            compressor = argv[++i];
+        } else if (arg == "--binary") {
+            useBinary = true;
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threadCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (arg == "--tile" && i + 1 < argc) {
+            options.tileSize = static_cast<size_t>(max(1, stoi(argv[++i])));
+        } else if (arg == "--prime") {
+            options.usePriming = true;
+        } else if (input.empty()) {
+            input = arg;
+        } else if (outputFile.empty()) {
+            outputFile = arg;
+        }
+    }
+
+    if (input.empty() || outputFile.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    CompressorSpec spec;
+    if (!CompressorSpec::parse(compressor, spec)) {
+        return 1;
+    }
+    if (format.empty()) {
+        format = filesystem::path(outputFile).extension() == ".csv" ? "csv" : "bin";
+    }
+    if (format != "csv" && format != "bin") {
+        cerr << "Error: Invalid format: " << format << endl;
+        cerr << "Valid options: csv, bin" << endl;
+        return 1;
+    }
+    if (options.usePriming && !CompressorWrapper::hasBackend(compressor)) {
+        cerr << "Warning: --prime needs an in-process " << compressor << " backend; compressing in full" << endl;
+    }
+
+    vector<string> files;
+    if (!collectFiles(input, useBinary, files)) {
+        return 1;
+    }
+
+    NCDMatrix matrix;
+    if (!matrix.compute(files, compressor, options)) {
+        return 1;
+    }
+
+    bool written = format == "csv" ? matrix.writeCSV(outputFile) : matrix.writeBinary(outputFile);
+    if (!written) {
+        return 1;
+    }
+    cout << "NCD matrix (" << matrix.size() << " x " << matrix.size() << ") saved to " << outputFile << endl;
+    return 0;
+}
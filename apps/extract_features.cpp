@@ -1,5 +1,8 @@
 #include "../include/utils/json.hpp" 
 #include "../include/core/FeatureExtractor.h"
+#include "../include/core/Metrics.h"
+#include "../include/core/ThreadPool.h"
+#include "../include/utils/CompressorWrapper.h"
 
 #include <iostream>
 #include <filesystem>
@@ -13,6 +16,8 @@
 #include <cstddef> // for size_t
 #include <string>
 #include <list> // for std::list
+#include <memory>
+#include <sstream>
 
 using namespace std;
 using namespace FeatureExtractor;
@@ -31,15 +36,29 @@ using std::list;
 
 void printUsage() {
     cout << "Usage: extract_features [OPTIONS] <input_path> <output_folder>\n";
+    cout << "       extract_features [OPTIONS] --pack <file.featdb> <input_path>\n";
     cout << "Options:\n";
     cout << "  --method <method>      Feature extraction method (spectral, maxfreq) [default: spectral]\n";
     cout << "  --frequencies <n>      Number of frequencies per frame (maxfreq) [default: 4]\n";
+    cout << "  --peak-spacing <n>     Pick only local maxima with no stronger bin within n bins (maxfreq)\n";
+    cout << "                         [default: 0, the strongest bins]\n";
     cout << "  --bins <n>             Number of frequency bins (spectral) [default: 32]\n";
     cout << "  --frame-size <n>       Frame size in samples [default: 1024]\n";
     cout << "  --hop-size <n>         Hop size in samples [default: 512]\n";
     cout << "  --config <file>        Load parameters from JSON config file\n";
     cout << "  --binary               Save features in binary format (.featbin) instead of text (.feat)\n";
+    cout << "  --quantize <type>      Value encoding of binary features (float32, uint16, uint8, delta8) [default: float32]\n";
     cout << "  --threads <n>          Number of threads to use [default: all available]\n";
+    cout << "  --incremental          Skip WAV files whose features are up to date with the same parameters\n";
+    cout << "                         and remove features whose WAV file is gone\n";
+    cout << "                         (tracked in <output_folder>/.extraction_manifest.json)\n";
+    cout << "  --writers <n>          Number of threads writing the output files [default: 4]\n";
+    cout << "  --pack <file>          Write the features straight into a packed database (as build_db\n";
+    cout << "                         does) instead of one file each in an output folder\n";
+    cout << "  --compressors <list>   Compressors to store sizes for with --pack (see build_db)\n";
+    cout << "                         [default: every in-process backend among gzip, bzip2, lzma, zstd, fcm]\n";
+    cout << "  --metrics <file>       Write per-stage timing histograms and counters on exit\n";
+    cout << "                         (Prometheus text for .prom/.txt, JSON otherwise)\n";
     cout << "  -h, --help             Show this help message\n";
     cout << "  -i, --input <path>     Input folder or WAV file\n";
     cout << "  -o, --output <folder>  Output folder for extracted features\n";
@@ -47,7 +66,11 @@ void printUsage() {
 }
 
 /**
- * Process all WAV files in a directory using multiple threads
+ * Process all WAV files in a directory with the extraction pipeline (see extractFeaturesFromFiles).
+ * Files are handed out largest first, so long tracks start early and the short ones fill
+ * in the gaps instead of piling up behind one thread.
+ * @param output Writer the features are queued on (files in outFolder, or a packed database)
+ * @param manifest Incremental mode: files it reports up to date are skipped
  */
 void processDirectory(
     const string& inFolder, 
@@ -58,6 +81,10 @@ void processDirectory(
     int frameSize, 
     int hopSize,
     bool useBinary,
+    FeatureFile::Encoding encoding,
+    int peakSpacing,
+    OutputWriter& output,
+    ExtractionManifest* manifest,
     unsigned int userThreadCount = 0
 ) {
     // Track metrics with atomic variables for thread safety
@@ -70,16 +97,21 @@ void processDirectory(
     
     if (method == "maxfreq") {
         cout << "Extracting " << numFrequencies << " peak frequencies per frame" << endl;
+        if (peakSpacing > 0) {
+            cout << "Picking local maxima at least " << peakSpacing + 1 << " bins apart" << endl;
+        }
     } else {
         cout << "Using " << numBins << " frequency bins" << endl;
     }
     
-    // Get list of WAV files
-    std::list<std::string> wavFiles;
+    // Get list of WAV files with their sizes
+    vector<pair<uintmax_t, string>> wavFiles;
     try {
         for (auto& entry : filesystem::directory_iterator(inFolder)) {
             if (entry.path().extension() == ".wav") {
-                wavFiles.push_back(entry.path().string());
+                error_code ec;
+                uintmax_t size = entry.file_size(ec);
+                wavFiles.emplace_back(ec ? 0 : size, entry.path().string());
             }
         }
     } catch (const filesystem::filesystem_error& e) {
@@ -88,58 +120,59 @@ void processDirectory(
     }
     size_t wavCount = wavFiles.size();
     cout << "Found " << wavCount << " WAV files to process" << endl;
+
+    // Largest first (ties by name, so the order is reproducible)
+    sort(wavFiles.begin(), wavFiles.end(), [](const pair<uintmax_t, string>& a, const pair<uintmax_t, string>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
     
-    // Determine optimal number of threads
-    unsigned int threadCount = userThreadCount > 0 ? userThreadCount : thread::hardware_concurrency();
-    if (threadCount == 0) threadCount = 2;  // Default if detection fails
-    threadCount = std::min(threadCount, static_cast<unsigned int>(wavCount));
-    cout << "Using " << threadCount << " threads to process " << wavCount << " files" << endl;
-    
-    // Thread-safe console output
-    mutex coutMutex;
-    
-    // Define the file processing function for each thread
-    auto processFileBatch = [&](size_t start, size_t end) {
-        auto it = wavFiles.begin();
-        std::advance(it, start);
-        for (size_t i = start; i < end && it != wavFiles.end(); ++i, ++it) {
-            extractFeaturesFromFile(
-                *it, outFolder, method,
-                numFrequencies, numBins, frameSize, hopSize,
-                coutMutex, filesProcessed, filesSkipped, useBinary
-            );
+    vector<string> orderedFiles;
+    orderedFiles.reserve(wavCount);
+    int upToDate = 0;
+    for (const auto& file : wavFiles) {
+        if (manifest && manifest->upToDate(file.second, outputFile(file.second, outFolder, method, useBinary))) {
+            upToDate++;
+            continue;
         }
-    };
-    
-    // Create and launch threads
-    size_t filesPerThread = (wavCount + threadCount - 1) / threadCount;
-    std::list<std::thread> threads;
-    for (unsigned int t = 0; t < threadCount; t++) {
-        size_t start = t * filesPerThread;
-        size_t end = std::min((t + 1) * filesPerThread, wavCount);
-        if (start >= wavCount) break;
-        threads.emplace_back(processFileBatch, start, end);
+        orderedFiles.push_back(file.second);
     }
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
-        }
+    if (manifest) {
+        cout << upToDate << " files up to date, " << orderedFiles.size() << " to extract" << endl;
+        filesSkipped += upToDate;
     }
+
+    // Determine optimal number of threads
+    unsigned int threadCount = ThreadPool::threadCountFor(userThreadCount, orderedFiles.size());
+    cout << "Using " << threadCount << " threads to process " << orderedFiles.size() << " files" << endl;
+    
+    extractFeaturesFromFiles(
+        orderedFiles, outFolder, method,
+        numFrequencies, numBins, frameSize, hopSize,
+        useBinary, encoding, threadCount, filesProcessed, filesSkipped, peakSpacing, &output, manifest
+    );
     
     auto endTime = chrono::high_resolution_clock::now();
     auto totalTime = chrono::duration_cast<chrono::seconds>(endTime - startTime).count();
     
     cout << "\nFeature extraction summary:" << endl;
     cout << "  Files processed: " << filesProcessed << endl;
-    cout << "  Files skipped: " << filesSkipped << endl;
+    cout << "  Files skipped: " << filesSkipped;
+    if (manifest) {
+        cout << " (" << upToDate << " up to date)";
+    }
+    cout << endl;
     cout << "  Total time: " << totalTime << " seconds" << endl;
     
     // Save configuration to output directory
-    saveConfig(outFolder, method, numFrequencies, numBins, frameSize, hopSize, filesProcessed);
+    if (!output.packed()) {
+        saveConfig(outFolder, method, numFrequencies, numBins, frameSize, hopSize, filesProcessed + upToDate,
+                   peakSpacing);
+    }
 }
 
 /**
- * Process a single WAV file
+ * Process a single WAV file (through the extraction pipeline when packing)
+ * @param manifest Incremental mode: the file is skipped if it reports it up to date
  */
 void processFile(
     const string& wavFile, 
@@ -149,21 +182,41 @@ void processFile(
     int numBins,
     int frameSize, 
     int hopSize,
-    bool useBinary
+    bool useBinary,
+    FeatureFile::Encoding encoding,
+    int peakSpacing,
+    OutputWriter& output,
+    ExtractionManifest* manifest
 ) {
     cout << "Processing single WAV file: " << wavFile << endl;
     
     atomic<int> filesProcessed(0);
     atomic<int> filesSkipped(0);
+    string featureFile = outputFile(wavFile, outFolder, method, useBinary);
+    if (manifest && manifest->upToDate(wavFile, featureFile)) {
+        cout << "  Features are up to date: " << featureFile << endl;
+        return;
+    }
     mutex coutMutex; // Not really needed for single file but keeps interface consistent
 
     auto startTime = chrono::high_resolution_clock::now();
     
-    extractFeaturesFromFile(
-        wavFile, outFolder, method,
-        numFrequencies, numBins, frameSize, hopSize,
-        coutMutex, filesProcessed, filesSkipped, useBinary
-    );
+    if (output.packed()) {
+        extractFeaturesFromFiles(
+            {wavFile}, outFolder, method,
+            numFrequencies, numBins, frameSize, hopSize,
+            useBinary, encoding, 1, filesProcessed, filesSkipped, peakSpacing, &output
+        );
+    } else {
+        bool extracted = extractFeaturesFromFile(
+            wavFile, outFolder, method,
+            numFrequencies, numBins, frameSize, hopSize,
+            coutMutex, filesProcessed, filesSkipped, useBinary, encoding, peakSpacing
+        );
+        if (extracted && manifest) {
+            manifest->record(wavFile, featureFile);
+        }
+    }
     
     auto endTime = chrono::high_resolution_clock::now();
     auto totalTime = chrono::duration_cast<chrono::seconds>(endTime - startTime).count();
@@ -174,7 +227,9 @@ void processFile(
     cout << "  Total time: " << totalTime << " seconds" << endl;
     
     // Save configuration to output directory
-    saveConfig(outFolder, method, numFrequencies, numBins, frameSize, hopSize, filesProcessed);
+    if (!output.packed()) {
+        saveConfig(outFolder, method, numFrequencies, numBins, frameSize, hopSize, filesProcessed, peakSpacing);
+    }
 }
 
 /**
@@ -185,6 +240,7 @@ int main(int argc, char* argv[]) {
     // Default values
     string method = "spectral";
     int numFrequencies = 4;
+    int peakSpacing = 0;
     int numBins = 32;
     int frameSize = 1024;
     int hopSize = 512;
@@ -192,7 +248,13 @@ int main(int argc, char* argv[]) {
     string outFolder;
     string configFile;
     bool useBinary = false;
+    string quantize = "float32";
     unsigned int userThreadCount = 0;
+    unsigned int writerCount = 0;
+    bool incremental = false;
+    string packFile;
+    string compressorList;
+    string metricsFile;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -205,6 +267,8 @@ int main(int argc, char* argv[]) {
             method = argv[++i];
         } else if (arg == "--frequencies" && i + 1 < argc) {
             numFrequencies = stoi(argv[++i]);
+        } else if (arg == "--peak-spacing" && i + 1 < argc) {
+            peakSpacing = stoi(argv[++i]);
         } else if (arg == "--bins" && i + 1 < argc) {
             numBins = stoi(argv[++i]);
         } else if (arg == "--frame-size" && i + 1 < argc) {
@@ -215,8 +279,20 @@ int main(int argc, char* argv[]) {
             configFile = argv[++i];
         } else if (arg == "--binary") {
             useBinary = true;
+        } else if (arg == "--quantize" && i + 1 < argc) {
+            quantize = argv[++i];
         } else if (arg == "--threads" && i + 1 < argc) {
             userThreadCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (arg == "--incremental") {
+            incremental = true;
+        } else if (arg == "--writers" && i + 1 < argc) {
+            writerCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (arg == "--pack" && i + 1 < argc) {
+            packFile = argv[++i];
+        } else if (arg == "--compressors" && i + 1 < argc) {
+            compressorList = argv[++i];
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metricsFile = argv[++i];
         } else if ((arg == "-i" || arg == "--input") && i + 1 < argc) {
             inputPath = argv[++i];
         } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
@@ -242,9 +318,12 @@ int main(int argc, char* argv[]) {
             // Override defaults with config values
             if (config.contains("method")) method = config["method"];
             if (config.contains("frequencies")) numFrequencies = config["frequencies"];
+            if (config.contains("peakSpacing")) peakSpacing = config["peakSpacing"];
             if (config.contains("bins")) numBins = config["bins"];
             if (config.contains("frameSize")) frameSize = config["frameSize"];
             if (config.contains("hopSize")) hopSize = config["hopSize"];
+            if (config.contains("quantize")) quantize = config["quantize"];
+            if (config.contains("incremental")) incremental = config["incremental"];
             if (config.contains("input")) inputPath = config["input"];
             if (config.contains("output")) outFolder = config["output"];
             
@@ -262,7 +341,7 @@ int main(int argc, char* argv[]) {
         cout << "Using default input path: " << inputPath << endl;
     }
     
-    if (outFolder.empty()) {
+    if (outFolder.empty() && packFile.empty()) {
         outFolder = "data/features";  // Default output directory
         cout << "Using default output folder: " << outFolder << endl;
     }
@@ -277,6 +356,23 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    FeatureFile::Encoding encoding;
+    if (!FeatureFile::parseEncoding(quantize, encoding)) {
+        cerr << "Error: Invalid quantization: " << quantize << endl;
+        cerr << "Valid options: float32, uint16, uint8, delta8" << endl;
+        return 1;
+    }
+
+    if (peakSpacing < 0) {
+        cerr << "Error: Invalid peak spacing: " << peakSpacing << endl;
+        return 1;
+    }
+
+    if (incremental && !packFile.empty()) {
+        cerr << "Error: --incremental updates an output folder and cannot be combined with --pack" << endl;
+        return 1;
+    }
+
     // Check if input exists
     if (!filesystem::exists(inputPath)) {
         cerr << "Error: Input path does not exist: " << inputPath << endl;
@@ -284,11 +380,52 @@ int main(int argc, char* argv[]) {
     }
 
     // Create output directory if it doesn't exist
-    try {
-        filesystem::create_directories(outFolder);
-    } catch (const filesystem::filesystem_error& e) {
-        cerr << "Error creating output directory: " << e.what() << endl;
-        return 1;
+    if (packFile.empty()) {
+        try {
+            filesystem::create_directories(outFolder);
+        } catch (const filesystem::filesystem_error& e) {
+            cerr << "Error creating output directory: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    if (!metricsFile.empty()) {
+        Metrics::enable(metricsFile);
+    }
+
+    OutputWriter output(writerCount);
+    if (!packFile.empty()) {
+        vector<string> compressors;
+        if (compressorList.empty()) {
+            for (const char* name : {"gzip", "bzip2", "lzma", "zstd", "fcm"}) {
+                if (CompressorWrapper::hasBackend(name)) compressors.push_back(name);
+            }
+        } else {
+            stringstream list(compressorList);
+            string name;
+            while (getline(list, name, ',')) {
+                CompressorSpec spec;
+                if (name.empty()) continue;
+                if (!CompressorSpec::parse(name, spec)) return 1;
+                compressors.push_back(name);
+            }
+        }
+        if (!output.openPacked(packFile, useBinary, compressors)) {
+            return 1;
+        }
+    }
+
+    // Incremental mode: what was extracted before, from which WAV file and with which parameters
+    unique_ptr<ExtractionManifest> manifest;
+    if (incremental) {
+        manifest = make_unique<ExtractionManifest>(
+            ExtractionManifest::defaultPath(outFolder),
+            ExtractionManifest::describe(method, numFrequencies, numBins, frameSize, hopSize, peakSpacing,
+                                         useBinary, quantize));
+        manifest->load();
+        for (const auto& name : manifest->removeOrphans(outFolder)) {
+            cout << "Removed " << name << " (WAV file no longer exists)" << endl;
+        }
     }
 
     try {
@@ -301,17 +438,28 @@ int main(int argc, char* argv[]) {
             }
             
             processFile(inputPath, outFolder, method,
-                       numFrequencies, numBins, frameSize, hopSize, useBinary);
+                       numFrequencies, numBins, frameSize, hopSize, useBinary, encoding, peakSpacing, output,
+                       manifest.get());
         } 
         else if (filesystem::is_directory(inputPath)) {
             // Process a directory
             processDirectory(inputPath, outFolder, method,
-                           numFrequencies, numBins, frameSize, hopSize, useBinary, userThreadCount);
+                           numFrequencies, numBins, frameSize, hopSize, useBinary, encoding, peakSpacing,
+                           output, manifest.get(), userThreadCount);
         }
         else {
             cerr << "Error: Input path is neither a file nor a directory: " << inputPath << endl;
             return 1;
         }
+        if (!output.finish()) {
+            return 1;
+        }
+        if (manifest) {
+            manifest->save();
+        }
+        if (!packFile.empty()) {
+            cout << "Database written to " << packFile << " (" << filesystem::file_size(packFile) << " bytes)" << endl;
+        }
         return 0;
     } 
     catch (const exception& e) {
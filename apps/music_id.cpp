@@ -1,7 +1,22 @@
 #include "../include/core/NCD.h"
 #include "../include/core/FeatureExtractor.h"
+#include "../include/core/FeatureFile.h"
+#include "../include/core/FeatureDatabase.h"
+#include "../include/core/Identification.h"
+#include "../include/core/BoundedQueue.h"
+#include "../include/core/Logger.h"
+#include "../include/core/Metrics.h"
+#include "../include/core/PrefilterIndex.h"
+#include "../include/core/TopK.h"
+#include "../include/core/ThreadPool.h"
+#include "../include/core/SpectralExtractor.h"
+#include "../include/core/MaxFreqExtractor.h"
+#include "../include/core/WAVStream.h"
+#include "../include/utils/CompressorWrapper.h"
 #include "../include/utils/json.hpp"
 #include <iostream>
+#include <chrono>
+#include <csignal>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
@@ -9,6 +24,21 @@
 #include <iomanip>
 #include <mutex>
 #include <atomic>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>  // for getpid()
 
 using namespace std;
@@ -16,15 +46,50 @@ using json = nlohmann::json;
 
 void printUsage() {
     cout << "Usage: music_id [OPTIONS] <query_file> <database_dir> <output_file>\n";
+    cout << "       music_id [OPTIONS] --batch <query_dir|query_list> <database_dir> <output_dir>\n";
+    cout << "       music_id [OPTIONS] --stream <source> <database_dir> <output_file>\n";
+    cout << "       music_id [OPTIONS] --serve <address> <database_dir>\n";
+    cout << "       music_id [OPTIONS] --shards <shard,...> <query_file> <output_file>\n";
     cout << "Query file can be either:\n";
     cout << "  - A feature file (.feat extension) - for direct comparison\n";
     cout << "  - A binary feature file (.featbin extension) - for direct comparison\n";
     cout << "  - A WAV file (.wav extension) - will extract features automatically\n";
+    cout << "Database can be a folder of feature files or a packed database file built by build_db\n";
     cout << "\nOptions:\n";
-    cout << "  --compressor <comp>   Compressor to use (gzip, bzip2, lzma, zstd) [default: gzip]\n";
+    cout << "  --compressor <comp>   Compressor to use (gzip, bzip2, lzma, zstd, fcm) [default: gzip, or the\n";
+    cout << "                        \"compressor\" entry of --config], as name[:level][:w<window log>][:t<threads>],\n";
+    cout << "                        e.g. zstd:3 or lzma:6:w20\n";
     cout << "  --top <n>             Show only top N matches [default: 10]\n";
     cout << "  --config <file>       Config file for feature extraction (when using WAV) [default: config/feature_extraction_spectral_default.json]\n";
     cout << "  --binary              Use binary feature files (.featbin) instead of text (.feat)\n";
+    cout << "  --batch <path>        Identify every query in a directory (or listed one per line in a file),\n";
+    cout << "                        loading the database once and writing <output_dir>/<query>_results.csv\n";
+    cout << "  --stream <source>     Identify live audio from - (stdin), unix:<path>, tcp:<host>:<port> or a FIFO;\n";
+    cout << "                        features are extracted with --config as the audio arrives\n";
+    cout << "  --serve <address>     Keep the database loaded and answer HTTP requests on unix:<path>,\n";
+    cout << "                        tcp:<port> (loopback) or tcp:<host>:<port>: POST a WAV or feature file\n";
+    cout << "                        to /identify[?name=<query>&top=<n>&format=csv|json], GET /health\n";
+    cout << "  --connections <n>     Requests the server handles at once [default: 4]\n";
+    cout << "  --shards <list>       Identify against a sharded database (see build_db --shards): comma-separated\n";
+    cout << "                        shard files, each ranked by a local worker process, or addresses of\n";
+    cout << "                        --serve servers; their best --top matches are merged\n";
+    cout << "  --rate <hz>           Sample rate of headerless PCM input (WAV headers are detected) [default: 44100]\n";
+    cout << "  --channels <n>        Channels of headerless PCM input [default: 2]\n";
+    cout << "  --bits <n>            Bits per sample of headerless PCM input [default: 16]\n";
+    cout << "  --window <seconds>    Length of the sliding query window in stream mode [default: 10]\n";
+    cout << "  --update <seconds>    Audio between two rankings in stream mode [default: 1]\n";
+    cout << "  --margin <ncd>        NCD lead over the runner-up needed to report a match [default: 0.01]\n";
+    cout << "  --confirm <n>         Consecutive rankings the lead must hold for [default: 3]\n";
+    cout << "  --threads <n>         Number of threads to scan the database with [default: all available]\n";
+    cout << "  --prime               Compress the query once and continue from a copy of that state for\n";
+    cout << "                        every database entry (gzip: exact, zstd: query used as dictionary)\n";
+    cout << "  --metrics <file>      Write per-stage timing histograms and counters on exit\n";
+    cout << "                        (Prometheus text for .prom/.txt, JSON otherwise)\n";
+    cout << "  --no-cache            Do not read or update the compressed size cache (<database_dir>/.ncd_cache.json)\n";
+    cout << "  --prefilter <k>       Rank only the k entries sharing the most spectral peak pairs with the query\n";
+    cout << "                        (landmark index built when the database is loaded) [default: 0, rank all]\n";
+    cout << "  --recall              With --prefilter, also rank the whole database and report how many of\n";
+    cout << "                        its best matches the prefilter kept (single and batch queries)\n";
     cout << "  -h, --help            Show this help message\n";
     cout << endl;
 }
@@ -33,7 +98,8 @@ void printUsage() {
  * Load feature extraction configuration from JSON file
  */
 bool loadConfig(const string& configFile, string& method, int& numFrequencies, 
-                int& numBins, int& frameSize, int& hopSize) {
+                int& numBins, int& frameSize, int& hopSize, FeatureFile::Encoding& encoding,
+                int& peakSpacing) {
     ifstream file(configFile);
     if (!file.is_open()) {
         cerr << "Error: Could not open config file: " << configFile << endl;
@@ -45,10 +111,17 @@ bool loadConfig(const string& configFile, string& method, int& numFrequencies,
         file >> config;
         
         method = config.value("method", "spectral");
-        numFrequencies = config.value("numFrequencies", 4);
-        numBins = config.value("numBins", 32);
+        // Same keys as extract_features (older configs used numFrequencies/numBins)
+        numFrequencies = config.value("frequencies", config.value("numFrequencies", 4));
+        numBins = config.value("bins", config.value("numBins", 32));
         frameSize = config.value("frameSize", 1024);
         hopSize = config.value("hopSize", 512);
+        peakSpacing = config.value("peakSpacing", 0);
+        string quantize = config.value("quantize", "float32");
+        if (!FeatureFile::parseEncoding(quantize, encoding)) {
+            cerr << "Error: Invalid quantization in config file: " << quantize << endl;
+            return false;
+        }
         
         return true;
     } catch (const exception& e) {
@@ -57,15 +130,53 @@ bool loadConfig(const string& configFile, string& method, int& numFrequencies,
     }
 }
 
+/**
+ * Read the optional "compressor" entry of a config file, either a spec string ("zstd:3")
+ * or an object with name, level, window (log2) and threads
+ * @return false if the entry is present but malformed; compressor is kept when it is absent
+ */
+bool loadCompressorConfig(const string& configFile, string& compressor) {
+    ifstream file(configFile);
+    if (!file.is_open()) {
+        cerr << "Error: Could not open config file: " << configFile << endl;
+        return false;
+    }
+    try {
+        json config;
+        file >> config;
+        if (!config.contains("compressor")) {
+            return true;
+        }
+        const json& entry = config["compressor"];
+        if (entry.is_string()) {
+            compressor = entry.get<string>();
+            return true;
+        }
+        CompressorSpec spec;
+        if (!CompressorSpec::parse(entry.at("name").get<string>(), spec)) {
+            return false;
+        }
+        string text = spec.name + ":" + to_string(entry.value("level", spec.level));
+        if (entry.contains("window")) text += ":w" + to_string(entry["window"].get<int>());
+        if (entry.contains("threads")) text += ":t" + to_string(entry["threads"].get<int>());
+        compressor = text;
+        return true;
+    } catch (const exception& e) {
+        cerr << "Error parsing compressor in config file: " << e.what() << endl;
+        return false;
+    }
+}
+
 /**
  * Extract features from a WAV file to a temporary feature file
  */
 string extractFeaturesFromWAV(const string& wavFile, const string& configFile, bool useBinary = false) {
     // Load configuration
     string method;
-    int numFrequencies, numBins, frameSize, hopSize;
+    int numFrequencies, numBins, frameSize, hopSize, peakSpacing;
+    FeatureFile::Encoding encoding;
     
-    if (!loadConfig(configFile, method, numFrequencies, numBins, frameSize, hopSize)) {
+    if (!loadConfig(configFile, method, numFrequencies, numBins, frameSize, hopSize, encoding, peakSpacing)) {
         return "";
     }
     
@@ -96,12 +207,13 @@ string extractFeaturesFromWAV(const string& wavFile, const string& configFile, b
     if (useBinary) {
         success = FeatureExtractor::extractFeaturesFromFile(
             wavFile, tempDir, method, numFrequencies, numBins, 
-            frameSize, hopSize, coutMutex, filesProcessed, filesSkipped, true
+            frameSize, hopSize, coutMutex, filesProcessed, filesSkipped, true, encoding, peakSpacing
         );
     } else {
         success = FeatureExtractor::extractFeaturesFromFile(
             wavFile, tempDir, method, numFrequencies, numBins, 
-            frameSize, hopSize, coutMutex, filesProcessed, filesSkipped, false
+            frameSize, hopSize, coutMutex, filesProcessed, filesSkipped, false,
+            FeatureFile::Encoding::Float32, peakSpacing
         );
     }
     
@@ -155,12 +267,121 @@ void cleanupTempFiles(const string& featFile) {
     }
 }
 
+/**
+ * Ranked results as CSV (the format read by calculate_accuracy.py)
+ */
+string formatResults(const string& queryFilename, const string& compressor,
+                     const vector<pair<string, double>>& results) {
+    ostringstream out;
+
+    // Write header
+    out << "Query: " << queryFilename << "\n";
+    out << "Compressor: " << compressor << "\n\n";
+    out << "Rank,File,NCD\n";
+
+    // Write sorted results
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << (i+1) << "," << results[i].first << "," << fixed << setprecision(6) << results[i].second << "\n";
+    }
+    return out.str();
+}
+
+/**
+ * Write ranked results as CSV (see formatResults())
+ */
+bool writeResults(const string& outputFile, const string& queryFilename, const string& compressor,
+                  const vector<pair<string, double>>& results) {
+    ofstream out(outputFile);
+    if (!out) {
+        cerr << "Error: Could not open output file for writing: " << outputFile << endl;
+        return false;
+    }
+    out << formatResults(queryFilename, compressor, results);
+    out.close();
+    return true;
+}
+
+/**
+ * Display the best matches of a query on the console
+ */
+void printTopMatches(const string& queryFilename, const vector<pair<string, double>>& results) {
+    cout << "\nTop matches for query '" << queryFilename << "':\n" << endl;
+    
+    const int rankWidth = 5;
+    const int ncdWidth = 10;
+    const int terminalWidth = 80; // Standard terminal width
+    const int filenameWidth = terminalWidth - rankWidth - ncdWidth - 2; // -2 for spacing
+    
+    cout << setw(rankWidth) << "Rank" << setw(filenameWidth) << "File" << setw(ncdWidth) << "NCD" << endl;
+    cout << string(terminalWidth - 2, '-') << endl;
+    
+    int displayCount = min(5, static_cast<int>(results.size()));
+    for (int i = 0; i < displayCount; ++i) {
+        // Truncate filename if necessary
+        string displayName = results[i].first;
+        if (displayName.length() > filenameWidth - 3) {
+            displayName = displayName.substr(0, filenameWidth - 3) + "...";
+        }
+        
+        cout << setw(rankWidth) << (i+1) 
+             << setw(filenameWidth) << displayName
+             << setw(ncdWidth) << fixed << setprecision(6) << results[i].second << endl;
+    }
+}
+
+/**
+ * Ask the prefilter index for the entries worth ranking for a query
+ * @param queryFile Whole query feature file (headers included)
+ * @return false if the database is not indexed, the query has no signature or no entry
+ * shares a landmark with it: the whole database is then ranked
+ */
+bool prefilterQuery(const Identification::Database& db, const Buffer& queryFile, const string& queryName,
+                    size_t prefilter, vector<size_t>& candidates) {
+    if (!db.indexed || prefilter == 0) return false;
+    vector<uint32_t> signature;
+    if (!PrefilterIndex::signatureOf(queryFile, queryName, signature)) {
+        return false;
+    }
+    candidates = db.prefilter.candidates(signature, prefilter);
+    if (candidates.empty()) {
+        cout << "Prefilter: no entry shares a landmark with " << queryName << "; ranking all entries" << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Recall of the prefilter for one query: how many of the best entries of the full ranking
+ * (as many as there are candidates, at most) were among the candidates
+ * @return Number of kept entries; total receives the number of entries checked
+ */
+size_t prefilterRecall(const vector<pair<string, double>>& fullResults, const vector<size_t>& candidates,
+                       const Identification::Database& db, size_t& total, bool& bestKept) {
+    vector<string> kept;
+    for (size_t e : candidates) kept.push_back(db.rankedName(e));
+    sort(kept.begin(), kept.end());
+    kept.erase(unique(kept.begin(), kept.end()), kept.end());  // Segments of one track
+
+    total = min(fullResults.size(), kept.size());
+    size_t found = 0;
+    bestKept = false;
+    for (size_t r = 0; r < total; ++r) {
+        if (binary_search(kept.begin(), kept.end(), fullResults[r].first)) {
+            found++;
+            if (r == 0) bestKept = true;
+        }
+    }
+    return found;
+}
+
 /**
  * Identify music by comparing query against database using NCD
  */
 bool identifyMusic(const string& queryFile, const string& dbDir, 
                  const string& outputFile, const string& compressor, int topN,
-                 const string& configFile, bool useBinary = false) {
+                 const string& configFile, bool useBinary = false, bool useCache = true,
+                 unsigned int userThreadCount = 0, bool usePriming = false,
+                 size_t prefilter = 0, bool reportRecall = false) {
     // Ensure query file exists
     if (!filesystem::exists(queryFile)) {
         cerr << "Error: Query file does not exist: " << queryFile << endl;
@@ -195,190 +416,1495 @@ bool identifyMusic(const string& queryFile, const string& dbDir,
     // Get the query filename for display
     string queryFilename = filesystem::path(queryFile).filename().string();
     
-    // Gather database feature files
-    vector<string> dbFiles;
-    vector<string> dbFilenames; // For display
+    // The query is loaded and compressed once
+    CompressorWrapper cw;
+    Buffer queryFileContents;
+    Buffer queryBuffer;
+    bool queryLoaded = Buffer::fromFile(actualQueryFile, queryFileContents) &&
+                       FeatureFile::contentOf(queryFileContents, actualQueryFile, queryBuffer);
+    long Cx = queryLoaded ? cw.compressedSize(compressor, queryBuffer) : 0;
+    if (Cx <= 0) {
+        cerr << "Error: Failed to compress query file: " << actualQueryFile << endl;
+        if (isWavFile) cleanupTempFiles(tempFeatFile);
+        return false;
+    }
+    size_t heapSize = topN > 0 ? static_cast<size_t>(topN) : 0;
+
+    // The database folder (sizes from the sidecar cache) or packed database is loaded once
+    // and ranked by the same code as the batch, live and server modes
+    Identification::Database db;
+    if (!Identification::loadDatabase(dbDir, useBinary, compressor, useCache, prefilter > 0, db)) {
+        if (isWavFile) cleanupTempFiles(tempFeatFile);
+        return false;
+    }
+
+    vector<size_t> candidates;
+    bool prefiltered = prefilterQuery(db, queryFileContents, queryFilename, prefilter, candidates);
+    if (prefiltered) {
+        cout << "Comparing query against " << candidates.size() << " of " << db.buffers.size()
+             << " database entries (prefiltered)" << endl;
+    } else {
+        cout << "Comparing query against " << db.buffers.size() << " database entries" << endl;
+    }
+
+    ThreadPool pool(ThreadPool::threadCountFor(userThreadCount, db.buffers.size()));
+    vector<pair<string, double>> results =
+        Identification::rankQuery(queryBuffer, Cx, db, compressor, heapSize, pool, usePriming,
+                                  prefiltered ? &candidates : nullptr);
+    if (prefiltered && reportRecall) {
+        size_t total;
+        bool bestKept;
+        vector<pair<string, double>> fullResults =
+            Identification::rankQuery(queryBuffer, Cx, db, compressor, heapSize, pool, usePriming);
+        size_t found = prefilterRecall(fullResults, candidates, db, total, bestKept);
+        cout << "Prefilter recall: " << found << "/" << total << " of the full top " << total
+             << (bestKept ? ", best match kept" : ", best match missed") << endl;
+    }
+    if (isWavFile) cleanupTempFiles(tempFeatFile);
+    if (!writeResults(outputFile, queryFilename, compressor, results)) {
+        return false;
+    }
+    printTopMatches(queryFilename, results);
+    cout << "\nFull results saved to " << outputFile << endl;
+    return true;
+}
+
+/**
+ * Collect batch queries from a directory (feature files) or from a list file (one feature or WAV path per line)
+ */
+bool collectBatchQueries(const string& batchPath, bool useBinary, vector<string>& queries) {
+    string featExtension = useBinary ? ".featbin" : ".feat";
     try {
-        for (auto& entry : filesystem::directory_iterator(dbDir)) {
-            if (entry.is_regular_file()) {
-                string filename = entry.path().filename().string();
+        if (filesystem::is_directory(batchPath)) {
+            for (auto& entry : filesystem::directory_iterator(batchPath)) {
+                if (!entry.is_regular_file()) continue;
                 string extension = entry.path().extension().string();
-                if ((useBinary && extension == ".featbin") || (!useBinary && extension == ".feat")) {
-                    dbFiles.push_back(entry.path().string());
-                    dbFilenames.push_back(filename);
+                transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                if (extension == featExtension) {
+                    queries.push_back(entry.path().string());
                 }
             }
+            sort(queries.begin(), queries.end());
+        } else {
+            ifstream list(batchPath);
+            if (!list) {
+                cerr << "Error: Could not open query list: " << batchPath << endl;
+                return false;
+            }
+            string line;
+            while (getline(list, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty() && line[0] != '#') queries.push_back(line);
+            }
         }
     } catch (const filesystem::filesystem_error& e) {
-        cerr << "Error reading database directory: " << e.what() << endl;
+        cerr << "Error reading query directory: " << e.what() << endl;
+        return false;
+    }
+
+    if (queries.empty()) {
+        cerr << "Error: No query files found in " << batchPath << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Identify a batch of queries against the database, loading the database only once.
+ * Writes <outputDir>/<query>_results.csv for every query, in the same format as identifyMusic.
+ */
+bool identifyBatch(const string& batchPath, const string& dbDir, const string& outputDir,
+                   const string& compressor, int topN, const string& configFile,
+                   bool useBinary = false, bool useCache = true, unsigned int userThreadCount = 0,
+                   bool usePriming = false, size_t prefilter = 0, bool reportRecall = false) {
+    vector<string> queryFiles;
+    if (!collectBatchQueries(batchPath, useBinary, queryFiles)) {
         return false;
     }
 
-    if (dbFiles.empty()) {
-        cerr << "Error: No files found in database directory: " << dbDir << endl;
+    try {
+        filesystem::create_directories(outputDir);
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error creating output directory: " << e.what() << endl;
         return false;
     }
 
-    cout << "Comparing query against " << dbFiles.size() << " database entries" << endl;
+    // Load and compress every query once
+    CompressorWrapper cw;
+    vector<string> queryNames;
+    vector<Buffer> queryFileContents;
+    vector<Buffer> queryBuffers;
+    vector<long> queryCx;
+    for (const auto& queryFile : queryFiles) {
+        string extension = filesystem::path(queryFile).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
 
-    // Compute NCD between query and each database entry
-    NCD ncd;
-    vector<pair<string, double>> results;
-    
-    for (size_t i = 0; i < dbFiles.size(); ++i) {
-        double ncdValue = ncd.computeNCD(actualQueryFile, dbFiles[i], compressor);
-        results.push_back({dbFilenames[i], ncdValue});
-        
-        // Show progress for large databases
-        if (dbFiles.size() > 20 && i % 10 == 0) {
-            cout << "Processed " << i << "/" << dbFiles.size() << " entries\r" << flush;
+        string featFile = queryFile;
+        if (extension == ".wav") {
+            featFile = extractFeaturesFromWAV(queryFile, configFile, useBinary);
+            if (featFile.empty()) {
+                cerr << "Warning: Skipping query " << queryFile << endl;
+                continue;
+            }
         }
-    }
-    
-    if (dbFiles.size() > 20) {
-        cout << "Processed " << dbFiles.size() << "/" << dbFiles.size() << " entries" << endl;
+
+        // The mapping stays valid after the temporary WAV features are removed
+        Buffer fileBytes;
+        Buffer bytes;
+        bool loaded = Buffer::fromFile(featFile, fileBytes) && FeatureFile::contentOf(fileBytes, featFile, bytes);
+        if (extension == ".wav") cleanupTempFiles(featFile);
+        if (!loaded) {
+            cerr << "Warning: Skipping query " << queryFile << endl;
+            continue;
+        }
+
+        long Cx = cw.compressedSize(compressor, bytes);
+        if (Cx <= 0) {
+            cerr << "Warning: Failed to compress query " << queryFile << ", skipping" << endl;
+            continue;
+        }
+        queryNames.push_back(filesystem::path(queryFile).filename().string());
+        queryFileContents.push_back(fileBytes);
+        queryBuffers.push_back(bytes);
+        queryCx.push_back(Cx);
     }
 
-    // Sort results by NCD (lowest first = best match)
-    sort(results.begin(), results.end(), 
-        [](const auto& a, const auto& b) { return a.second < b.second; });
-    
-    // Limit to top N if requested
-    if (topN > 0 && topN < static_cast<int>(results.size())) {
-        results.resize(topN);
+    if (queryBuffers.empty()) {
+        cerr << "Error: No usable queries" << endl;
+        return false;
     }
 
-    // Save results to output file
-    ofstream out(outputFile);
-    if (!out) {
-        cerr << "Error: Could not open output file for writing: " << outputFile << endl;
+    // Load the database into memory, with compressed sizes from the sidecar cache
+    Identification::Database db;
+    if (!Identification::loadDatabase(dbDir, useBinary, compressor, useCache, prefilter > 0, db)) {
         return false;
     }
 
-    // Write header
-    out << "Query: " << queryFilename << "\n";
-    out << "Compressor: " << compressor << "\n\n";
-    out << "Rank,File,NCD\n";
+    size_t numQueries = queryBuffers.size();
+    size_t numEntries = db.files.size();
 
-    // Write sorted results
-    for (size_t i = 0; i < results.size(); ++i) {
-        out << (i+1) << "," << results[i].first << "," << fixed << setprecision(6) << results[i].second << "\n";
+    // Entries ranked per query (everything unless the prefilter narrowed it down); jobs
+    // firstJob[q] .. firstJob[q + 1] belong to query q
+    vector<vector<size_t>> candidates(numQueries);
+    vector<char> prefiltered(numQueries, 0);
+    vector<size_t> firstJob(numQueries + 1, 0);
+    for (size_t q = 0; q < numQueries; ++q) {
+        prefiltered[q] = prefilterQuery(db, queryFileContents[q], queryNames[q], prefilter, candidates[q]);
+        firstJob[q + 1] = firstJob[q] + (prefiltered[q] ? candidates[q].size() : numEntries);
+    }
+    size_t totalJobs = firstJob[numQueries];
+    if (db.indexed) {
+        cout << "Comparing " << numQueries << " queries against " << numEntries << " database entries ("
+             << totalJobs << " of " << numQueries * numEntries << " comparisons after prefiltering)" << endl;
+    } else {
+        cout << "Comparing " << numQueries << " queries against " << numEntries << " database entries" << endl;
     }
-    out.close();
 
-    // Display top results on console
-    cout << "\nTop matches for query '" << queryFilename << "':\n" << endl;
-    
-    const int rankWidth = 5;
-    const int ncdWidth = 10;
-    const int terminalWidth = 80; // Standard terminal width
-    const int filenameWidth = terminalWidth - rankWidth - ncdWidth - 2; // -2 for spacing
-    
-    cout << setw(rankWidth) << "Rank" << setw(filenameWidth) << "File" << setw(ncdWidth) << "NCD" << endl;
-    cout << string(terminalWidth - 2, '-') << endl;
-    
-    int displayCount = min(5, static_cast<int>(results.size()));
-    for (int i = 0; i < displayCount; ++i) {
-        // Truncate filename if necessary
-        string displayName = results[i].first;
-        if (displayName.length() > filenameWidth - 3) {
-            displayName = displayName.substr(0, filenameWidth - 3) + "...";
+    // Schedule the whole query x database grid across the pool
+    ThreadPool pool(ThreadPool::threadCountFor(userThreadCount, totalJobs));
+    size_t heapSize = topN > 0 ? static_cast<size_t>(topN) : 0;
+
+    atomic<size_t> jobsDone(0);
+    mutex coutMutex;
+    vector<vector<TopK>> partialResults(pool.size(), vector<TopK>(numQueries, TopK(heapSize)));
+    // Jobs are query-major and each worker takes them in increasing order, so a worker
+    // only re-primes when it moves on to the next query
+    vector<unique_ptr<PrimedCompressor>> primed(pool.size());
+    vector<size_t> primedQuery(pool.size(), numQueries);
+    vector<double> segmentScores(db.segmented() ? totalJobs : 0);
+
+    pool.parallelFor(totalJobs, [&](size_t job, unsigned int worker) {
+        NCD ncd;
+        Compressor* c = CompressorWrapper::threadCompressor(compressor);
+        if (!c) return;
+        size_t q = upper_bound(firstJob.begin(), firstJob.end(), job) - firstJob.begin() - 1;
+        size_t e = prefiltered[q] ? candidates[q][job - firstJob[q]] : job - firstJob[q];
+
+        if (usePriming && primedQuery[worker] != q) {
+            primed[worker] = c->prime(queryBuffers[q]);
+            primedQuery[worker] = q;
+        }
+        double threshold = db.segmented() ? numeric_limits<double>::infinity() : partialResults[worker][q].threshold();
+        double ncdValue = primed[worker] ? ncd.computeNCD(*primed[worker], db.buffers[e], queryCx[q], db.sizes[e])
+                                         : ncd.computeNCD(queryBuffers[q], db.buffers[e], *c, queryCx[q], db.sizes[e],
+                                                          threshold);
+        if (db.segmented()) {
+            segmentScores[job] = ncdValue;
+        } else {
+            partialResults[worker][q].push(db.names[e], ncdValue);
+        }
+
+        size_t done = ++jobsDone;
+        if (totalJobs > 20 && done % 100 == 0) {
+            lock_guard<mutex> lock(coutMutex);
+            cout << "Processed " << done << "/" << totalJobs << " comparisons\r" << flush;
+        }
+    });
+    cout << "Processed " << totalJobs << "/" << totalJobs << " comparisons" << endl;
+
+    // Merge per query and write one CSV per query
+    bool allWritten = true;
+    size_t recallFound = 0, recallTotal = 0, bestKept = 0, recallQueries = 0;
+    for (size_t q = 0; q < numQueries; ++q) {
+        TopK merged(heapSize);
+        if (db.segmented()) {
+            Identification::pushBestSegments(db, segmentScores.data() + firstJob[q],
+                                             firstJob[q + 1] - firstJob[q],
+                                             prefiltered[q] ? &candidates[q] : nullptr, merged);
+        }
+        for (const auto& partial : partialResults) {
+            merged.merge(partial[q]);
+        }
+        vector<pair<string, double>> results = merged.sorted();
+
+        if (reportRecall && prefiltered[q]) {
+            // Rank the whole database as well to see what the prefilter dropped
+            vector<pair<string, double>> fullResults =
+                Identification::rankQuery(queryBuffers[q], queryCx[q], db, compressor, heapSize, pool, usePriming);
+            size_t total;
+            bool kept;
+            recallFound += prefilterRecall(fullResults, candidates[q], db, total, kept);
+            recallTotal += total;
+            bestKept += kept ? 1 : 0;
+            recallQueries++;
+        }
+
+        string stem = filesystem::path(queryNames[q]).stem().string();
+        string resultFile = (filesystem::path(outputDir) / (stem + "_results.csv")).string();
+        if (!writeResults(resultFile, queryNames[q], compressor, results)) {
+            allWritten = false;
+            continue;
+        }
+        if (!results.empty()) {
+            cout << queryNames[q] << " -> " << results[0].first << " ("
+                 << fixed << setprecision(6) << results[0].second << ")" << endl;
         }
-        
-        cout << setw(rankWidth) << (i+1) 
-             << setw(filenameWidth) << displayName
-             << setw(ncdWidth) << fixed << setprecision(6) << results[i].second << endl;
     }
 
-    cout << "\nFull results saved to " << outputFile << endl;
-    
-    // Clean up temporary files if WAV file was used
-    if (isWavFile) {
-        cleanupTempFiles(tempFeatFile);
+    if (recallQueries > 0) {
+        cout << "Prefilter recall: " << recallFound << "/" << recallTotal << " of the full top entries ("
+             << fixed << setprecision(1) << 100.0 * recallFound / max<size_t>(1, recallTotal)
+             << "%), best match kept for " << bestKept << "/" << recallQueries << " queries" << endl;
     }
-    
-    return true;
+    cout << "\nResults for " << numQueries << " queries saved to " << outputDir << endl;
+    return allWritten;
 }
 
-int main(int argc, char* argv[]) {
-    // Default values
-    string compressor = "gzip";
-    string queryFile;
-    string dbDir;
-    string outputFile;
-    string configFile = "config/feature_extraction_spectral_default.json";
-    int topN = 10;
-    bool useBinary = false;
-    
-    // Parse command line arguments
-    for (int i = 1; i < argc; i++) {
-        string arg = argv[i];
-        
-        if (arg == "-h" || arg == "--help") {
-            printUsage();
-            return 0;
-        } else if (arg == "--compressor" && i + 1 < argc) {
-            compressor = argv[++i];
-        } else if (arg == "--top" && i + 1 < argc) {
-            topN = stoi(argv[++i]);
-        } else if (arg == "--config" && i + 1 < argc) {
-            configFile = argv[++i];
-        } else if (arg == "--binary") {
-            useBinary = true;
-        } else if (queryFile.empty()) {
-            queryFile = arg;
-        } else if (dbDir.empty()) {
-            dbDir = arg;
-        } else if (outputFile.empty()) {
-            outputFile = arg;
-        }
+/**
+ * Parameters of the live identification mode
+ */
+struct StreamOptions {
+    int rawSampleRate = 44100;   // Format of headerless PCM input
+    int rawChannels = 2;
+    int rawBits = 16;
+    double windowSeconds = 10.0; // Length of the sliding query window
+    double updateSeconds = 1.0;  // Audio between two rankings
+    double margin = 0.01;        // NCD lead of the best match over the second one
+    int confirmations = 3;       // Consecutive rankings the lead must hold for
+};
+
+/**
+ * Open the live input: "-" (stdin), "unix:<path>", "tcp:<host>:<port>", or a file/FIFO path
+ * @return File descriptor, or -1 on failure
+ */
+int openStreamSource(const string& source) {
+    if (source == "-") {
+        return STDIN_FILENO;
     }
-    
-    // Validate required arguments
-    if (queryFile.empty() || dbDir.empty() || outputFile.empty()) {
-        cerr << "Error: Missing required arguments\n";
-        printUsage();
-        return 1;
+
+    if (source.rfind("unix:", 0) == 0) {
+        string socketPath = source.substr(5);
+        sockaddr_un addr{};
+        if (socketPath.size() >= sizeof(addr.sun_path)) {
+            cerr << "Error: Socket path too long: " << socketPath << endl;
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            cerr << "Error: Could not connect to " << socketPath << ": " << strerror(errno) << endl;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
     }
 
-    // Validate compressor
-    vector<string> validCompressors = {"gzip", "bzip2", "lzma", "zstd"};
-    if (find(validCompressors.begin(), validCompressors.end(), compressor) == validCompressors.end()) {
-        cerr << "Error: Invalid compressor: " << compressor << endl;
-        cerr << "Valid options: gzip, bzip2, lzma, zstd" << endl;
-        return 1;
+    if (source.rfind("tcp:", 0) == 0) {
+        string hostPort = source.substr(4);
+        size_t colon = hostPort.rfind(':');
+        if (colon == string::npos) {
+            cerr << "Error: Expected tcp:<host>:<port>, got " << source << endl;
+            return -1;
+        }
+        string host = hostPort.substr(0, colon);
+        string port = hostPort.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addrs = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+            cerr << "Error: Could not resolve " << host << endl;
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo* a = addrs; a; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(addrs);
+        if (fd < 0) {
+            cerr << "Error: Could not connect to " << hostPort << endl;
+        }
+        return fd;
     }
 
-    // Check if database directory exists
-    if (!filesystem::exists(dbDir) || !filesystem::is_directory(dbDir)) {
-        cerr << "Error: Database directory does not exist: " << dbDir << endl;
-        return 1;
+    int fd = open(source.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Could not open " << source << ": " << strerror(errno) << endl;
     }
+    return fd;
+}
 
-    // Ensure output directory exists
-    filesystem::path outPath(outputFile);
-    try {
-        if (!outPath.empty() && outPath.has_parent_path()) {
-            filesystem::create_directories(outPath.parent_path());
-        }
-    } catch (const filesystem::filesystem_error& e) {
-        cerr << "Error creating output directory: " << e.what() << endl;
+/**
+ * Identify live audio: extract features frame by frame as PCM arrives, rank the last
+ * windowSeconds of features against the in-memory database every updateSeconds, and report
+ * the best match once it has led the runner-up by the margin for several rankings in a row.
+ * The confident ranking is written to outputFile (and rewritten whenever the answer changes).
+ */
+bool identifyStream(const string& source, const string& dbDir, const string& outputFile,
+                    const string& compressor, int topN, const string& configFile,
+                    bool useBinary, bool useCache, unsigned int userThreadCount,
+                    bool usePriming, size_t prefilter, const StreamOptions& options) {
+    string method;
+    int numFrequencies, numBins, frameSize, hopSize, peakSpacing;
+    FeatureFile::Encoding encoding;
+    if (!loadConfig(configFile, method, numFrequencies, numBins, frameSize, hopSize, encoding, peakSpacing)) {
+        return false;
     }
 
-    cout << "Music identification using " << compressor << " compressor" << endl;
-    cout << "Query: " << queryFile << endl;
-    cout << "Database: " << dbDir << endl;
-    cout << "Output file: " << outputFile << endl;
-    
-    // Check if config file exists (only needed for WAV files)
-    string extension = filesystem::path(queryFile).extension().string();
-    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-    if (extension == ".wav" && !filesystem::exists(configFile)) {
-        cerr << "Error: Config file does not exist: " << configFile << endl;
-        return 1;
+    Identification::Database db;
+    if (!Identification::loadDatabase(dbDir, useBinary, compressor, useCache, prefilter > 0, db)) {
+        return false;
     }
 
-    if (!identifyMusic(queryFile, dbDir, outputFile, compressor, topN, configFile, useBinary)) {
+    int fd = openStreamSource(source);
+    if (fd < 0) {
+        return false;
+    }
+    WAVStream stream;
+    bool opened = stream.openFd(fd, options.rawSampleRate, options.rawChannels, options.rawBits) &&
+                  stream.setFraming(frameSize, hopSize);
+    if (!opened) {
+        if (fd != STDIN_FILENO) close(fd);
+        return false;
+    }
+
+    SpectralExtractor specExt(numBins);
+    MaxFreqExtractor mfExt(numFrequencies, peakSpacing);
+    bool spectral = method != "maxfreq";
+    string header = spectral ? specExt.featureHeader(stream.getChannels(), frameSize, hopSize, stream.getSampleRate())
+                             : mfExt.featureHeader(stream.getChannels(), frameSize, hopSize, stream.getSampleRate());
+
+    double framesPerSecond = static_cast<double>(stream.getSampleRate()) / hopSize;
+    size_t windowFrames = max<size_t>(1, static_cast<size_t>(options.windowSeconds * framesPerSecond + 0.5));
+    size_t updateFrames = max<size_t>(1, static_cast<size_t>(options.updateSeconds * framesPerSecond + 0.5));
+
+    // Rankings run on one pool for the whole stream, so worker compressors are reused
+    ThreadPool pool(ThreadPool::threadCountFor(userThreadCount, db.buffers.size()));
+    // The runner-up is needed for the confidence margin
+    size_t heapSize = topN > 0 ? max<size_t>(static_cast<size_t>(topN), 2) : 0;
+
+    string sourceName = source == "-" ? "stdin" : source;
+    cout << "Listening on " << sourceName << " (" << method << " features, " << options.windowSeconds
+         << " s window, ranking every " << options.updateSeconds << " s)" << endl;
+
+    // Binary windows use the payload encoding of an extracted .featbin file
+    FeatureFile::Info format;
+    format.method = method;
+    format.dims = static_cast<uint32_t>(spectral ? numBins : numFrequencies);
+    format.encoding = encoding;
+    format.scale = FeatureFile::defaultScale(method, encoding, frameSize);
+
+    CompressorWrapper cw;
+    deque<string> textFrames;
+    deque<vector<float>> binaryFrames;
+    size_t totalFrames = 0;
+    size_t sinceUpdate = 0;
+    string leader;
+    int streak = 0;
+    string reported;
+    vector<pair<string, double>> results;
+
+    auto rankWindow = [&]() {
+        // Serialize the window exactly like a feature file, so it compares like one
+        vector<uint8_t> bytes;
+        if (useBinary) {
+            bytes.reserve(binaryFrames.size() * format.dims * FeatureFile::valueSize(format.encoding));
+            for (const auto& values : binaryFrames) {
+                FeatureFile::encodeFrame(values, format, bytes);
+            }
+            if (format.encoding == FeatureFile::Encoding::Delta8) {
+                FeatureFile::deltaEncode(bytes.data(), binaryFrames.size(), format.dims);
+            }
+        } else {
+            bytes.assign(header.begin(), header.end());
+            for (const auto& line : textFrames) {
+                bytes.insert(bytes.end(), line.begin(), line.end());
+                bytes.push_back('\n');
+            }
+        }
+        Buffer query = Buffer::fromBytes(move(bytes));
+        long Cx = cw.compressedSize(compressor, query);
+        if (Cx <= 0) {
+            cerr << "Error: Failed to compress the query window" << endl;
+            return;
+        }
+        // Binary windows have no header, so their signature comes from the frames
+        vector<size_t> candidates;
+        bool prefiltered = false;
+        if (db.indexed && useBinary) {
+            PrefilterIndex::SignatureBuilder signature(spectral);
+            for (const auto& values : binaryFrames) signature.addFrame(values);
+            candidates = db.prefilter.candidates(signature.tokens(), prefilter);
+            prefiltered = !candidates.empty();
+        } else if (db.indexed) {
+            prefiltered = prefilterQuery(db, query, sourceName, prefilter, candidates);
+        }
+        results = Identification::rankQuery(query, Cx, db, compressor, heapSize, pool, usePriming,
+                                            prefiltered ? &candidates : nullptr);
+        if (results.empty()) return;
+
+        double lead = results.size() > 1 ? results[1].second - results[0].second : 1.0;
+        bool ahead = lead >= options.margin;
+        streak = ahead ? (results[0].first == leader ? streak + 1 : 1) : 0;
+        leader = results[0].first;
+
+        double elapsed = totalFrames / framesPerSecond;
+        cout << "[" << fixed << setprecision(1) << elapsed << " s] best: " << leader
+             << " (" << setprecision(6) << results[0].second << ", lead " << lead << ")" << endl;
+
+        if (streak >= options.confirmations && leader != reported) {
+            reported = leader;
+            cout << "Identified after " << setprecision(1) << elapsed << " s: " << leader << endl;
+            printTopMatches(sourceName, results);
+            writeResults(outputFile, sourceName, compressor, results);
+        }
+    };
+
+    const float* frame;
+    while (stream.nextFrame(frame)) {
+        if (useBinary) {
+            binaryFrames.push_back(spectral ? specExt.extractFrameBinary(frame, frameSize)
+                                            : mfExt.extractFrameBinary(frame, frameSize));
+            if (binaryFrames.size() > windowFrames) binaryFrames.pop_front();
+        } else {
+            textFrames.push_back(spectral ? specExt.extractFrame(frame, frameSize)
+                                          : mfExt.extractFrame(frame, frameSize));
+            if (textFrames.size() > windowFrames) textFrames.pop_front();
+        }
+        totalFrames++;
+        if (++sinceUpdate >= updateFrames) {
+            sinceUpdate = 0;
+            rankWindow();
+        }
+    }
+    if (fd != STDIN_FILENO) close(fd);
+
+    if (stream.failed()) {
+        return false;
+    }
+    if (sinceUpdate > 0 && totalFrames > 0) {
+        rankWindow();
+    }
+    cout << "End of stream after " << fixed << setprecision(1) << totalFrames / framesPerSecond << " s" << endl;
+
+    if (reported.empty()) {
+        if (results.empty()) {
+            cerr << "Error: Not enough audio to identify" << endl;
+            return false;
+        }
+        // No match got confidently ahead; keep the last ranking
+        cout << "No confident match; last ranking:" << endl;
+        printTopMatches(sourceName, results);
+        return writeResults(outputFile, sourceName, compressor, results);
+    }
+    return true;
+}
+
+/**
+ * Parameters of the server mode
+ */
+struct ServeOptions {
+    unsigned int connections = 4;        // Requests handled at once
+    size_t maxBodyBytes = 256 << 20;     // Largest accepted query
+    int timeoutSeconds = 30;             // Receive/send timeout of a connection
+};
+
+namespace {
+
+volatile sig_atomic_t serverStopping = 0;
+
+void stopServer(int) {
+    serverStopping = 1;
+}
+
+Metrics::Stage& requestStage = Metrics::stage("serve_request");
+
+}
+
+/**
+ * Listen on "unix:<path>", "tcp:<port>" (loopback) or "tcp:<host>:<port>"
+ * @return Listening socket, or -1 on failure
+ */
+int openServerSocket(const string& address) {
+    if (address.rfind("unix:", 0) == 0) {
+        string socketPath = address.substr(5);
+        sockaddr_un addr{};
+        if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) {
+            cerr << "Error: Invalid socket path: " << socketPath << endl;
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socketPath.c_str());  // Left behind by a previous server
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+            cerr << "Error: Could not listen on " << socketPath << ": " << strerror(errno) << endl;
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    if (address.rfind("tcp:", 0) == 0) {
+        string hostPort = address.substr(4);
+        size_t colon = hostPort.rfind(':');
+        string host = colon == string::npos ? "127.0.0.1" : hostPort.substr(0, colon);
+        string port = colon == string::npos ? hostPort : hostPort.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* addrs = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+            cerr << "Error: Could not resolve " << host << endl;
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo* a = addrs; a; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            int reuse = 1;
+            if (fd >= 0 && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0 &&
+                bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, 64) == 0) {
+                break;
+            }
+            if (fd >= 0) close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(addrs);
+        if (fd < 0) {
+            cerr << "Error: Could not listen on " << hostPort << ": " << strerror(errno) << endl;
+        }
+        return fd;
+    }
+
+    cerr << "Error: Expected unix:<path>, tcp:<port> or tcp:<host>:<port>, got " << address << endl;
+    return -1;
+}
+
+/**
+ * One HTTP request (as much of HTTP/1.1 as a query needs: no chunked bodies, one request
+ * per connection)
+ */
+struct HttpRequest {
+    string method;
+    string path;
+    map<string, string> params;     // Query string, decoded
+    map<string, string> headers;    // Lower-case names
+    string body;
+};
+
+string percentDecode(const string& text) {
+    string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '+') {
+            out += ' ';
+        } else if (text[i] == '%' && i + 2 < text.size() && isxdigit(text[i + 1]) && isxdigit(text[i + 2])) {
+            out += static_cast<char>(stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeAllFd(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void sendResponse(int fd, int status, const string& contentType, const string& body) {
+    const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 404 ? "Not Found"
+                       : status == 405 ? "Method Not Allowed" : status == 411 ? "Length Required"
+                       : status == 413 ? "Payload Too Large" : "Internal Server Error";
+    string head = "HTTP/1.1 " + to_string(status) + " " + reason + "\r\n" +
+                  "Content-Type: " + contentType + "\r\n" +
+                  "Content-Length: " + to_string(body.size()) + "\r\n" +
+                  "Connection: close\r\n\r\n";
+    if (sendAll(fd, head.data(), head.size())) {
+        sendAll(fd, body.data(), body.size());
+    }
+}
+
+/**
+ * Read a request from a connection
+ * @return 0 on success, otherwise the HTTP status to answer with (message has the reason)
+ */
+int readRequest(int fd, size_t maxBodyBytes, HttpRequest& request, string& message) {
+    // Headers first; whatever follows them is the start of the body
+    string data;
+    size_t headerEnd;
+    char chunk[64 * 1024];
+    while ((headerEnd = data.find("\r\n\r\n")) == string::npos) {
+        if (data.size() > sizeof(chunk)) {
+            message = "Headers too large";
+            return 400;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            message = "Incomplete request";
+            return 400;
+        }
+        data.append(chunk, static_cast<size_t>(n));
+    }
+
+    istringstream head(data.substr(0, headerEnd));
+    string line, target, version;
+    getline(head, line);
+    istringstream requestLine(line);
+    if (!(requestLine >> request.method >> target >> version)) {
+        message = "Malformed request line";
+        return 400;
+    }
+    while (getline(head, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == string::npos) continue;
+        string name = line.substr(0, colon);
+        transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        request.headers[name] = start == string::npos ? "" : line.substr(start);
+    }
+
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != string::npos) {
+        stringstream query(target.substr(question + 1));
+        string pair;
+        while (getline(query, pair, '&')) {
+            size_t equals = pair.find('=');
+            request.params[percentDecode(pair.substr(0, equals))] =
+                equals == string::npos ? "" : percentDecode(pair.substr(equals + 1));
+        }
+    }
+
+    if (request.method != "POST") {
+        return 0;
+    }
+    if (request.headers.count("transfer-encoding")) {
+        message = "Chunked bodies are not supported; send Content-Length";
+        return 411;
+    }
+    auto length = request.headers.find("content-length");
+    if (length == request.headers.end()) {
+        message = "Content-Length required";
+        return 411;
+    }
+    size_t bodyBytes = 0;
+    try {
+        bodyBytes = stoull(length->second);
+    } catch (const exception&) {
+        message = "Invalid Content-Length";
+        return 400;
+    }
+    if (bodyBytes > maxBodyBytes) {
+        message = "Query larger than " + to_string(maxBodyBytes) + " bytes";
+        return 413;
+    }
+    auto expect = request.headers.find("expect");
+    if (expect != request.headers.end() && expect->second == "100-continue") {
+        const string proceed = "HTTP/1.1 100 Continue\r\n\r\n";
+        sendAll(fd, proceed.data(), proceed.size());
+    }
+
+    request.body = data.substr(headerEnd + 4);
+    request.body.reserve(bodyBytes);
+    while (request.body.size() < bodyBytes) {
+        ssize_t n = recv(fd, chunk, min(sizeof(chunk), bodyBytes - request.body.size()), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            message = "Incomplete body";
+            return 400;
+        }
+        request.body.append(chunk, static_cast<size_t>(n));
+    }
+    request.body.resize(bodyBytes);
+    return 0;
+}
+
+/**
+ * State shared by every request of the server: the resident database, the pool its
+ * comparisons run on and the extraction parameters of WAV queries
+ */
+struct ServerState {
+    Identification::Database db;
+    string compressor;
+    int topN = 10;
+    bool useBinary = false;
+    bool usePriming = false;
+    size_t prefilter = 0;
+    StreamOptions rawFormat;        // Format of headerless PCM bodies
+    bool haveConfig = false;
+    string method;
+    int numFrequencies = 4, numBins = 32, frameSize = 1024, hopSize = 512, peakSpacing = 0;
+    FeatureFile::Encoding encoding = FeatureFile::Encoding::Float32;
+    unique_ptr<ThreadPool> pool;
+};
+
+/**
+ * Extract the features of a WAV query held in memory; the bytes go through an anonymous
+ * in-memory file so the stream sees a seekable regular file, as for a WAV on disk
+ */
+bool extractQueryFromWAV(const string& wav, const ServerState& state, Buffer& featureFile, string& message) {
+    int fd = memfd_create("music_id_query", MFD_CLOEXEC);
+    if (fd < 0 || !writeAllFd(fd, wav.data(), wav.size()) || lseek(fd, 0, SEEK_SET) != 0) {
+        message = string("Could not buffer the WAV query: ") + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    WAVStream stream;
+    bool ok = stream.openFd(fd, state.rawFormat.rawSampleRate, state.rawFormat.rawChannels,
+                            state.rawFormat.rawBits) &&
+              FeatureExtractor::extractFeatureFile(stream, state.method, state.numFrequencies, state.numBins,
+                                                   state.frameSize, state.hopSize, state.useBinary,
+                                                   state.encoding, state.peakSpacing, featureFile);
+    close(fd);
+    if (!ok) {
+        message = "Could not decode the WAV query";
+    }
+    return ok;
+}
+
+/**
+ * Rank one query posted to /identify
+ * @return HTTP status; body receives the ranking (CSV, or JSON with format=json) or the error
+ */
+int identifyRequest(const HttpRequest& request, ServerState& state, string& body, string& contentType) {
+    contentType = "text/plain";
+    auto param = [&](const string& name, const string& fallback) {
+        auto it = request.params.find(name);
+        return it == request.params.end() ? fallback : it->second;
+    };
+    string queryName = param("name", "query");
+    string format = param("format", "csv");
+    if (format != "csv" && format != "json") {
+        body = "Unknown format: " + format + " (csv or json)\n";
+        return 400;
+    }
+    int topN = state.topN;
+    try {
+        topN = stoi(param("top", to_string(state.topN)));
+    } catch (const exception&) {
+        body = "Invalid top\n";
+        return 400;
+    }
+    if (request.body.empty()) {
+        body = "Empty query\n";
+        return 400;
+    }
+
+    // The body is a WAV file or a feature file, told apart by their first bytes
+    Buffer queryFile;
+    bool isWav = request.body.compare(0, 4, "RIFF") == 0 || param("type", "") == "wav";
+    if (isWav) {
+        if (!state.haveConfig) {
+            body = "WAV queries need the server to be started with a valid --config\n";
+            return 400;
+        }
+        string message;
+        if (!extractQueryFromWAV(request.body, state, queryFile, message)) {
+            body = message + "\n";
+            return 400;
+        }
+    } else {
+        queryFile = Buffer::fromString(request.body);
+    }
+
+    Buffer query;
+    if (!FeatureFile::contentOf(queryFile, queryName, query)) {
+        body = "Query is not a valid feature file\n";
+        return 400;
+    }
+    CompressorWrapper cw;
+    long Cx = cw.compressedSize(state.compressor, query);
+    if (Cx <= 0) {
+        body = "Failed to compress the query\n";
+        return 500;
+    }
+
+    vector<size_t> candidates;
+    bool prefiltered = prefilterQuery(state.db, queryFile, queryName, state.prefilter, candidates);
+    size_t heapSize = topN > 0 ? static_cast<size_t>(topN) : 0;
+    vector<pair<string, double>> results =
+        Identification::rankQuery(query, Cx, state.db, state.compressor, heapSize, *state.pool,
+                                  state.usePriming, prefiltered ? &candidates : nullptr);
+
+    if (format == "json") {
+        json doc;
+        doc["query"] = queryName;
+        doc["compressor"] = state.compressor;
+        doc["compared"] = prefiltered ? candidates.size() : state.db.buffers.size();
+        doc["results"] = json::array();
+        for (size_t i = 0; i < results.size(); ++i) {
+            doc["results"].push_back({{"rank", i + 1}, {"file", results[i].first}, {"ncd", results[i].second}});
+        }
+        body = doc.dump() + "\n";
+        contentType = "application/json";
+    } else {
+        body = formatResults(queryName, state.compressor, results);
+        contentType = "text/csv";
+    }
+    return 200;
+}
+
+/**
+ * Answer one connection
+ */
+void handleConnection(int fd, ServerState& state, const ServeOptions& options, Logger& logger) {
+    Metrics::ScopedTimer timer(requestStage);
+    auto start = chrono::steady_clock::now();
+    timeval timeout{options.timeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    HttpRequest request;
+    string body;
+    string contentType = "text/plain";
+    int status = readRequest(fd, options.maxBodyBytes, request, body);
+    if (status != 0) {
+        body += "\n";
+    } else if (request.path == "/health") {
+        status = 200;
+        body = "ok " + to_string(state.db.buffers.size()) + " entries\n";
+    } else if (request.path != "/identify") {
+        status = 404;
+        body = "Unknown path: " + request.path + " (POST /identify, GET /health)\n";
+    } else if (request.method != "POST") {
+        status = 405;
+        body = "POST the query to /identify\n";
+    } else {
+        try {
+            status = identifyRequest(request, state, body, contentType);
+        } catch (const exception& e) {
+            status = 500;
+            body = string("Error: ") + e.what() + "\n";
+        }
+    }
+    sendResponse(fd, status, contentType, body);
+    close(fd);
+
+    long long millis = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    auto name = request.params.find("name");
+    logger.log(to_string(status) + " " + request.method + " " + request.path +
+               (name != request.params.end() ? " " + name->second : "") + " " + to_string(millis) + " ms\n");
+}
+
+/**
+ * Serve identification requests: load the database (sizes, prefilter index) and the
+ * extraction config once, then answer HTTP requests on a Unix or TCP socket until SIGINT
+ * or SIGTERM. Up to options.connections requests are handled at once; their comparisons
+ * share one worker pool.
+ */
+bool serveDatabase(const string& address, const string& dbDir, const string& compressor, int topN,
+                   const string& configFile, bool useBinary, bool useCache, unsigned int userThreadCount,
+                   bool usePriming, size_t prefilter, const StreamOptions& rawFormat, const ServeOptions& options) {
+    ServerState state;
+    state.compressor = compressor;
+    state.topN = topN;
+    state.useBinary = useBinary;
+    state.usePriming = usePriming;
+    state.prefilter = prefilter;
+    state.rawFormat = rawFormat;
+    if (filesystem::exists(configFile)) {
+        state.haveConfig = loadConfig(configFile, state.method, state.numFrequencies, state.numBins,
+                                      state.frameSize, state.hopSize, state.encoding, state.peakSpacing);
+    }
+    if (!state.haveConfig) {
+        cerr << "Warning: No usable config file (" << configFile << "); only feature file queries are accepted" << endl;
+    }
+
+    auto loadStart = chrono::steady_clock::now();
+    if (!Identification::loadDatabase(dbDir, useBinary, compressor, useCache, prefilter > 0, state.db)) {
+        return false;
+    }
+    state.pool = make_unique<ThreadPool>(ThreadPool::threadCountFor(userThreadCount, state.db.buffers.size()));
+    auto loadMillis = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - loadStart).count();
+
+    int listenFd = openServerSocket(address);
+    if (listenFd < 0) {
+        return false;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    cout << "Loaded " << state.db.buffers.size() << " database entries in " << loadMillis << " ms" << endl;
+    cout << "Serving on " << address << " (" << options.connections << " connections, "
+         << state.pool->size() << " comparison threads); POST queries to /identify" << endl;
+
+    // Accepted connections wait here for a handler
+    Logger logger;
+    BoundedQueue<int> connections(4 * options.connections);
+    vector<thread> handlers;
+    for (unsigned int h = 0; h < options.connections; ++h) {
+        handlers.emplace_back([&]() {
+            int fd;
+            while (connections.pop(fd)) {
+                handleConnection(fd, state, options, logger);
+            }
+        });
+    }
+
+    while (!serverStopping) {
+        pollfd pending{listenFd, POLLIN, 0};
+        int ready = poll(&pending, 1, 500);
+        if (ready <= 0) continue;  // Timeout, or interrupted by a signal
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        connections.push(fd);
+    }
+
+    cout << "Shutting down" << endl;
+    close(listenFd);
+    if (address.rfind("unix:", 0) == 0) {
+        unlink(address.substr(5).c_str());
+    }
+    connections.close();
+    for (auto& handler : handlers) {
+        handler.join();
+    }
+    return true;
+}
+
+/**
+ * Send a query to a server (see serveDatabase()) and read its ranking
+ * @param address unix:<path> or tcp:<host>:<port>
+ * @return false if the server cannot be reached or answers with an error
+ */
+bool queryServer(const string& address, const Buffer& queryFile, int topN, json& response, string& error) {
+    int fd = openStreamSource(address);
+    if (fd < 0) {
+        error = "could not connect";
+        return false;
+    }
+    string head = "POST /identify?format=json&top=" + to_string(topN) + " HTTP/1.1\r\n" +
+                  "Host: music_id\r\n" +
+                  "Content-Type: application/octet-stream\r\n" +
+                  "Content-Length: " + to_string(queryFile.size()) + "\r\n" +
+                  "Connection: close\r\n\r\n";
+    bool sent = sendAll(fd, head.data(), head.size()) &&
+                sendAll(fd, reinterpret_cast<const char*>(queryFile.data()), queryFile.size());
+    shutdown(fd, SHUT_WR);
+
+    // One request per connection: the reply ends when the server closes it
+    string reply;
+    char chunk[64 * 1024];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        reply.append(chunk, static_cast<size_t>(n));
+    }
+    close(fd);
+    if (!sent) {
+        error = "could not send the query";
+        return false;
+    }
+
+    size_t headerEnd = reply.find("\r\n\r\n");
+    int status = 0;
+    if (headerEnd == string::npos || sscanf(reply.c_str(), "HTTP/%*s %d", &status) != 1) {
+        error = "malformed reply";
+        return false;
+    }
+    string body = reply.substr(headerEnd + 4);
+    if (status != 200) {
+        error = "HTTP " + to_string(status) + ": " + body;
+        while (!error.empty() && error.back() == '\n') error.pop_back();
+        return false;
+    }
+    try {
+        response = json::parse(body);
+    } catch (const exception& e) {
+        error = string("malformed reply: ") + e.what();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Shard workers of a coordinator: servers already running elsewhere, or local processes
+ * started on shard database files and stopped at the end
+ */
+class ShardWorkers {
+public:
+    ~ShardWorkers() { stop(); }
+
+    /**
+     * @brief Start a local server for every shard that is a database file; every other shard
+     * is taken as the address of a running server
+     * @param serveArgs Options passed on to the local servers (compressor, threads, ...)
+     * @return false if a local server could not be started
+     */
+    bool start(const vector<string>& shards, const vector<string>& serveArgs) {
+        for (size_t s = 0; s < shards.size(); ++s) {
+            if (shards[s].rfind("unix:", 0) == 0 || shards[s].rfind("tcp:", 0) == 0) {
+                addresses.push_back(shards[s]);
+                continue;
+            }
+            if (socketDir.empty()) {
+                char pattern[] = "/tmp/music_id_shards_XXXXXX";
+                if (!mkdtemp(pattern)) {
+                    cerr << "Error: Could not create a directory for the shard sockets" << endl;
+                    return false;
+                }
+                socketDir = pattern;
+            }
+            string address = "unix:" + socketDir + "/shard" + to_string(s) + ".sock";
+            vector<string> args = {"music_id", "--serve", address};
+            args.insert(args.end(), serveArgs.begin(), serveArgs.end());
+            args.push_back(shards[s]);
+            vector<char*> argv;
+            for (auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+            argv.push_back(nullptr);
+
+            // The workers' console output would interleave with ours; errors still show
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+            pid_t pid;
+            int rc = posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, argv.data(), environ);
+            posix_spawn_file_actions_destroy(&actions);
+            if (rc != 0) {
+                cerr << "Error: Could not start a worker for shard " << shards[s] << ": " << strerror(rc) << endl;
+                return false;
+            }
+            children.push_back(pid);
+            addresses.push_back(address);
+            if (!waitReady(pid, address)) {
+                cerr << "Error: Worker for shard " << shards[s] << " did not start" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const vector<string>& serverAddresses() const { return addresses; }
+
+    /**
+     * @brief Stop the local servers and remove their sockets
+     */
+    void stop() {
+        for (pid_t pid : children) {
+            kill(pid, SIGTERM);
+        }
+        for (pid_t pid : children) {
+            waitpid(pid, nullptr, 0);
+        }
+        children.clear();
+        if (!socketDir.empty()) {
+            error_code ec;
+            filesystem::remove_all(socketDir, ec);
+            socketDir.clear();
+        }
+    }
+
+private:
+    vector<string> addresses;
+    vector<pid_t> children;
+    string socketDir;
+
+    // A worker listens once its shard is loaded; poll until then or until it exits
+    static bool waitReady(pid_t pid, const string& address) {
+        string socketPath = address.substr(5);
+        for (int attempt = 0; attempt < 6000; ++attempt) {
+            if (waitpid(pid, nullptr, WNOHANG) == pid) {
+                return false;
+            }
+            if (access(socketPath.c_str(), F_OK) == 0) {
+                int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                sockaddr_un addr{};
+                addr.sun_family = AF_UNIX;
+                strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+                bool connected = fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+                if (fd >= 0) close(fd);
+                if (connected) return true;
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+/**
+ * Identify a query against a sharded database: every shard worker ranks the query against
+ * its entries and returns its best topN, and the partial lists are merged into the final
+ * ranking. Entries are ranked by (NCD, name) everywhere, so without a prefilter the result
+ * is the same as ranking the whole database on one node.
+ */
+bool identifySharded(const string& queryFile, const vector<string>& shards, const string& outputFile,
+                     const string& compressor, int topN, const string& configFile, bool useBinary,
+                     const vector<string>& serveArgs) {
+    if (!filesystem::exists(queryFile)) {
+        cerr << "Error: Query file does not exist: " << queryFile << endl;
+        return false;
+    }
+
+    // WAV queries are extracted once here, so the workers need no config
+    string extension = filesystem::path(queryFile).extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    string featFile = queryFile;
+    if (extension == ".wav") {
+        cout << "Detected WAV file input - extracting features first..." << endl;
+        featFile = extractFeaturesFromWAV(queryFile, configFile, useBinary);
+        if (featFile.empty()) {
+            return false;
+        }
+    } else if (extension != ".feat" && extension != ".featbin") {
+        cerr << "Error: Query file must be either .wav, .feat, or .featbin format" << endl;
+        return false;
+    }
+    Buffer query;
+    bool loaded = Buffer::fromFile(featFile, query);
+    if (extension == ".wav") cleanupTempFiles(featFile);
+    if (!loaded) {
+        cerr << "Error: Could not read query file: " << featFile << endl;
+        return false;
+    }
+    string queryFilename = filesystem::path(queryFile).filename().string();
+
+    ShardWorkers workers;
+    if (!workers.start(shards, serveArgs)) {
+        return false;
+    }
+    const vector<string>& addresses = workers.serverAddresses();
+    cout << "Sending query to " << addresses.size() << " shards" << endl;
+
+    // Every shard at once; each returns at most topN entries with their exact NCD
+    vector<json> responses(addresses.size());
+    vector<string> errors(addresses.size());
+    vector<char> answered(addresses.size(), 0);
+    vector<thread> requests;
+    for (size_t s = 0; s < addresses.size(); ++s) {
+        requests.emplace_back([&, s]() {
+            answered[s] = queryServer(addresses[s], query, topN, responses[s], errors[s]);
+        });
+    }
+    for (auto& request : requests) {
+        request.join();
+    }
+    workers.stop();
+
+    size_t heapSize = topN > 0 ? static_cast<size_t>(topN) : 0;
+    TopK merged(heapSize);
+    size_t compared = 0;
+    for (size_t s = 0; s < addresses.size(); ++s) {
+        if (!answered[s]) {
+            cerr << "Error: Shard " << shards[s] << " failed: " << errors[s] << endl;
+            return false;
+        }
+        string shardCompressor = responses[s].value("compressor", "");
+        if (CompressorWrapper::sizeKey(shardCompressor) != CompressorWrapper::sizeKey(compressor)) {
+            cerr << "Error: Shard " << shards[s] << " compares with " << shardCompressor << ", not " << compressor << endl;
+            return false;
+        }
+        compared += responses[s].value("compared", static_cast<size_t>(0));
+        for (const auto& entry : responses[s]["results"]) {
+            merged.push(entry.at("file").get<string>(), entry.at("ncd").get<double>());
+        }
+    }
+    cout << "Compared query against " << compared << " database entries in " << addresses.size() << " shards" << endl;
+
+    vector<pair<string, double>> results = merged.sorted();
+    if (!writeResults(outputFile, queryFilename, compressor, results)) {
+        return false;
+    }
+    printTopMatches(queryFilename, results);
+    cout << "\nFull results saved to " << outputFile << endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Default values
+    string compressor = "gzip";
+    bool compressorGiven = false;
+    string queryFile;
+    string dbDir;
+    string outputFile;
+    string configFile = "config/feature_extraction_spectral_default.json";
+    int topN = 10;
+    bool useBinary = false;
+    bool useCache = true;
+    unsigned int userThreadCount = 0;
+    string batchPath;
+    string streamSource;
+    StreamOptions streamOptions;
+    string serveAddress;
+    ServeOptions serveOptions;
+    vector<string> shards;
+    bool usePriming = false;
+    size_t prefilter = 0;
+    bool reportRecall = false;
+    string metricsFile;
+    
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        
+        if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg == "--compressor" && i + 1 < argc) {
+            compressor = argv[++i];
+            compressorGiven = true;
+        } else if (arg == "--top" && i + 1 < argc) {
+            topN = stoi(argv[++i]);
+        } else if (arg == "--config" && i + 1 < argc) {
+            configFile = argv[++i];
+        } else if (arg == "--binary") {
+            useBinary = true;
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "--prime") {
+            usePriming = true;
+        } else if (arg == "--prefilter" && i + 1 < argc) {
+            prefilter = static_cast<size_t>(max(0, stoi(argv[++i])));
+        } else if (arg == "--recall") {
+            reportRecall = true;
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metricsFile = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchPath = argv[++i];
+        } else if (arg == "--stream" && i + 1 < argc) {
+            streamSource = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--connections" && i + 1 < argc) {
+            serveOptions.connections = static_cast<unsigned int>(max(1, stoi(argv[++i])));
+        } else if (arg == "--shards" && i + 1 < argc) {
+            stringstream list(argv[++i]);
+            string shard;
+            while (getline(list, shard, ',')) {
+                if (!shard.empty()) shards.push_back(shard);
+            }
+        } else if (arg == "--rate" && i + 1 < argc) {
+            streamOptions.rawSampleRate = stoi(argv[++i]);
+        } else if (arg == "--channels" && i + 1 < argc) {
+            streamOptions.rawChannels = stoi(argv[++i]);
+        } else if (arg == "--bits" && i + 1 < argc) {
+            streamOptions.rawBits = stoi(argv[++i]);
+        } else if (arg == "--window" && i + 1 < argc) {
+            streamOptions.windowSeconds = stod(argv[++i]);
+        } else if (arg == "--update" && i + 1 < argc) {
+            streamOptions.updateSeconds = stod(argv[++i]);
+        } else if (arg == "--margin" && i + 1 < argc) {
+            streamOptions.margin = stod(argv[++i]);
+        } else if (arg == "--confirm" && i + 1 < argc) {
+            streamOptions.confirmations = stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            userThreadCount = static_cast<unsigned int>(stoi(argv[++i]));
+        } else if (queryFile.empty() && batchPath.empty() && streamSource.empty() && serveAddress.empty()) {
+            queryFile = arg;
+        } else if (dbDir.empty()) {
+            dbDir = arg;
+        } else if (outputFile.empty()) {
+            outputFile = arg;
+        }
+    }
+    
+    // A coordinator has no database argument: <query_file> <output_file>
+    if (!shards.empty() && outputFile.empty()) {
+        outputFile = dbDir;
+        dbDir.clear();
+    }
+
+    if (!shards.empty()) {
+        if (queryFile.empty() || outputFile.empty() || !batchPath.empty() || !streamSource.empty() ||
+            !serveAddress.empty()) {
+            cerr << "Error: --shards needs a query file and an output file (no --batch, --stream or --serve)\n";
+            printUsage();
+            return 1;
+        }
+    } else {
+        // Validate required arguments (the server writes no output file)
+        bool haveQuery = !queryFile.empty() || !batchPath.empty() || !streamSource.empty() || !serveAddress.empty();
+        if (!haveQuery || dbDir.empty() || (outputFile.empty() && serveAddress.empty())) {
+            cerr << "Error: Missing required arguments\n";
+            printUsage();
+            return 1;
+        }
+    }
+
+    // Validate compressor (the config file may choose it when --compressor is not given)
+    if (!compressorGiven && filesystem::exists(configFile) && !loadCompressorConfig(configFile, compressor)) {
+        return 1;
+    }
+    CompressorSpec spec;
+    if (!CompressorSpec::parse(compressor, spec)) {
+        return 1;
+    }
+
+    if (!shards.empty()) {
+        string extension = filesystem::path(queryFile).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == ".wav" && !filesystem::exists(configFile)) {
+            cerr << "Error: Config file does not exist: " << configFile << endl;
+            return 1;
+        }
+        if (prefilter > 0) {
+            cerr << "Warning: --prefilter is applied per shard; the merged ranking may differ from an unsharded one" << endl;
+        }
+    } else {
+        // Check if database directory (or packed database file) exists
+        if (!filesystem::is_directory(dbDir) && !FeatureDatabase::isPacked(dbDir)) {
+            cerr << "Error: Database directory does not exist: " << dbDir << endl;
+            return 1;
+        }
+
+        if (usePriming && !CompressorWrapper::hasBackend(compressor)) {
+            cerr << "Warning: --prime needs an in-process " << compressor << " backend; compressing in full" << endl;
+        }
+        if (reportRecall && prefilter == 0) {
+            cerr << "Warning: --recall has no effect without --prefilter" << endl;
+        }
+
+        // Live queries are always extracted; a single query only when it is a WAV file
+        string extension = filesystem::path(queryFile).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        bool needsConfig = !streamSource.empty() || (serveAddress.empty() && batchPath.empty() && extension == ".wav");
+        if (needsConfig && !filesystem::exists(configFile)) {
+            cerr << "Error: Config file does not exist: " << configFile << endl;
+            return 1;
+        }
+    }
+
+    // Every mode records into the same metrics file
+    if (!metricsFile.empty()) {
+        Metrics::enable(metricsFile);
+    }
+
+    if (!shards.empty()) {
+        // Options of the local workers
+        vector<string> serveArgs = {"--compressor", compressor, "--top", to_string(topN)};
+        if (useBinary) serveArgs.push_back("--binary");
+        if (!useCache) serveArgs.push_back("--no-cache");
+        if (usePriming) serveArgs.push_back("--prime");
+        if (prefilter > 0) serveArgs.insert(serveArgs.end(), {"--prefilter", to_string(prefilter)});
+        if (userThreadCount > 0) serveArgs.insert(serveArgs.end(), {"--threads", to_string(userThreadCount)});
+
+        filesystem::path outPath(outputFile);
+        error_code ec;
+        if (outPath.has_parent_path()) filesystem::create_directories(outPath.parent_path(), ec);
+
+        cout << "Sharded music identification using " << compressor << " compressor" << endl;
+        cout << "Query: " << queryFile << endl;
+        cout << "Shards: " << shards.size() << endl;
+        cout << "Output file: " << outputFile << endl;
+        if (!identifySharded(queryFile, shards, outputFile, compressor, topN, configFile, useBinary, serveArgs)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!serveAddress.empty()) {
+        cout << "Music identification server using " << compressor << " compressor" << endl;
+        cout << "Database: " << dbDir << endl;
+        if (!serveDatabase(serveAddress, dbDir, compressor, topN, configFile, useBinary, useCache, userThreadCount,
+                           usePriming, prefilter, streamOptions, serveOptions)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!batchPath.empty()) {
+        cout << "Batch music identification using " << compressor << " compressor" << endl;
+        cout << "Queries: " << batchPath << endl;
+        cout << "Database: " << dbDir << endl;
+        cout << "Output directory: " << outputFile << endl;
+
+        if (!identifyBatch(batchPath, dbDir, outputFile, compressor, topN, configFile, useBinary, useCache, userThreadCount,
+                           usePriming, prefilter, reportRecall)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    // Ensure output directory exists
+    filesystem::path outPath(outputFile);
+    try {
+        if (!outPath.empty() && outPath.has_parent_path()) {
+            filesystem::create_directories(outPath.parent_path());
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error creating output directory: " << e.what() << endl;
+    }
+
+    if (!streamSource.empty()) {
+        cout << "Live music identification using " << compressor << " compressor" << endl;
+        cout << "Database: " << dbDir << endl;
+        cout << "Output file: " << outputFile << endl;
+
+        if (!identifyStream(streamSource, dbDir, outputFile, compressor, topN, configFile, useBinary,
+                            useCache, userThreadCount, usePriming, prefilter, streamOptions)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    cout << "Music identification using " << compressor << " compressor" << endl;
+    cout << "Query: " << queryFile << endl;
+    cout << "Database: " << dbDir << endl;
+    cout << "Output file: " << outputFile << endl;
+
+    if (!identifyMusic(queryFile, dbDir, outputFile, compressor, topN, configFile, useBinary, useCache, userThreadCount,
+                       usePriming, prefilter, reportRecall)) {
         return 1;
     }
     
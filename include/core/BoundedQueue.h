@@ -0,0 +1,94 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Blocking FIFO with a fixed capacity, used to connect pipeline stages.
+ * push() waits while the queue is full, so a slow stage holds back the stages feeding
+ * it instead of letting work pile up in memory. After close(), pushes are refused and
+ * pop() drains what is left before reporting the end.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief Append an item, waiting for room
+     * @return false if the queue was closed (the item is dropped)
+     */
+    bool push(T item) {
+        unique_lock<mutex> lock(mtx);
+        notFull.wait(lock, [this]() { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item, waiting for one
+     * @return false once the queue is closed and empty
+     */
+    bool pop(T& item) {
+        unique_lock<mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take up to maxItems of the oldest items at once, waiting for at least one
+     * @param batch Output, replaced
+     * @return false once the queue is closed and empty
+     */
+    bool popBatch(vector<T>& batch, size_t maxItems) {
+        batch.clear();
+        unique_lock<mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        while (!items.empty() && batch.size() < maxItems) {
+            batch.push_back(move(items.front()));
+            items.pop_front();
+        }
+        lock.unlock();
+        notFull.notify_all();
+        return !batch.empty();
+    }
+
+    /**
+     * @brief Stop accepting items and wake every waiting producer and consumer
+     */
+    void close() {
+        {
+            lock_guard<mutex> lock(mtx);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex mtx;
+    condition_variable notFull;
+    condition_variable notEmpty;
+};
+
+#endif // BOUNDEDQUEUE_H
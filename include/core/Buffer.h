@@ -0,0 +1,57 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "../utils/CompressorWrapper.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Read-only byte buffer, either owned in memory or memory-mapped from a file.
+ * Copies and sub-views share the underlying storage, so database entries can be handed
+ * to the compressors without copying the file contents.
+ */
+class Buffer {
+public:
+    Buffer() = default;
+
+    /**
+     * @brief Take ownership of a byte vector
+     */
+    static Buffer fromBytes(vector<uint8_t> bytes);
+
+    /**
+     * @brief Take ownership of a string (e.g. text features)
+     */
+    static Buffer fromString(string text);
+
+    /**
+     * @brief Load a file, memory-mapping it when possible (falls back to reading it)
+     * @param path File to load
+     * @param buffer Output buffer
+     * @return true on success
+     */
+    static bool fromFile(const string& path, Buffer& buffer);
+
+    /**
+     * @brief Sub-range of this buffer that shares its storage
+     */
+    Buffer view(size_t offset, size_t length) const;
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    ByteSpan span() const { return ByteSpan(ptr, length); }
+    operator ByteSpan() const { return span(); }
+
+private:
+    shared_ptr<const void> owner;  // Keeps the vector or the mapping alive
+    const uint8_t* ptr = nullptr;
+    size_t length = 0;
+};
+
+#endif // BUFFER_H
@@ -0,0 +1,59 @@
+#ifndef EXTRACTIONCONTEXT_H
+#define EXTRACTIONCONTEXT_H
+
+#include "MaxFreqExtractor.h"
+#include "SpectralExtractor.h"
+#include "WAVStream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief ExtractionContext is the per-thread state of feature extraction, kept for the
+ * lifetime of a worker. It owns the spectral and maxfreq extractors, and with them the FFT
+ * plans, Hann windows and every scratch buffer of the frame loop (FFT input and output,
+ * magnitudes, bins, peak order, the values of the last frame). Those buffers keep their
+ * capacity from frame to frame and from file to file, so once they have grown to the frame
+ * size the frame loop performs no heap allocation; the output of a file (text or values) is
+ * sized once up front from the length of the stream. A context is not thread-safe.
+ */
+class ExtractionContext {
+public:
+    /**
+     * @brief Spectral extractor with the given number of bins (rebuilt only when it changes)
+     */
+    SpectralExtractor& spectral(int numBins);
+
+    /**
+     * @brief Maxfreq extractor with the given number of peaks and peak spacing (rebuilt only
+     * when they change)
+     */
+    MaxFreqExtractor& maxfreq(int numFrequencies, int peakSpacing = 0);
+
+    /**
+     * @brief Extract the text features of a stream: header, then one line per frame
+     * @param method "spectral" or "maxfreq" (anything else extracts nothing)
+     * @param text Output, replaced
+     * @param peakSpacing Maxfreq peak-picking distance (0: strongest bins)
+     */
+    void extractText(WAVStream& stream, const string& method, int numFrequencies, int numBins,
+                     int frameSize, int hopSize, string& text, int peakSpacing = 0);
+
+    /**
+     * @brief Extract the features of a stream as one row-major array of values per frame
+     * (maxfreq frames with fewer peaks are padded with zeros, as in .featbin files)
+     * @param method "spectral" or "maxfreq" (anything else extracts nothing)
+     * @param values Output, replaced; numBins or numFrequencies values per frame
+     * @param peakSpacing Maxfreq peak-picking distance (0: strongest bins)
+     */
+    void extractValues(WAVStream& stream, const string& method, int numFrequencies, int numBins,
+                       int frameSize, int hopSize, vector<float>& values, int peakSpacing = 0);
+
+private:
+    unique_ptr<SpectralExtractor> spectralExtractor;
+    unique_ptr<MaxFreqExtractor> maxfreqExtractor;
+};
+
+#endif // EXTRACTIONCONTEXT_H
@@ -0,0 +1,96 @@
+#ifndef EXTRACTIONMANIFEST_H
+#define EXTRACTIONMANIFEST_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief ExtractionManifest records, for every feature file of an output folder, the WAV
+ * file it was extracted from (size, modification time and content hash) and the extraction
+ * parameters, so an incremental run only extracts what changed. Stored as JSON in the output
+ * folder (by default <dir>/.extraction_manifest.json). A WAV file whose size and time are
+ * unchanged is trusted without reading it; otherwise its contents are hashed, so a file that
+ * was only touched or copied is not extracted again.
+ */
+class ExtractionManifest {
+public:
+    /**
+     * @param manifestFile Path of the JSON manifest file
+     * @param params Description of the extraction parameters of this run (see describe())
+     */
+    ExtractionManifest(const string& manifestFile, const string& params);
+
+    /**
+     * @brief Default manifest location for an output folder
+     */
+    static string defaultPath(const string& outFolder);
+
+    /**
+     * @brief Canonical description of the parameters the features depend on
+     */
+    static string describe(const string& method, int numFrequencies, int numBins, int frameSize, int hopSize,
+                           int peakSpacing, bool useBinary, const string& encoding);
+
+    /**
+     * @brief 64-bit FNV-1a hash of a file's contents, as 16 hex digits
+     * @return false if the file cannot be read
+     */
+    static bool hashFile(const string& path, string& hash);
+
+    /**
+     * @brief Load the manifest file (a missing file is an empty manifest)
+     * @return false if the file exists but could not be parsed
+     */
+    bool load();
+
+    /**
+     * @brief Write the manifest back to disk (through a temporary name) if anything changed
+     * @return true if the manifest is up to date on disk
+     */
+    bool save();
+
+    /**
+     * @brief Check if a feature file exists and was extracted from the current contents of the
+     * WAV file with this run's parameters. Thread-safe.
+     * @param outputFile Path of the feature file (entries are keyed by its file name)
+     */
+    bool upToDate(const string& wavFile, const string& outputFile);
+
+    /**
+     * @brief Record a feature file just extracted from a WAV file with this run's parameters.
+     * Thread-safe.
+     * @return false if the WAV file could not be stamped (nothing is recorded)
+     */
+    bool record(const string& wavFile, const string& outputFile);
+
+    /**
+     * @brief Delete the feature files whose WAV file no longer exists, and forget entries
+     * whose feature file is gone
+     * @param outFolder Folder the feature files are in
+     * @return Names of the deleted feature files
+     */
+    vector<string> removeOrphans(const string& outFolder);
+
+private:
+    struct Entry {
+        string source;          // Absolute path of the WAV file
+        uintmax_t size = 0;
+        int64_t mtime = 0;
+        string hash;
+        string params;
+    };
+
+    string path;
+    string params;
+    // Feature file name -> entry
+    map<string, Entry> entries;
+    bool dirty = false;
+    mutex mtx;
+};
+
+#endif // EXTRACTIONMANIFEST_H
@@ -0,0 +1,66 @@
+#ifndef FFTPLAN_H
+#define FFTPLAN_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Precomputed forward FFT for one transform size.
+ * The bit-reversal permutation and twiddle factors are computed once when the plan is
+ * built, and transforms run in place on caller-owned buffers, so the frame loop does no
+ * trigonometry and no allocation. Plans are immutable once built and can be shared
+ * between threads; use forSize() to get the process-wide plan for a size.
+ * Power-of-two sizes use radix-2 Cooley-Tukey; other sizes fall back to a direct DFT.
+ * When built with FFTW, forwardReal() runs through an FFTW r2c plan instead.
+ */
+class FFTPlan {
+public:
+    explicit FFTPlan(int size);
+    ~FFTPlan();
+
+    FFTPlan(const FFTPlan&) = delete;
+    FFTPlan& operator=(const FFTPlan&) = delete;
+
+    /**
+     * @brief Transform size in samples
+     */
+    int size() const { return n; }
+
+    /**
+     * @brief In-place forward transform of size() complex values
+     * @param data Buffer of size() values, overwritten with the spectrum
+     */
+    void forward(complex<double>* data) const;
+
+    /**
+     * @brief Forward transform of size() real values.
+     * Runs a size()/2 complex transform on the samples packed as (even, odd) pairs and
+     * splits the result, which is about half the work of a complex transform.
+     * @param input size() real samples
+     * @param spectrum Output bins 0..size()/2 (resized to size()/2 + 1)
+     */
+    void forwardReal(const double* input, vector<complex<double>>& spectrum) const;
+
+    /**
+     * @brief Shared plan for the given size, built on first use
+     */
+    static shared_ptr<const FFTPlan> forSize(int size);
+
+private:
+    int n;
+    bool radix2;
+    vector<int> bitReverse;             // Permutation applied before the butterflies
+    vector<complex<double>> twiddles;   // exp(-2*pi*i*k/n): k < n/2 for radix-2, k < n otherwise
+    vector<complex<double>> splitTwiddles;  // exp(-2*pi*i*k/n), k < n/2, for the real split
+    unique_ptr<FFTPlan> half;           // size n/2 plan used by forwardReal()
+    void* fftwPlan = nullptr;           // fftw_plan for the real transform (HAVE_FFTW builds)
+
+    FFTPlan(int size, bool withRealPath);
+    void radix2Forward(complex<double>* data) const;
+    void dftForward(complex<double>* data) const;
+};
+
+#endif // FFTPLAN_H
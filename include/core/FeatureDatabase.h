@@ -0,0 +1,137 @@
+#ifndef FEATUREDATABASE_H
+#define FEATUREDATABASE_H
+
+#include "Buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief FeatureDatabase is a packed, single-file feature database (.featdb).
+ * The feature files of one extraction folder are stored back to back at 64-byte aligned
+ * offsets, followed by an index of file names, offsets and lengths and the compressed
+ * sizes of every entry for one or more compressors. Opening memory-maps the whole file
+ * once, so a query costs one open() instead of one per track, and every entry is a
+ * zero-copy view of the mapping.
+ * A segmented database (build_db --segment) stores overlapping fixed-length segments of
+ * every track instead of whole files, named "<file>@<first frame>" (see segmentName()).
+ */
+class FeatureDatabase {
+public:
+    FeatureDatabase() = default;
+
+    /**
+     * @brief Writes a packed database entry by entry, so the files never have to be in
+     * memory (or on disk) all at once. The index lists the entries sorted by name, whatever
+     * order they were added in. The database is written to "<path>.tmp" and renamed over the
+     * path by finish(), so readers never open a half-written database.
+     */
+    class Writer {
+    public:
+        /**
+         * @param binary True if the entries are .featbin files, false for .feat
+         * @param sizeKeys Compressor keys of the sizes given with every entry
+         * @param segmented True if the entries are track segments (see segmentName())
+         * @return false if the file cannot be created
+         */
+        bool open(const string& path, bool binary, const vector<string>& sizeKeys, bool segmented = false);
+
+        /**
+         * @brief Append an entry
+         * @param sizes Compressed size for each size key (missing ones are stored as unknown)
+         * @return false on a write error
+         */
+        bool add(const string& name, const uint8_t* data, size_t size, const vector<long>& sizes);
+
+        /**
+         * @brief Write the index and the header, close the file and move it into place
+         */
+        bool finish();
+
+        size_t size() const { return entries.size(); }
+
+    private:
+        struct Entry {
+            string name;
+            uint64_t offset;
+            uint64_t length;
+            vector<long> sizes;
+        };
+
+        string path;
+        string tempPath;
+        ofstream out;
+        bool binaryEntries = false;
+        bool segmentedEntries = false;
+        vector<string> keys;
+        vector<Entry> entries;
+        uint64_t position = 0;
+    };
+
+    /**
+     * @brief Check if a path is a packed database (by its magic bytes)
+     */
+    static bool isPacked(const string& path);
+
+    /**
+     * @brief Write a packed database
+     * @param path Output file
+     * @param names File name of every entry (e.g. song01_maxfreq.featbin)
+     * @param files Contents of every feature file
+     * @param binary True if the entries are .featbin files, false for .feat
+     * @param sizeKeys Compressor keys ("<compressor>:<level>") the sizes were computed for
+     * @param sizes sizes[k][i]: compressed size of the content of entry i with sizeKeys[k]
+     * @param segmented True if the entries are track segments (see segmentName())
+     * @return true on success
+     */
+    static bool write(const string& path, const vector<string>& names, const vector<Buffer>& files,
+                      bool binary, const vector<string>& sizeKeys, const vector<vector<long>>& sizes,
+                      bool segmented = false);
+
+    /**
+     * @brief Entry name of the segment of a track starting at a frame
+     */
+    static string segmentName(const string& track, uint64_t startFrame);
+
+    /**
+     * @brief Track (file name) a segment entry belongs to
+     */
+    static string trackOf(const string& segmentName);
+
+    /**
+     * @brief Memory-map a packed database and read its index
+     * @return true on success
+     */
+    static bool open(const string& path, FeatureDatabase& db);
+
+    size_t size() const { return names.size(); }
+    bool binary() const { return binaryEntries; }
+    bool segmented() const { return segmentedEntries; }
+    const string& name(size_t i) const { return names[i]; }
+
+    /**
+     * @brief Whole feature file of an entry, sharing the mapping
+     */
+    const Buffer& file(size_t i) const { return files[i]; }
+
+    /**
+     * @brief Compressed sizes stored for a compressor key, or nullptr if the key is missing
+     * or some entries have no size
+     */
+    const vector<long>* compressedSizes(const string& key) const;
+
+private:
+    Buffer mapping;
+    bool binaryEntries = false;
+    bool segmentedEntries = false;
+    vector<string> names;
+    vector<Buffer> files;
+    vector<string> sizeKeys;
+    vector<vector<long>> sizes;
+};
+
+#endif // FEATUREDATABASE_H
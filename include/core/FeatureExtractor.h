@@ -1,6 +1,10 @@
 #ifndef EXTRACTION_UTILS_H
 #define EXTRACTION_UTILS_H
 
+#include "ExtractionManifest.h"
+#include "FeatureFile.h"
+#include "OutputWriter.h"
+#include "WAVStream.h"
 #include <string>
 #include <atomic>
 #include <mutex>
@@ -11,6 +15,7 @@ using namespace std;
 namespace FeatureExtractor {
     /**
      * Save extraction configuration to a text file in the output directory
+     * (written to a temporary name and renamed, like the feature files)
      */
     void saveConfig(
         const string& outFolder, 
@@ -19,22 +24,52 @@ namespace FeatureExtractor {
         int numBins,
         int frameSize, 
         int hopSize, 
-        int filesProcessed
+        int filesProcessed,
+        int peakSpacing = 0
     );
     
     /**
-     * Save features in text format
+     * Save features in text format (to <outFile>.feat.tmp, then renamed)
      */
     bool saveFeaturesText(const string& outFile, const string& featData);
     
     /**
-     * Save features in binary format
+     * Save features in binary format (.featbin version 2, see FeatureFile), through a
+     * temporary name like saveFeaturesText()
+     * @param featData Row-major feature values, info.dims per frame
      */
-    bool saveFeaturesBinary(const string& outFile, const vector<float>& featData);
+    bool saveFeaturesBinary(const string& outFile, const vector<float>& featData,
+                            const FeatureFile::Info& info);
+
+    /**
+     * Path of the feature file extracted from a WAV file (<outFolder>/<name>_<method>.feat[bin])
+     */
+    string outputFile(const string& wavFile, const string& outFolder, const string& method, bool useBinary);
+
+    /**
+     * Extract the features of an open stream into a whole feature file in memory, exactly as
+     * extractFeaturesFromFile() would save it (uses this thread's ExtractionContext)
+     * @param file Output: .featbin file if useBinary, else .feat text
+     * @return false on a read error
+     */
+    bool extractFeatureFile(
+        WAVStream& stream,
+        const string& method,
+        int numFrequencies,
+        int numBins,
+        int frameSize,
+        int hopSize,
+        bool useBinary,
+        FeatureFile::Encoding encoding,
+        int peakSpacing,
+        Buffer& file
+    );
 
     /**
      * Extract features from a single WAV file
      * @param useBinary If true, save features as binary (.featbin), else as text (.feat)
+     * @param encoding Value encoding of binary features
+     * @param peakSpacing Maxfreq peak-picking distance in bins (0: strongest bins)
      */
     bool extractFeaturesFromFile(
         const string& wavFile, 
@@ -47,7 +82,40 @@ namespace FeatureExtractor {
         mutex& coutMutex,
         atomic<int>& filesProcessed,
         atomic<int>& filesSkipped,
-        bool useBinary = false
+        bool useBinary = false,
+        FeatureFile::Encoding encoding = FeatureFile::Encoding::Float32,
+        int peakSpacing = 0
+    );
+
+    /**
+     * Extract features from many WAV files with a staged pipeline: up to two I/O threads open
+     * the files in the given order and start reading their audio ahead, a pool of compute
+     * threads decodes, extracts and serializes, and an OutputWriter saves the results. The
+     * stages are joined by bounded queues, so a slow disk or a slow stage throttles the others
+     * instead of buffering whole tracks, and progress is logged through a lock-free buffered
+     * logger. Each compute thread keeps one ExtractionContext for all the files it extracts.
+     * @param threadCount Number of compute threads (0: all available)
+     * @param peakSpacing Maxfreq peak-picking distance in bins (0: strongest bins)
+     * @param output Writer to queue the files on, e.g. one in packed mode; flushed before
+     * returning but not finished (nullptr: write the files into outFolder)
+     * @param manifest If set, every feature file written is recorded in it
+     */
+    void extractFeaturesFromFiles(
+        const vector<string>& wavFiles,
+        const string& outFolder,
+        const string& method,
+        int numFrequencies,
+        int numBins,
+        int frameSize,
+        int hopSize,
+        bool useBinary,
+        FeatureFile::Encoding encoding,
+        unsigned int threadCount,
+        atomic<int>& filesProcessed,
+        atomic<int>& filesSkipped,
+        int peakSpacing = 0,
+        OutputWriter* output = nullptr,
+        ExtractionManifest* manifest = nullptr
     );
 }
 
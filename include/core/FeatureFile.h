@@ -0,0 +1,182 @@
+#ifndef FEATUREFILE_H
+#define FEATUREFILE_H
+
+#include "Buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief FeatureFile reads and writes the binary feature container (.featbin).
+ * Version 2 files start with a fixed 64-byte header (frame count, values per frame,
+ * extraction method and framing, value encoding) followed by the frames as one contiguous
+ * row-major array starting at a 64-byte aligned offset. Values are stored as float32 or
+ * quantized to uint16/uint8 (stored = trunc(value * scale), like the text format).
+ * The delta8 encoding stores the uint8 codes as differences (mod 256) from the same value
+ * of the previous frame: slowly changing features turn into runs of small deltas, which the
+ * compressors shrink further than the codes themselves.
+ * Loading memory-maps the file, and payload() is a zero-copy view of the frame data that
+ * can be handed straight to the compressors. Version 1 files (raw float32 values without
+ * a header) are still readable; their frame layout is unknown.
+ */
+class FeatureFile {
+public:
+    enum class Encoding : uint32_t {
+        Float32 = 0,
+        UInt16 = 1,
+        UInt8 = 2,
+        Delta8 = 3      // uint8 codes, each minus the code of the previous frame (mod 256)
+    };
+
+    struct Info {
+        int version = 2;
+        string method;              // "spectral" or "maxfreq" (at most 15 characters)
+        uint64_t frames = 0;        // Number of frames (0 if unknown, version 1)
+        uint32_t dims = 0;          // Values per frame (0 if unknown, version 1)
+        Encoding encoding = Encoding::Float32;
+        float scale = 1.0f;         // value = stored / scale for the integer encodings
+        uint32_t frameSize = 0;
+        uint32_t hopSize = 0;
+        uint32_t sampleRate = 0;
+    };
+
+    static constexpr size_t headerSize = 64;
+
+    /**
+     * @brief Parse an encoding name (float32, uint16, uint8, delta8)
+     * @return false if the name is unknown
+     */
+    static bool parseEncoding(const string& name, Encoding& encoding);
+
+    static const char* encodingName(Encoding encoding);
+
+    /**
+     * @brief Bytes per stored value
+     */
+    static size_t valueSize(Encoding encoding);
+
+    /**
+     * @brief Scale used to quantize the features of a method: spectral bins (0..1) use the
+     * 10000 factor of the text format for uint16 and 255 for uint8; maxfreq indices are
+     * stored as-is, or scaled down to fit uint8 when frameSize / 2 exceeds 255 (delta8 uses
+     * the uint8 scale)
+     */
+    static float defaultScale(const string& method, Encoding encoding, int frameSize);
+
+    /**
+     * @brief Append one frame in the file's value encoding, padded with zeros or cut to dims values
+     * (delta8 frames are appended as plain uint8 codes; see deltaEncode())
+     * @param frame Feature values of the frame
+     * @param info Encoding, scale and dims to use
+     * @param out Byte vector the encoded frame is appended to
+     */
+    static void encodeFrame(const vector<float>& frame, const Info& info, vector<uint8_t>& out);
+    static void encodeFrame(const float* frame, size_t count, const Info& info, vector<uint8_t>& out);
+
+    /**
+     * @brief Turn rows of uint8 codes into delta8 rows in place (last frame first)
+     */
+    static void deltaEncode(uint8_t* rows, size_t frames, size_t dims);
+
+    /**
+     * @brief Encode a whole version 2 file (header and payload) into memory
+     * @param frames Feature frames; info.frames is taken from frames.size()
+     * @param info Header fields (version is ignored)
+     * @param out Output, replaced
+     */
+    static void serialize(const vector<vector<float>>& frames, const Info& info, vector<uint8_t>& out);
+
+    /**
+     * @brief Same as serialize() for a row-major array of info.dims values per frame
+     */
+    static void serialize(const vector<float>& values, const Info& info, vector<uint8_t>& out);
+
+    /**
+     * @brief Write a version 2 file (see serialize())
+     * @param path Output file
+     * @param frames Feature frames; info.frames is taken from frames.size()
+     * @param info Header fields (version is ignored)
+     * @return true on success
+     */
+    static bool write(const string& path, const vector<vector<float>>& frames, const Info& info);
+
+    /**
+     * @brief Write a version 2 file from a row-major array of info.dims values per frame
+     * @param values Feature values; info.frames is taken from values.size() / info.dims
+     */
+    static bool write(const string& path, const vector<float>& values, const Info& info);
+
+    /**
+     * @brief Memory-map a feature file and validate its header
+     * @param path File to load (version 1 or 2)
+     * @param file Output
+     * @return true on success
+     */
+    static bool load(const string& path, FeatureFile& file);
+
+    /**
+     * @brief Same as load() for a feature file that is already in memory
+     * @param contents Contents of the file (the result shares its storage)
+     * @param name File name used in error messages
+     */
+    static bool load(const Buffer& contents, const string& name, FeatureFile& file);
+
+    /**
+     * @brief Load the bytes of a feature file that take part in NCD: the payload of a
+     * version 2 .featbin file, or the whole file for anything else (.feat, version 1)
+     * @return false if the file cannot be read or has a corrupt header
+     */
+    static bool loadContent(const string& path, Buffer& content);
+
+    /**
+     * @brief Same as loadContent() for a feature file that is already in memory
+     * @param file Contents of the file (the result shares its storage)
+     * @param name File name used in error messages
+     */
+    static bool contentOf(const Buffer& file, const string& name, Buffer& content);
+
+    /**
+     * @brief Split a feature file into overlapping segments of a fixed duration, each a valid
+     * feature file of the same kind: a .feat segment repeats the "#" header lines, a .featbin
+     * segment gets its own header (delta8 segments start from absolute codes). The last
+     * segment ends with the file; a file no longer than one segment is returned whole.
+     * @param file Contents of the file
+     * @param seconds Segment length
+     * @param hopSeconds Distance between the starts of two segments
+     * @param segments Output, replaced
+     * @param starts Output, replaced: first frame of every segment
+     * @return false if the file cannot be parsed or does not state its frame rate
+     */
+    static bool segment(const Buffer& file, const string& name, double seconds, double hopSeconds,
+                        vector<Buffer>& segments, vector<uint64_t>& starts);
+
+    const Info& info() const { return header; }
+
+    /**
+     * @brief Frame data, frames * dims values, row-major, sharing the file mapping
+     */
+    const Buffer& payload() const { return data; }
+
+    /**
+     * @brief Decoded value of one frame entry (version 2 files only; for delta8 this sums
+     * the deltas of all earlier frames, so use decode() to read whole files)
+     */
+    float value(size_t frame, size_t dim) const;
+
+    /**
+     * @brief Decode every frame (version 2 files only)
+     * @param values Output, frames * dims values, row-major
+     */
+    void decode(vector<float>& values) const;
+
+private:
+    Info header;
+    Buffer data;
+
+    static bool parse(const Buffer& file, const string& path, Info& info, Buffer& payload);
+};
+
+#endif // FEATUREFILE_H
@@ -0,0 +1,69 @@
+#ifndef IDENTIFICATION_H
+#define IDENTIFICATION_H
+
+#include "Buffer.h"
+#include "PrefilterIndex.h"
+#include "ThreadPool.h"
+#include "TopK.h"
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace Identification {
+    /**
+     * Database feature files loaded into memory, with their compressed sizes and, when
+     * prefiltering, the landmark index of their signatures. The entries of a segmented
+     * database are track segments: tracks[e] is the track of entry e in trackNames.
+     */
+    struct Database {
+        vector<string> files;
+        vector<string> names;
+        vector<Buffer> buffers;
+        vector<long> sizes;
+        PrefilterIndex prefilter;
+        bool indexed = false;
+        vector<size_t> tracks;
+        vector<string> trackNames;
+
+        bool segmented() const { return !tracks.empty(); }
+
+        /**
+         * Name an entry is ranked under: its file name, or the track of a segment
+         */
+        const string& rankedName(size_t e) const { return tracks.empty() ? names[e] : trackNames[tracks[e]]; }
+    };
+
+    /**
+     * Load every database entry and its compressed size (from the sidecar cache unless disabled);
+     * dbDir may also be a packed database file, whose stored sizes are used when present
+     * @param usePrefilter Also build the landmark index of the entries
+     */
+    bool loadDatabase(const string& dbDir, bool useBinary, const string& compressor, bool useCache,
+                      bool usePrefilter, Database& db);
+
+    /**
+     * Reduce the scores of segment entries to the best segment of every track and offer those
+     * to the heap
+     * @param entries Entry of every score (or nullptr: score j belongs to entry j)
+     */
+    void pushBestSegments(const Database& db, const double* scores, size_t count, const vector<size_t>* entries,
+                          TopK& best);
+
+    /**
+     * Rank one in-memory query against the database (or only the given entries), spreading
+     * the entries over the pool into per-worker top-K heaps; entries that cannot beat a
+     * worker's K-th best are abandoned part-way. A segmented database ranks every track by
+     * its best segment.
+     * @param Cx Compressed size of the query
+     * @param usePriming Continue every C(xy) from the worker's primed query state
+     */
+    vector<pair<string, double>> rankQuery(const Buffer& query, long Cx, const Database& db,
+                                           const string& compressor, size_t heapSize,
+                                           ThreadPool& pool, bool usePriming,
+                                           const vector<size_t>* entries = nullptr);
+}
+
+#endif // IDENTIFICATION_H
@@ -0,0 +1,59 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+/**
+ * @brief Buffered console logger for worker threads.
+ * log() only links the message into a lock-free list, so workers never wait on each
+ * other or on the terminal; a background thread writes the collected messages in the
+ * order they were logged every few milliseconds and when the logger is destroyed.
+ * Each message is written as one piece, so the lines of one message stay together.
+ */
+class Logger {
+public:
+    /**
+     * @param out Stream to write to
+     * @param flushMillis Time between two background flushes
+     */
+    explicit Logger(ostream& out = cout, int flushMillis = 50);
+
+    /**
+     * @brief Write what is still pending and stop the background thread
+     */
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * @brief Queue a message (include the trailing newline). Thread-safe and lock-free.
+     */
+    void log(string message);
+
+private:
+    struct Node {
+        string text;
+        Node* next;
+    };
+
+    ostream& out;
+    int flushMillis;
+    atomic<Node*> head{nullptr};
+    bool stopping = false;
+    mutex wakeMutex;
+    condition_variable wake;
+    thread flusher;
+
+    void flushLoop();
+    void drain();
+};
+
+#endif // LOGGER_H
@@ -1,6 +1,11 @@
 #ifndef MAXFREQEXTRACTOR_H
 #define MAXFREQEXTRACTOR_H
 
+#include "FFTPlan.h"
+#include "SpectralKernels.h"
+#include "WAVStream.h"
+#include <complex>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -11,7 +16,12 @@ using namespace std;
  */
 class MaxFreqExtractor {
 public:
-    MaxFreqExtractor(int numFrequencies = 4);
+    /**
+     * @param numFrequencies Number of bins picked per frame
+     * @param peakSpacing 0 picks the strongest bins; otherwise only local maxima with no
+     * stronger bin within this many bins are picked (see PeakSelector)
+     */
+    MaxFreqExtractor(int numFrequencies = 4, int peakSpacing = 0);
     ~MaxFreqExtractor() = default;
     
     /**
@@ -37,28 +47,101 @@ public:
      */
     std::vector<std::vector<float>> extractFeaturesBinary(const std::vector<int16_t>& samples, int channels, int frameSize, int hopSize, int sampleRate = 44100);
 
-private:
-    int numFreqs;  // Number of frequencies to extract per frame
+    /**
+     * @brief Extract features frame by frame from an opened WAV stream
+     * @param stream WAV stream (mixed to mono by the stream)
+     * @param frameSize Size of each analysis frame
+     * @param hopSize Number of samples to advance between frames
+     * @return Feature string representation
+     */
+    string extractFeatures(WAVStream& stream, int frameSize, int hopSize);
+
+    /**
+     * @brief Text header that precedes the frame lines in a feature file
+     * @param channels Number of channels of the source audio
+     * @param frameSize Size of each analysis frame
+     * @param hopSize Number of samples to advance between frames
+     * @param sampleRate Audio sample rate in Hz
+     * @return Header lines, each ending in a newline
+     */
+    string featureHeader(int channels, int frameSize, int hopSize, int sampleRate) const;
+
+    /**
+     * @brief Extract the features of a single frame (e.g. from live input)
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return One feature line, without the trailing newline
+     */
+    string extractFrame(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the features of a single frame as a binary vector
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return Feature vector (float)
+     */
+    vector<float> extractFrameBinary(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the peak bins of a single frame into the extractor's own buffer
+     * (no allocation once the buffers have grown to the frame size)
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return Up to numFreqs peak bins, valid until the next frame is extracted
+     */
+    const vector<int>& extractFrameValues(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the peak bins of a single frame and append them to a text buffer as
+     * one feature line, including the trailing newline
+     */
+    void appendFrame(const float* frame, int frameSize, string& out);
+
+    int getNumFrequencies() const { return numFreqs; }
+    int getPeakSpacing() const { return peakSpacing; }
+
+    // Frame stages, in the order extractFrameValues() runs them (each can be timed on its own)
+
+    /**
+     * @brief Apply window function to a float frame (see WAVStream) and store it as the FFT input
+     */
+    void applyWindow(const float* frame, int size);
+
+    /**
+     * @brief Compute FFT magnitude spectrum of the windowed frame
+     * @param magnitudes Output magnitude spectrum
+     */
+    void computeFFT(vector<double>& magnitudes);
 
     /**
      * @brief Get top N frequency indices from magnitudes
      * @param magnitudes FFT magnitude spectrum
-     * @return Vector of frequency indices
+     * @return Vector of frequency indices, valid until the next frame
      */
-    vector<int> getTopFreqIndices(const vector<double>& magnitudes);
-    
+    const vector<int>& getTopFreqIndices(const vector<double>& magnitudes);
+
+private:
+    int numFreqs;  // Number of frequencies to extract per frame
+    int peakSpacing;  // Peak-picking distance in bins (0: strongest bins)
+    shared_ptr<const vector<float>> window;  // Hann window for the current frame size
+    shared_ptr<const FFTPlan> plan;  // FFT plan for the current frame size
+    vector<double> frameMagnitudes;  // Reused magnitude buffer for single frames
+    vector<int> indices;             // Reused candidate bins for selections beyond PeakSelector::MAX_PEAKS
+    vector<int> topIndices;          // Reused peak bins of the last frame
+    vector<double> fftInput;          // Reused FFT input buffer
+    vector<complex<double>> spectrum; // Reused FFT output buffer
+
     /**
-     * @brief Compute FFT magnitude spectrum of frame
-     * @param frame Input audio frame
-     * @param magnitudes Output magnitude spectrum
+     * @brief Append the peak bins as text, separated by spaces
      */
-    void computeFFT(const vector<int16_t>& frame, vector<double>& magnitudes);
+    static void appendIndices(const vector<int>& peaks, string& out);
     
     /**
-     * @brief Apply window function to frame before FFT
+     * @brief Apply window function to frame and store it as the FFT input
      * @param frame Audio frame data
+     * @param size Number of samples in the frame
      */
-    void applyWindow(vector<int16_t>& frame);
+    void applyWindow(const int16_t* frame, int size);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief Process-wide timing histograms and counters for the hot paths.
+ * Instrumented code looks its stage up once (e.g. into a static reference) and wraps the
+ * timed region in a ScopedTimer. Metrics are off by default; a disabled timer or counter
+ * only tests one flag, without reading the clock. Recording is lock-free: each stage keeps
+ * log2-spaced duration buckets in relaxed atomics, so worker threads never wait on it.
+ */
+namespace Metrics {
+
+/**
+ * @brief Duration histogram of one instrumented stage
+ */
+class Stage {
+public:
+    static constexpr int BUCKETS = 40;  // Bucket b counts durations below 2^b ns; the last one takes the rest
+
+    explicit Stage(const string& name);
+
+    Stage(const Stage&) = delete;
+    Stage& operator=(const Stage&) = delete;
+
+    void record(uint64_t nanos);
+
+    const string& name() const { return stageName; }
+    uint64_t count() const { return calls.load(memory_order_relaxed); }
+    uint64_t totalNanos() const { return total.load(memory_order_relaxed); }
+    uint64_t minNanos() const { return count() ? shortest.load(memory_order_relaxed) : 0; }
+    uint64_t maxNanos() const { return longest.load(memory_order_relaxed); }
+    uint64_t bucket(int b) const { return buckets[b].load(memory_order_relaxed); }
+
+    /**
+     * @brief Upper bound of the bucket holding the given quantile (capped at the longest call)
+     */
+    uint64_t quantileNanos(double q) const;
+
+private:
+    string stageName;
+    atomic<uint64_t> buckets[BUCKETS] = {};
+    atomic<uint64_t> calls{0};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> shortest{UINT64_MAX};
+    atomic<uint64_t> longest{0};
+};
+
+/**
+ * @brief Monotonic event or byte counter
+ */
+class Counter {
+public:
+    explicit Counter(const string& name) : counterName(name) {}
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    inline void add(uint64_t n = 1);
+
+    const string& name() const { return counterName; }
+    uint64_t value() const { return total.load(memory_order_relaxed); }
+
+private:
+    string counterName;
+    atomic<uint64_t> total{0};
+};
+
+extern atomic<bool> active;
+
+inline bool enabled() { return active.load(memory_order_relaxed); }
+
+inline void Counter::add(uint64_t n) {
+    if (enabled()) total.fetch_add(n, memory_order_relaxed);
+}
+
+/**
+ * @brief Stage or counter with the given name, created on first use; the reference stays valid
+ */
+Stage& stage(const string& name);
+Counter& counter(const string& name);
+
+/**
+ * @brief Start recording and write everything recorded to the file when the process exits
+ * @param exportFile Prometheus text format for .prom and .txt files, JSON otherwise
+ */
+void enable(const string& exportFile);
+
+/**
+ * @brief Write the recorded stages (those that ran) and counters
+ * @return false if the file could not be written
+ */
+bool write(const string& path);
+
+/**
+ * @brief Times the enclosing scope into a stage (nothing is read while metrics are disabled)
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage& stage) : target(stage), running(enabled()) {
+        if (running) start = chrono::steady_clock::now();
+    }
+
+    ~ScopedTimer() {
+        if (running) {
+            auto nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+            target.record(static_cast<uint64_t>(nanos.count()));
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage& target;
+    bool running;
+    chrono::steady_clock::time_point start;
+};
+
+}
+
+#endif // METRICS_H
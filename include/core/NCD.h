@@ -1,14 +1,15 @@
 #ifndef NCD_H
 #define NCD_H
 
+#include "Buffer.h"
 #include <string>
 #include <vector>
 
 using namespace std;
 
 /**
- * @brief NCD computes the normalized compression distance between files.
- * Uses an external compressor selected by name (gzip, bzip2, etc.).
+ * @brief NCD computes the normalized compression distance between files or buffers.
+ * Uses a compressor selected by name (gzip, bzip2, etc.) or a Compressor instance.
  */
 class NCD {
 public:
@@ -20,14 +21,83 @@ public:
      * @return The NCD value between 0.0 and 1.0 (smaller means more similar)
      */
     double computeNCD(const string& file1, const string& file2, const string& compressor);
+
+    /**
+     * Compute the NCD between two files whose compressed sizes are already known
+     * (e.g. from a CompressionCache), so only the concatenation is compressed
+     * @param file1 Path to the first file
+     * @param file2 Path to the second file
+     * @param compressor Name of the compressor to use (gzip, bzip2, etc.)
+     * @param Cx Compressed size of file1
+     * @param Cy Compressed size of file2
+     * @return The NCD value between 0.0 and 1.0 (smaller means more similar)
+     */
+    double computeNCD(const string& file1, const string& file2, const string& compressor, long Cx, long Cy);
+
+    /**
+     * Compute the normalized compression distance between two buffers.
+     * C(xy) is obtained by streaming x and then y into the compressor, without
+     * copying them into a concatenated buffer or a temporary file.
+     * @param x First input
+     * @param y Second input
+     * @param compressor Compressor to use
+     * @return The NCD value between 0.0 and 1.0 (smaller means more similar)
+     */
+    double computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor);
+
+    /**
+     * Compute the NCD between two buffers whose compressed sizes are already known
+     * @param x First input
+     * @param y Second input
+     * @param compressor Compressor to use
+     * @param Cx Compressed size of x
+     * @param Cy Compressed size of y
+     * @return The NCD value between 0.0 and 1.0 (smaller means more similar)
+     */
+    double computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor, long Cx, long Cy);
+
+    /**
+     * Same as above, but gives up on C(xy) part-way once the NCD is certain to exceed a
+     * threshold (e.g. the K-th best score of a ranking so far): the partial compressed size
+     * of xy is a lower bound of C(xy), so compression stops when it reaches sizeAbove()
+     * @param threshold Highest NCD of interest
+     * @return The NCD value, or a value above threshold if C(xy) was abandoned
+     */
+    double computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor, long Cx, long Cy,
+                      double threshold);
+
+    /**
+     * Compute the NCD against a compressor already primed with x (see Compressor::prime),
+     * so only y is compressed for C(xy)
+     * @param primedX Compressor state after feeding x
+     * @param y Second input
+     * @param Cx Compressed size of x
+     * @param Cy Compressed size of y
+     * @return The NCD value between 0.0 and 1.0 (smaller means more similar)
+     */
+    double computeNCD(PrimedCompressor& primedX, const Buffer& y, long Cx, long Cy);
+
+    /**
+     * Combine compressed sizes into an NCD value clamped to [0,1]
+     * @return The NCD value, or 1.0 if any size is invalid
+     */
+    static double fromSizes(long Cx, long Cy, long Cxy);
+
+    /**
+     * Smallest C(xy) whose NCD (see fromSizes()) exceeds a threshold
+     * @return The size, or LONG_MAX if no C(xy) can exceed it
+     */
+    static long sizeAbove(long Cx, long Cy, double threshold);
     
     /**
-     * Compute the NCD matrix for a set of files
+     * Compute the NCD matrix for a set of files (see NCDMatrix, which also writes it to disk)
      * @param files Vector of file paths
      * @param compressor Name of the compressor to use
-     * @return Matrix of NCD values between each pair of files
+     * @param threadCount Number of worker threads (0: all available)
+     * @return Matrix of NCD values between each pair of files, or empty on failure
      */
-    vector<vector<double>> computeMatrix(const vector<string>& files, const string& compressor);
+    vector<vector<double>> computeMatrix(const vector<string>& files, const string& compressor,
+                                         unsigned int threadCount = 0);
 };
 
 #endif
\ No newline at end of file
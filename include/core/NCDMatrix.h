@@ -0,0 +1,63 @@
+#ifndef NCDMATRIX_H
+#define NCDMATRIX_H
+
+#include "Buffer.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief NCDMatrix builds the symmetric all-pairs NCD matrix of a set of feature files.
+ * Every file is loaded (memory-mapped) and compressed once; the upper triangle is then cut
+ * into square tiles of C(xy) jobs that the thread pool hands out, so each worker reuses the
+ * same few rows and columns while they are hot in cache. With priming, a worker compresses
+ * the row file once per tile row and continues from a copy of that state for every column.
+ * Values are kept in one row-major array and can be written as CSV or as a binary matrix.
+ */
+class NCDMatrix {
+public:
+    struct Options {
+        unsigned int threadCount = 0;   // Worker threads (0: all available)
+        size_t tileSize = 32;           // Rows/columns per tile
+        bool usePriming = false;        // Reuse the row's compressor state (see Compressor::prime)
+        bool showProgress = true;       // Rate-limited progress line on cout
+    };
+
+    /**
+     * @brief Compute the matrix for a set of feature files
+     * @param files Feature files (.feat or .featbin); names are their file names
+     * @param compressor Name of the compressor to use
+     * @param options Threading, tiling and progress options
+     * @return false if a file cannot be loaded or the compressor is unavailable
+     */
+    bool compute(const vector<string>& files, const string& compressor, const Options& options);
+
+    size_t size() const { return names.size(); }
+    const vector<string>& fileNames() const { return names; }
+    double at(size_t i, size_t j) const { return values[i * names.size() + j]; }
+
+    /**
+     * @brief Matrix as one vector per row
+     */
+    vector<vector<double>> rows() const;
+
+    /**
+     * @brief Write as CSV: a header row of file names, then one row per file
+     */
+    bool writeCSV(const string& path) const;
+
+    /**
+     * @brief Write as binary: "NCDMAT\0\0", uint32 version (1), uint32 n, n names
+     * (uint16 length + bytes), zero padding to a multiple of 8 bytes, then n * n float64
+     * values row-major (all little-endian)
+     */
+    bool writeBinary(const string& path) const;
+
+private:
+    vector<string> names;
+    vector<double> values;
+};
+
+#endif // NCDMATRIX_H
@@ -0,0 +1,112 @@
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include "BoundedQueue.h"
+#include "Buffer.h"
+#include "FeatureDatabase.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief OutputWriter saves finished output files off the compute threads.
+ * Files are queued with write() and a few writer threads take them off the queue in
+ * batches, so on a slow (e.g. network) file system several open/write/close round trips
+ * are in flight at once while the compute threads keep extracting; a full queue holds the
+ * producers back. Each file is written to "<path>.tmp" and renamed over its path, so a
+ * reader never sees a half-written file, and nothing is fsynced.
+ * In packed mode (openPacked()) the files are instead appended to one packed database
+ * (see FeatureDatabase::Writer) together with their compressed sizes, which the writer
+ * threads compute, and no per-file output is left behind.
+ */
+class OutputWriter {
+public:
+    /**
+     * @brief Called on a writer thread once a file is written (or failed to be)
+     */
+    using Callback = function<void(bool ok)>;
+
+    /**
+     * @param threadCount Number of writer threads (0: default of 4)
+     * @param queueSize Number of files that can wait for a writer (0: 4 per thread)
+     */
+    explicit OutputWriter(unsigned int threadCount = 0, size_t queueSize = 0);
+
+    /**
+     * @brief Finish the pending writes (see finish())
+     */
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    /**
+     * @brief Write the files into a packed database instead; call before the first write()
+     * @param binary True if the files are .featbin files, false for .feat
+     * @param compressors Compressors to store the compressed size of every entry for
+     * @return false if the database cannot be created
+     */
+    bool openPacked(const string& path, bool binary, const vector<string>& compressors);
+
+    bool packed() const { return isPacked; }
+
+    /**
+     * @brief Queue a file, waiting while the queue is full
+     * @param path Output path (in packed mode only its file name is used, as entry name)
+     * @param done Optional completion callback
+     */
+    void write(const string& path, Buffer data, Callback done = nullptr);
+
+    /**
+     * @brief Wait until every queued file has been written
+     */
+    void flush();
+
+    /**
+     * @brief Write the queued files, stop the writer threads and, in packed mode, write the
+     * database index and move the database into place
+     * @return false if any file could not be written
+     */
+    bool finish();
+
+    /**
+     * @brief Write a file synchronously to "<path>.tmp" and rename it over the path
+     * @return false on error (reported on cerr)
+     */
+    static bool writeFile(const string& path, const uint8_t* data, size_t size);
+
+private:
+    struct Job {
+        string path;
+        Buffer data;
+        Callback done;
+        vector<long> sizes; // Packed mode: compressed size for every compressor
+    };
+
+    BoundedQueue<Job> jobs;
+    vector<thread> writers;
+    bool finished = false;
+    atomic<bool> failed{false};
+
+    mutex pendingMutex;
+    condition_variable allDone;
+    size_t pending = 0;
+
+    bool isPacked = false;
+    mutex packMutex;
+    FeatureDatabase::Writer pack;
+    vector<string> compressors;
+
+    void run();
+    void sizeJob(Job& job);
+};
+
+#endif // OUTPUTWRITER_H
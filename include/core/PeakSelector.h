@@ -0,0 +1,38 @@
+#ifndef PEAKSELECTOR_H
+#define PEAKSELECTOR_H
+
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief One-pass top-K selection of spectral bins, straight on the magnitude array.
+ * The best K bins seen so far are kept in a small sorted array of fixed capacity; a bin is
+ * only inserted when it beats the current K-th, which after the first bins of a frame is
+ * rare, so a frame costs about one comparison per bin instead of a sort of bin indices.
+ * Bins are ranked by magnitude, and equal magnitudes go to the lower bin.
+ * In peak-picking mode only local maxima are candidates: a bin must be higher than the
+ * bins up to `spacing` below it and at least as high as those up to `spacing` above it,
+ * so two picked bins are always more than `spacing` bins apart and a broad peak yields one
+ * bin instead of several neighbours.
+ */
+namespace PeakSelector {
+
+constexpr int MAX_PEAKS = 64;  // Largest K kept in the fixed-capacity array
+
+/**
+ * @brief Pick the K strongest bins of a frame, strongest first
+ * @param magnitudes Magnitude spectrum
+ * @param n Number of bins
+ * @param first First bin considered (1 skips the DC component)
+ * @param k Number of bins to pick
+ * @param spacing 0 to consider every bin, otherwise the peak-picking distance in bins
+ * @param out Output, room for k bins
+ * @param scratch Bin buffer, only used when k exceeds MAX_PEAKS
+ * @return Number of bins picked (less than k when there are fewer candidates)
+ */
+int select(const double* magnitudes, int n, int first, int k, int spacing, int* out, vector<int>& scratch);
+
+}
+
+#endif // PEAKSELECTOR_H
@@ -0,0 +1,86 @@
+#ifndef PREFILTERINDEX_H
+#define PREFILTERINDEX_H
+
+#include "Buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief PrefilterIndex picks the database entries worth a full NCD run for a query.
+ * Every track is reduced to a signature: the set of peak pairs ("landmarks") linking a
+ * spectral peak of one frame to a peak of one of the next few frames, stored as
+ * (first bin, second bin, frame distance). Maxfreq frames are peak bins already; for
+ * spectral frames the strongest bins are used. Landmarks only depend on relative time,
+ * so an excerpt shares the landmarks of the part of the track it was cut from.
+ * The signatures go into an inverted index (sorted token list with posting lists), and a
+ * query scores every entry by the shared landmarks, each weighted by how rare it is in
+ * the database (idf), so one scan of the query's posting lists ranks the whole library.
+ */
+class PrefilterIndex {
+public:
+    /**
+     * @brief Builds the signature of one track from its feature frames, in order
+     */
+    class SignatureBuilder {
+    public:
+        /**
+         * @param spectral True for spectral frames (bin energies), false for maxfreq frames (peak bins)
+         */
+        explicit SignatureBuilder(bool spectral);
+
+        void addFrame(const float* values, size_t dims);
+        void addFrame(const vector<float>& values) { addFrame(values.data(), values.size()); }
+
+        /**
+         * @brief Landmark tokens of the frames added so far, sorted and without duplicates
+         */
+        vector<uint32_t> tokens() const;
+
+    private:
+        bool spectral;
+        vector<vector<int>> recent;   // Peaks of the last frames (ring of fanout entries)
+        size_t framesAdded = 0;
+        vector<uint32_t> collected;
+        vector<int> peaks;
+        vector<int> order;
+    };
+
+    static constexpr size_t peaksPerSpectralFrame = 3;
+    static constexpr size_t fanout = 3;  // Frame distances 1..fanout are paired
+
+    /**
+     * @brief Signature of a whole feature file (text .feat or version 2 .featbin)
+     * @param file Contents of the file
+     * @param name File name used in error messages
+     * @param tokens Output, sorted and without duplicates
+     * @return false if the file has no known frame layout (e.g. version 1 .featbin)
+     */
+    static bool signatureOf(const Buffer& file, const string& name, vector<uint32_t>& tokens);
+
+    /**
+     * @brief Build the index; entry i is signatures[i]
+     */
+    void build(const vector<vector<uint32_t>>& signatures);
+
+    size_t size() const { return entryCount; }
+
+    /**
+     * @brief The best scoring entries for a query signature, best first (ties: lower entry
+     * index first); entries sharing no landmark with the query are not returned
+     * @param query Signature of the query (sorted, without duplicates)
+     * @param k Number of candidates to return
+     */
+    vector<size_t> candidates(const vector<uint32_t>& query, size_t k) const;
+
+private:
+    size_t entryCount = 0;
+    vector<uint32_t> tokens;      // Distinct tokens, sorted
+    vector<uint32_t> firstPosting; // Postings of tokens[t]: postings[firstPosting[t] .. firstPosting[t + 1])
+    vector<uint32_t> postings;    // Entry indices
+};
+
+#endif // PREFILTERINDEX_H
@@ -0,0 +1,52 @@
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief Thread-safe progress line for long jobs, printed at most once per interval.
+ * Workers only bump an atomic counter; whichever worker notices that the interval has
+ * passed prints the line (done/total, rate and estimated time left), and the others
+ * never wait for it.
+ */
+class ProgressReporter {
+public:
+    /**
+     * @param label Text in front of the counts
+     * @param total Number of steps in the job
+     * @param intervalSeconds Minimum time between two progress lines
+     */
+    ProgressReporter(const string& label, size_t total, double intervalSeconds = 1.0);
+
+    /**
+     * @brief Record finished steps
+     */
+    void add(size_t count = 1);
+
+    /**
+     * @brief Print the final line (once)
+     */
+    void finish();
+
+private:
+    using Clock = chrono::steady_clock;
+
+    string label;
+    size_t total;
+    Clock::duration interval;
+    Clock::time_point start;
+    atomic<size_t> done{0};
+    atomic<Clock::rep> nextReport;
+    mutex printMutex;
+    bool finished = false;
+
+    void print(size_t count, bool last);
+};
+
+#endif // PROGRESSREPORTER_H
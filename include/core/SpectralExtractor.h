@@ -1,6 +1,11 @@
 #ifndef SpectralExtractor_H
 #define SpectralExtractor_H
 
+#include "FFTPlan.h"
+#include "SpectralKernels.h"
+#include "WAVStream.h"
+#include <complex>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -37,28 +42,99 @@ public:
      */
     std::vector<std::vector<float>> extractFeaturesBinary(const std::vector<int16_t>& samples, int channels, int frameSize, int hopSize, int sampleRate = 44100);
 
-private:
-    int numBins;  // Number of frequency bins to use
-    
     /**
-     * @brief Compute FFT magnitude spectrum of frame
-     * @param frame Input audio frame
+     * @brief Extract features frame by frame from an opened WAV stream
+     * @param stream WAV stream (mixed to mono by the stream)
+     * @param frameSize Size of each analysis frame
+     * @param hopSize Number of samples to advance between frames
+     * @return Feature string representation
+     */
+    string extractFeatures(WAVStream& stream, int frameSize, int hopSize);
+
+    /**
+     * @brief Text header that precedes the frame lines in a feature file
+     * @param channels Number of channels of the source audio
+     * @param frameSize Size of each analysis frame
+     * @param hopSize Number of samples to advance between frames
+     * @param sampleRate Audio sample rate in Hz
+     * @return Header lines, each ending in a newline
+     */
+    string featureHeader(int channels, int frameSize, int hopSize, int sampleRate) const;
+
+    /**
+     * @brief Extract the features of a single frame (e.g. from live input)
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return One feature line, without the trailing newline
+     */
+    string extractFrame(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the features of a single frame as a binary vector
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return Feature vector (float)
+     */
+    vector<float> extractFrameBinary(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the features of a single frame into the extractor's own buffer
+     * (no allocation once the buffers have grown to the frame size)
+     * @param frame frameSize mono samples in the 16-bit range (see WAVStream)
+     * @param frameSize Size of the frame
+     * @return numBins values, valid until the next frame is extracted
+     */
+    const vector<float>& extractFrameValues(const float* frame, int frameSize);
+
+    /**
+     * @brief Extract the features of a single frame and append them to a text buffer as
+     * one feature line, including the trailing newline
+     */
+    void appendFrame(const float* frame, int frameSize, string& out);
+
+    int getNumBins() const { return numBins; }
+
+    // Frame stages, in the order extractFrameValues() runs them (each can be timed on its own)
+
+    /**
+     * @brief Apply window function to a float frame (see WAVStream) and store it as the FFT input
+     */
+    void applyWindow(const float* frame, int size);
+
+    /**
+     * @brief Compute FFT log-magnitude spectrum of the windowed frame
      * @param magnitudes Output magnitude spectrum
      */
-    void computeFFT(const vector<int16_t>& frame, vector<double>& magnitudes);
+    void computeFFT(vector<float>& magnitudes);
+
+    /**
+     * @brief Convert full FFT spectrum to reduced bins
+     * @param magnitudes Full magnitude spectrum
+     * @return Reduced spectrum with 'numBins' bins, valid until the next frame
+     */
+    const vector<float>& getBinnedSpectrum(const vector<float>& magnitudes);
+
+private:
+    int numBins;  // Number of frequency bins to use
+    const SpectralKernels::Kernels* kernels;  // Vector kernels picked for this CPU
+    shared_ptr<const vector<float>> window;   // Hann window for the current frame size
+    shared_ptr<const FFTPlan> plan;  // FFT plan for the current frame size
+    vector<float> frameMagnitudes;  // Reused magnitude buffer for single frames
+    vector<float> frameBins;        // Reused binned spectrum of the last frame
+    vector<double> fftInput;          // Reused FFT input buffer
+    vector<complex<double>> spectrum; // Reused FFT output buffer
     
     /**
-     * @brief Apply window function to frame before FFT
+     * @brief Apply window function to frame and store it as the FFT input
      * @param frame Audio frame data
+     * @param size Number of samples in the frame
      */
-    void applyWindow(vector<int16_t>& frame);
-    
+    void applyWindow(const int16_t* frame, int size);
+
     /**
-     * @brief Convert full FFT spectrum to reduced bins
-     * @param magnitudes Full magnitude spectrum
-     * @return Reduced spectrum with 'numBins' bins
+     * @brief Append the fixed-point text form of the bins, separated by spaces
      */
-    vector<double> getBinnedSpectrum(const vector<double>& magnitudes);
+    static void appendBins(const vector<float>& bins, string& out);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef SPECTRALKERNELS_H
+#define SPECTRALKERNELS_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Per-frame float32 kernels used by the feature extractors, with AVX2 (x86-64) and
+ * NEON (AArch64) versions picked at runtime and a scalar fallback.
+ * The scalar kernels use the same lane layout and log polynomial as the vector ones, so the
+ * extracted features do not depend on which kernel set the machine ends up using.
+ */
+namespace SpectralKernels {
+
+struct Kernels {
+    const char* name;
+
+    /**
+     * @brief out[i] = trunc(samples[i] * window[i]) * scale; the product is truncated to an
+     * integer sample like the int16 frame the extractors used to window in place
+     */
+    void (*window)(const int16_t* samples, const float* window, double scale, double* out, size_t n);
+
+    /**
+     * @brief Same as window() for float samples in the 16-bit range (see WAVStream)
+     */
+    void (*windowFloat)(const float* samples, const float* window, double scale, double* out, size_t n);
+
+    /**
+     * @brief out[i] = log1p(|spectrum[i]|), from |X|^2 computed in double
+     */
+    void (*logMagnitude)(const complex<double>* spectrum, float* out, size_t n);
+
+    /**
+     * @brief Sum of squares of n values (the energy of one spectral bin)
+     */
+    float (*sumSquares)(const float* values, size_t n);
+};
+
+/**
+ * @brief Best kernel set supported by this CPU (detected once)
+ */
+const Kernels& active();
+
+/**
+ * @brief Portable kernel set, always available
+ */
+const Kernels& scalar();
+
+/**
+ * @brief Shared Hann window for the given frame size, computed on first use
+ */
+shared_ptr<const vector<float>> hannWindow(int size);
+
+}
+
+#endif // SPECTRALKERNELS_H
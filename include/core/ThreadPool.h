@@ -0,0 +1,76 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Fixed set of worker threads fed from one shared task queue.
+ * Idle workers take the next task as soon as they finish one, so long and short jobs
+ * balance themselves instead of being split into fixed ranges up front. The workers live
+ * as long as the pool, so per-thread state (e.g. CompressorWrapper::threadCompressor)
+ * is reused across every batch of work submitted to it.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param threadCount Number of workers (0: one per hardware thread)
+     */
+    explicit ThreadPool(unsigned int threadCount = 0);
+
+    /**
+     * @brief Finish the queued tasks, then stop and join the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Worker count for a requested value: the request itself, or the hardware
+     * concurrency (2 if unknown) when it is 0, capped to the number of jobs when given
+     */
+    static unsigned int threadCountFor(unsigned int requested, size_t jobs = 0);
+
+    /**
+     * @brief Number of worker threads
+     */
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    /**
+     * @brief Queue a task; it receives the index (0..size()-1) of the worker running it
+     */
+    void submit(function<void(unsigned int worker)> task);
+
+    /**
+     * @brief Block until every task submitted so far has finished
+     */
+    void wait();
+
+    /**
+     * @brief Run body(index, worker) for every index in [0, count) and wait for all of them.
+     * Indices are handed out one at a time in increasing order to whichever worker is free,
+     * so put the most expensive items first. Must not be called from inside a pool task.
+     */
+    void parallelFor(size_t count, const function<void(size_t index, unsigned int worker)>& body);
+
+private:
+    vector<thread> workers;
+    deque<function<void(unsigned int)>> tasks;
+    mutex mtx;
+    condition_variable taskReady;
+    condition_variable allDone;
+    size_t pending = 0;         // Tasks queued or running
+    bool stopping = false;
+
+    void workerLoop(unsigned int worker);
+};
+
+#endif // THREADPOOL_H
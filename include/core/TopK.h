@@ -0,0 +1,57 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Bounded max-heap keeping the K lowest-scoring (best) entries seen so far.
+ * Ties on score are broken by name so the final ranking does not depend on the
+ * order in which entries were pushed (e.g. by different worker threads).
+ */
+class TopK {
+public:
+    /**
+     * @param k Number of entries to keep (0 keeps every entry)
+     */
+    explicit TopK(size_t k = 0);
+    ~TopK() = default;
+
+    /**
+     * @brief Offer an entry; it is kept only if it ranks among the best K
+     */
+    void push(const string& name, double score);
+
+    /**
+     * @brief Merge the entries of another heap into this one
+     */
+    void merge(const TopK& other);
+
+    /**
+     * @brief Check if a score could still enter the heap
+     */
+    bool accepts(double score) const;
+
+    /**
+     * @brief Worst score currently kept (the K-th best), or +infinity while not full
+     */
+    double threshold() const;
+
+    size_t size() const { return heap.size(); }
+    size_t capacity() const { return k; }
+
+    /**
+     * @brief Entries ordered from best (lowest score) to worst
+     */
+    vector<pair<string, double>> sorted() const;
+
+private:
+    size_t k;
+    vector<pair<string, double>> heap;  // max-heap on (score, name)
+};
+
+#endif // TOPK_H
@@ -0,0 +1,130 @@
+#ifndef WAVSTREAM_H
+#define WAVSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief WAVStream decodes a WAV file (PCM 8/16/24/32-bit or 32-bit float) incrementally
+ * into overlapping frames of mono float samples.
+ * The data chunk is read in fixed-size blocks, so memory use is one block plus one frame
+ * regardless of the track length. Samples are scaled to the 16-bit range; 8- and 16-bit
+ * channels are mixed to mono with the same integer average as the in-memory extractors.
+ * Besides files, the stream can read from a pipe or socket (live input), either with a WAV
+ * header or as headerless PCM; nextFrame() then blocks until enough audio has arrived.
+ */
+class WAVStream {
+public:
+    WAVStream() = default;
+    ~WAVStream();
+
+    WAVStream(const WAVStream&) = delete;
+    WAVStream& operator=(const WAVStream&) = delete;
+
+    /**
+     * @brief Open a WAV file and parse its header
+     * @param filename Path to WAV file
+     * @param verbose Print the format to cout (see describe())
+     * @return true if the file is a supported WAV file
+     */
+    bool open(const string& filename, bool verbose = true);
+
+    /**
+     * @brief Read from an already open pipe, socket or file (not closed by the stream).
+     * A stream that starts with a RIFF header is parsed as WAV; anything else is taken as
+     * headerless little-endian PCM in the given format.
+     * @return true if the header (if any) is supported
+     */
+    bool openFd(int fd, int rawSampleRate, int rawChannels, int rawBitsPerSample);
+
+    /**
+     * @brief Set the framing used by nextFrame() and restart from the first sample
+     * (live input cannot be restarted once frames have been read)
+     * @param frameSize Number of mono samples per frame
+     * @param hopSize Number of samples to advance between frames
+     * @return true on success
+     */
+    bool setFraming(int frameSize, int hopSize);
+
+    /**
+     * @brief Get the next frame; the pointer stays valid until the next call
+     * @param frame Output pointer to frameSize mono samples
+     * @return false once fewer than frameSize samples remain, or on read error
+     */
+    bool nextFrame(const float*& frame);
+
+    /**
+     * @brief Ask the kernel to start reading the rest of the data chunk in the background
+     * (regular files only), so decoding does not wait for the disk
+     */
+    void prefetch() const;
+
+    /**
+     * @brief Format summary lines as printed when the stream is opened
+     */
+    string describe() const;
+
+    /**
+     * @brief Check if reading stopped because of an I/O error rather than the end of data
+     */
+    bool failed() const { return readError; }
+
+    int getSampleRate() const { return samplerate; }
+    int getChannels() const { return channels; }
+    int getBitsPerSample() const { return bitsPerSample; }
+
+    /**
+     * @brief Number of samples per channel in the data chunk (0 for live input)
+     */
+    size_t frameCount() const { return blockAlign && !unbounded ? dataBytes / blockAlign : 0; }
+
+    /**
+     * @brief Number of frames nextFrame() returns with the given framing (0 for live input)
+     */
+    size_t analysisFrames(int frameSize, int hopSize) const {
+        size_t samples = frameCount();
+        if (frameSize <= 0 || hopSize <= 0 || samples < static_cast<size_t>(frameSize)) return 0;
+        return (samples - frameSize) / hopSize + 1;
+    }
+
+private:
+    string path;
+    int fd = -1;
+    bool ownsFd = false;
+    bool seekable = false;
+    bool unbounded = false;     // Live input: read until end of stream
+    int samplerate = 0;
+    int channels = 0;
+    int bitsPerSample = 0;
+    bool isFloat = false;
+    size_t blockAlign = 0;      // Bytes per sample frame (all channels)
+    int64_t dataStart = 0;      // Offset of the first sample in the file
+    size_t dataBytes = 0;       // Size of the data chunk, whole sample frames only
+    size_t bytesRead = 0;       // Bytes of the data chunk consumed so far
+    bool readError = false;
+    bool endOfInput = false;
+
+    int frameSize = 0;
+    int hopSize = 0;
+    bool started = false;
+    vector<uint8_t> block;      // Raw bytes read but not decoded yet (partial sample frames)
+    vector<float> pending;      // Decoded mono samples not yet dropped
+    size_t frameStart = 0;      // Index in pending where the next frame starts
+
+    void reset();
+    void closeFd();
+    bool parseHeader(const uint8_t* riff);
+    bool validateFormat();
+    size_t readSome(uint8_t* buffer, size_t size);
+    bool readExact(uint8_t* buffer, size_t size);
+    bool skipBytes(size_t size);
+    bool fill();
+    void decode(const uint8_t* bytes, size_t count);
+    float decodeSample(const uint8_t* p) const;
+};
+
+#endif // WAVSTREAM_H
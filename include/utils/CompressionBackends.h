@@ -0,0 +1,36 @@
+#ifndef COMPRESSIONBACKENDS_H
+#define COMPRESSIONBACKENDS_H
+
+#include "CompressorWrapper.h"
+
+/**
+ * @brief Factories for the in-process compression backends.
+ * Each factory is only available when the corresponding library was found at build time
+ * (HAVE_ZLIB, HAVE_BZIP2, HAVE_LZMA, HAVE_ZSTD). Each takes its level, window and thread
+ * count from the spec; the default levels mirror the external tools (gzip -9, bzip2 -9,
+ * lzma -9, zstd -19) so compressed sizes stay comparable.
+ * The fcm backend is built in and always available.
+ */
+namespace CompressionBackends {
+    /**
+     * @brief Order-k finite-context model that estimates the arithmetic-coded size of its
+     * input from symbol statistics, without producing output
+     * @param spec The level is the context length in bytes (1 to 8)
+     */
+    unique_ptr<Compressor> makeFcm(const CompressorSpec& spec);
+
+#ifdef HAVE_ZLIB
+    unique_ptr<Compressor> makeGzip(const CompressorSpec& spec);
+#endif
+#ifdef HAVE_BZIP2
+    unique_ptr<Compressor> makeBzip2(const CompressorSpec& spec);
+#endif
+#ifdef HAVE_LZMA
+    unique_ptr<Compressor> makeLzma(const CompressorSpec& spec);
+#endif
+#ifdef HAVE_ZSTD
+    unique_ptr<Compressor> makeZstd(const CompressorSpec& spec);
+#endif
+}
+
+#endif // COMPRESSIONBACKENDS_H
@@ -0,0 +1,85 @@
+#ifndef COMPRESSIONCACHE_H
+#define COMPRESSIONCACHE_H
+
+#include "CompressorWrapper.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief CompressionCache is a persistent sidecar cache of per-file compressed sizes.
+ * Entries are keyed by compressor spec (name, level, window, threads) and file path, and are only reused while the
+ * file still has the same size and modification time. Stored as JSON next to the files
+ * (by default <dir>/.ncd_cache.json) so every query against the same database only
+ * compresses what changed.
+ */
+class CompressionCache {
+public:
+    /**
+     * @param cacheFile Path of the JSON cache file; file paths are stored relative to its directory
+     */
+    explicit CompressionCache(const string& cacheFile);
+    ~CompressionCache() = default;
+
+    /**
+     * @brief Default cache location for a database directory
+     */
+    static string defaultPath(const string& dbDir);
+
+    /**
+     * @brief Load the cache file (a missing file is an empty cache)
+     * @return false if the file exists but could not be parsed
+     */
+    bool load();
+
+    /**
+     * @brief Write the cache back to disk if anything changed since load()
+     * @return true if the cache is up to date on disk
+     */
+    bool save();
+
+    /**
+     * @brief Get the compressed size of a file, compressing it only if the cached value is stale.
+     * Thread-safe.
+     * @return Compressed size in bytes, or 0 on failure (failures are not cached)
+     */
+    long compressedSize(const string& file, const string& compressor);
+
+    /**
+     * @brief Same as above, but compresses the given content of the file (e.g. the payload
+     * of a .featbin file) instead of the whole file; the entry is still keyed by the file.
+     * Thread-safe.
+     */
+    long compressedSize(const string& file, ByteSpan content, const string& compressor);
+
+    /**
+     * @brief Number of lookups answered from the cache / recomputed since construction
+     */
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    struct Entry {
+        uintmax_t fileSize = 0;
+        int64_t mtime = 0;
+        long compressed = 0;
+    };
+
+    string path;
+    string baseDir;
+    // Size key of the compressor spec ("<name>:<level>[:w<window>][:t<threads>]") -> relative file path -> entry
+    map<string, map<string, Entry>> entries;
+    bool dirty = false;
+    int hitCount = 0;
+    int missCount = 0;
+    mutex mtx;
+
+    string relativeKey(const string& file) const;
+    long cachedSize(const string& file, const string& compressor, const function<long()>& compress);
+};
+
+#endif // COMPRESSIONCACHE_H
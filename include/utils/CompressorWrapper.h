@@ -1,24 +1,218 @@
 #ifndef COMPRESSORWRAPPER_H
 #define COMPRESSORWRAPPER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 /**
- * @brief CompressorWrapper calls external compressors to compress files and returns compressed size.
+ * @brief Non-owning view of a contiguous byte range (a minimal span<const uint8_t>)
+ */
+struct ByteSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ByteSpan() = default;
+    ByteSpan(const uint8_t* d, size_t n) : data(d), size(n) {}
+    ByteSpan(const vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+    ByteSpan(const string& s) : data(reinterpret_cast<const uint8_t*>(s.data())), size(s.size()) {}
+};
+
+/**
+ * @brief A compressor and its tuning parameters, written "name[:level][:w<window log>][:t<threads>]"
+ * (e.g. "zstd:3", "lzma:6:w24", "zstd:19:t4"). Parameters that are left out use the
+ * defaults of the backend, which match the one-shot tools (gzip/bzip2/lzma -9, zstd -19).
+ * Every place that takes a compressor name also accepts a spec.
+ */
+struct CompressorSpec {
+    string name;
+    int level = 0;      // Compression level (fcm: context order); 0 until parsed
+    int windowLog = 0;  // log2 of the window / dictionary size (0: backend default)
+    int threads = 0;    // Worker threads inside the backend (zstd only; 0: none)
+
+    /**
+     * @brief Parse and validate a spec against the ranges the backend supports:
+     * gzip level 1-9, window 9-15; bzip2 level 1-9; lzma level 0-9, window 12-30;
+     * zstd level 1-22, window 10-31, threads; fcm order 1-8
+     * @return false (with a message on cerr) if the spec is malformed or out of range
+     */
+    static bool parse(const string& text, CompressorSpec& spec);
+
+    /**
+     * @brief Canonical form with the level always written, e.g. "gzip:9" or "zstd:3:w23";
+     * stored compressed sizes are keyed by it
+     */
+    string key() const;
+};
+
+/**
+ * @brief Compressor state captured after a common prefix (e.g. the query) has been fed.
+ * Each call continues from a copy of that state, so the prefix is only compressed once
+ * no matter how many suffixes are compared against it. Not thread-safe; use one per thread.
+ */
+class PrimedCompressor {
+public:
+    virtual ~PrimedCompressor() = default;
+
+    /**
+     * @brief Compressed size of the prefix followed by the given suffix
+     * @return Compressed size in bytes, or 0 on failure
+     */
+    virtual long compressedSizeWith(ByteSpan suffix) = 0;
+};
+
+/**
+ * @brief Compressor is an in-process compression backend that only counts output bytes.
+ * Input is streamed through begin()/feed()/finish(); the compressed stream is written into
+ * a fixed per-thread scratch buffer that is overwritten continuously, so memory use does not
+ * depend on the input size and nothing is allocated per call once the backend is warm.
+ */
+class Compressor {
+public:
+    virtual ~Compressor() = default;
+
+    /**
+     * @brief Name of the compressor (gzip, bzip2, lzma, zstd, fcm)
+     */
+    virtual string name() const = 0;
+
+    /**
+     * @brief Start a new compressed stream
+     * @param totalSize Total number of bytes that will be fed (0 if unknown); lets the
+     *        backend pick the same parameters the one-shot tools would use
+     * @return true on success
+     */
+    virtual bool begin(size_t totalSize) = 0;
+
+    /**
+     * @brief Feed the next chunk of input into the current stream
+     * @return true on success
+     */
+    virtual bool feed(ByteSpan input) = 0;
+
+    /**
+     * @brief Finish the current stream
+     * @return Total compressed size in bytes, or 0 on failure
+     */
+    virtual long finish() = 0;
+
+    /**
+     * @brief Compress a memory buffer and return the size of the compressed output
+     * @return Compressed size in bytes, or 0 on failure
+     */
+    long compressedSize(ByteSpan input);
+
+    /**
+     * @brief Compress the concatenation of two buffers as a single stream, without copying them
+     * @return Compressed size of first followed by second, or 0 on failure
+     */
+    long compressedSize(ByteSpan first, ByteSpan second);
+
+    /**
+     * @brief Same as compressedSize(first, second), but gives up as soon as the output
+     * reaches limit bytes: second is fed in chunks, checking outputSoFar() after each (in
+     * one piece if the backend cannot tell its output size)
+     * @return Compressed size, a size of at least limit if abandoned, or 0 on failure
+     */
+    long compressedSize(ByteSpan first, ByteSpan second, long limit);
+
+    /**
+     * @brief Compressed size the current stream has reached so far, a lower bound of what
+     * finish() returns. Backends that buffer a whole block (bzip2, zstd) report nothing
+     * until the block is complete.
+     * @return Size in bytes, or -1 if the backend cannot tell (or its result would depend
+     * on how the input is split, as fcm's floating-point cost does)
+     */
+    virtual long outputSoFar() const { return -1; }
+
+    /**
+     * @brief Snapshot the compressor state after feeding a prefix (see PrimedCompressor).
+     * gzip continues from an exact copy of the deflate state, so results equal compressing
+     * prefix+suffix as one stream; zstd uses the prefix as a raw-content dictionary, which
+     * approximates C(prefix+suffix) as C(prefix) + C(suffix | prefix).
+     * @return The primed state, or nullptr if this compressor cannot be primed
+     */
+    virtual unique_ptr<PrimedCompressor> prime(ByteSpan prefix);
+
+protected:
+    /**
+     * @brief Per-thread scratch buffer that backends use as their output sink
+     */
+    static uint8_t* scratch();
+    static constexpr size_t SCRATCH_SIZE = 64 * 1024;
+};
+
+/**
+ * @brief CompressorWrapper compresses files and returns the compressed size.
+ * Uses an in-process backend when one is available for the requested compressor,
+ * and falls back to calling the external compressor tool otherwise.
  */
 class CompressorWrapper {
 public:
+    using BackendFactory = function<unique_ptr<Compressor>(const CompressorSpec&)>;
+
     CompressorWrapper() = default;
     ~CompressorWrapper() = default;
 
     /**
      * @brief Compress file with specified compressor and return the size of compressed output.
-     * Compressors supported: gzip, bzip2, lzma, zstd.
-     * Temporary files are created and cleaned up.
+     * Compressors supported: gzip, bzip2, lzma, zstd, fcm, each optionally with parameters
+     * (see CompressorSpec).
+     * In-process backends stream the file through the counting sink; otherwise temporary
+     * files are created by the external tool and cleaned up.
      */
     long compressAndGetSize(const string& compressor, const string& inputFile);
+
+    /**
+     * @brief Compress a memory buffer and return the size of the compressed output.
+     * Falls back to the external tool (through a temporary file) if no in-process backend exists.
+     */
+    long compressedSize(const string& compressor, ByteSpan input);
+
+    /**
+     * @brief Compression level used when a spec gives none (gzip/bzip2/lzma: 9, zstd: 19, fcm: 6)
+     */
+    static int defaultLevel(const string& compressor);
+
+    /**
+     * @brief Canonical key of a compressor spec (CompressorSpec::key()), or the text itself
+     * if it does not parse
+     */
+    static string sizeKey(const string& compressor);
+
+    /**
+     * @brief Create an in-process backend for the given compressor spec.
+     * @return The backend, or nullptr if it was not compiled in
+     */
+    static unique_ptr<Compressor> createBackend(const string& compressor);
+
+    /**
+     * @brief Check if an in-process backend is available for the given compressor (name or spec)
+     */
+    static bool hasBackend(const string& compressor);
+
+    /**
+     * @brief Register (or replace) an in-process backend under the given name
+     */
+    static void registerBackend(const string& compressor, BackendFactory factory);
+
+    /**
+     * @brief Get (creating on first use) this thread's backend for the given compressor
+     * @return The backend, or nullptr if none is available
+     */
+    static Compressor* threadBackend(const string& compressor);
+
+    /**
+     * @brief Get this thread's compressor for the given name: the in-process backend when
+     * available, otherwise one that streams its input to a temporary file for the external tool
+     * @return The compressor, or nullptr if the name is unknown
+     */
+    static Compressor* threadCompressor(const string& compressor);
 };
 
 #endif // COMPRESSORWRAPPER_H
@@ -14,7 +14,7 @@ function show_help() {
     echo "  -q, --query <dir>     Directory with query feature files [default: data/queries]"
     echo "  -d, --db <dir>        Directory with database feature files [default: data/features/db]"
     echo "  -o, --output <dir>    Output directory for results [default: output]"
-    echo "  -c, --compressor <c>  Compressor to use (gzip, bzip2, lzma, zstd) [default: gzip]"
+    echo "  -c, --compressor <c>  Compressor to use (gzip, bzip2, lzma, zstd, fcm) [default: gzip]"
     echo "  --binary              Use binary feature files (.featbin) instead of text (.feat)"
     echo "  -h, --help            Show this help message"
     echo
@@ -86,34 +86,28 @@ else
     file_extension="*.feat"
 fi
 
-query_count=0
+# Count the query files
+shopt -s nullglob
+query_files=("${query_dir}"/${file_extension})
+shopt -u nullglob
+query_count=${#query_files[@]}
 
-for query_file in "${query_dir}"/${file_extension}; do
-    if [ ! -f "$query_file" ]; then
-        if [ "$use_binary" = true ]; then
-            echo "No .featbin files found in $query_dir"
-        else
-            echo "No .feat files found in $query_dir"
-        fi
-        exit 1
-    fi
-    
-    query_name=$(basename "$query_file")
-    if [ "$use_binary" = true ]; then
-        result_file="${output_dir}/${query_name%.featbin}_results.csv"
-    else
-        result_file="${output_dir}/${query_name%.feat}_results.csv"
-    fi
-    
-    echo "Processing query: $query_name"
+if [ "$query_count" -eq 0 ]; then
     if [ "$use_binary" = true ]; then
-        ./apps/music_id --compressor "$compressor" --binary "$query_file" "$db_dir" "$result_file"
+        echo "No .featbin files found in $query_dir"
     else
-        ./apps/music_id --compressor "$compressor" "$query_file" "$db_dir" "$result_file"
+        echo "No .feat files found in $query_dir"
     fi
-    
-    ((query_count++))
-done
+    exit 1
+fi
+
+# Identify all queries in one process, so the database is only loaded once
+echo "Processing $query_count queries..."
+if [ "$use_binary" = true ]; then
+    ./apps/music_id --compressor "$compressor" --binary --batch "$query_dir" "$db_dir" "$output_dir"
+else
+    ./apps/music_id --compressor "$compressor" --batch "$query_dir" "$db_dir" "$output_dir"
+fi
 
 echo "Batch processing complete. Processed $query_count queries."
 echo "Results saved to $output_dir"
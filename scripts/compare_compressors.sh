@@ -4,7 +4,7 @@
 query_dir="data/queries"
 db_dir="data/features/db"
 output_dir="results"
-compressors=("gzip" "bzip2" "lzma" "zstd")
+compressors=("gzip" "bzip2" "lzma" "zstd" "fcm")
 parallel=false
 use_binary=false
 
@@ -15,7 +15,7 @@ function show_help() {
     echo "  -q, --query <dir>           Directory with query feature files [default: data/queries]"
     echo "  -d, --db <dir>              Directory with database feature files [default: data/features/db]"
     echo "  -o, --output <dir>          Base output directory for results [default: results]"
-    echo "  -c, --compressors <list>    Comma-separated list of compressors [default: gzip,bzip2,lzma,zstd]"
+    echo "  -c, --compressors <list>    Comma-separated list of compressors [default: gzip,bzip2,lzma,zstd,fcm]"
     echo "  -p, --parallel              Run compressor tests in parallel [default: false]"
     echo "  --binary                    Use binary feature files (.featbin) instead of text (.feat)"
     echo "  -h, --help                  Show this help message"
@@ -17,7 +17,9 @@ print_usage() {
     echo "Available applications:"
     echo "  music_id         Full pipeline: extract features, compute NCD, build tree"
     echo "  extract_features Extract frequency features from WAV files"
+    echo "  build_db         Pack a feature folder into one database file"
     echo "  compute_ncd      Compute NCD matrix between feature files"
+    echo "  bench            Run the benchmark suite (results as JSON)"
     echo "  build_tree       Build a similarity tree from NCD matrix"
     echo ""
     echo "Examples:"
@@ -39,7 +41,7 @@ shift  # Remove the app name from arguments
 
 # Validate app name
 case "$APP" in
-    music_id|extract_features|compute_ncd|build_tree)
+    music_id|extract_features|build_db|compute_ncd|bench|build_tree)
         # Valid app name
         ;;
     *)
@@ -0,0 +1,97 @@
+#include "../../include/core/Buffer.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Owns a read-only file mapping
+ */
+struct Mapping {
+    void* addr = MAP_FAILED;
+    size_t length = 0;
+
+    ~Mapping() {
+        if (addr != MAP_FAILED) munmap(addr, length);
+    }
+};
+
+}
+
+Buffer Buffer::fromBytes(vector<uint8_t> bytes) {
+    auto storage = make_shared<vector<uint8_t>>(move(bytes));
+    Buffer buffer;
+    buffer.ptr = storage->data();
+    buffer.length = storage->size();
+    buffer.owner = storage;
+    return buffer;
+}
+
+Buffer Buffer::fromString(string text) {
+    auto storage = make_shared<string>(move(text));
+    Buffer buffer;
+    buffer.ptr = reinterpret_cast<const uint8_t*>(storage->data());
+    buffer.length = storage->size();
+    buffer.owner = storage;
+    return buffer;
+}
+
+bool Buffer::fromFile(const string& path, Buffer& buffer) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Could not open file " << path << endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        cerr << "Error: Could not stat file " << path << endl;
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(st.st_size);
+    if (fileSize == 0) {
+        close(fd);
+        buffer = Buffer();
+        return true;
+    }
+
+    auto mapping = make_shared<Mapping>();
+    mapping->addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    mapping->length = fileSize;
+    close(fd);
+
+    if (mapping->addr != MAP_FAILED) {
+        buffer.ptr = static_cast<const uint8_t*>(mapping->addr);
+        buffer.length = fileSize;
+        buffer.owner = mapping;
+        return true;
+    }
+
+    // Not mappable (e.g. some special filesystems): read it instead
+    ifstream in(path, ios::binary);
+    vector<uint8_t> bytes(fileSize);
+    if (!in || !in.read(reinterpret_cast<char*>(bytes.data()), fileSize)) {
+        cerr << "Error: Could not read file " << path << endl;
+        return false;
+    }
+    buffer = fromBytes(move(bytes));
+    return true;
+}
+
+Buffer Buffer::view(size_t offset, size_t len) const {
+    Buffer sub;
+    if (offset > length) offset = length;
+    sub.ptr = ptr + offset;
+    sub.length = min(len, length - offset);
+    sub.owner = owner;
+    return sub;
+}
@@ -0,0 +1,56 @@
+#include "../../include/core/ExtractionContext.h"
+
+using namespace std;
+
+SpectralExtractor& ExtractionContext::spectral(int numBins) {
+    if (!spectralExtractor || spectralExtractor->getNumBins() != numBins) {
+        spectralExtractor = make_unique<SpectralExtractor>(numBins);
+    }
+    return *spectralExtractor;
+}
+
+MaxFreqExtractor& ExtractionContext::maxfreq(int numFrequencies, int peakSpacing) {
+    if (!maxfreqExtractor || maxfreqExtractor->getNumFrequencies() != numFrequencies ||
+        maxfreqExtractor->getPeakSpacing() != peakSpacing) {
+        maxfreqExtractor = make_unique<MaxFreqExtractor>(numFrequencies, peakSpacing);
+    }
+    return *maxfreqExtractor;
+}
+
+void ExtractionContext::extractText(WAVStream& stream, const string& method, int numFrequencies, int numBins,
+                                    int frameSize, int hopSize, string& text, int peakSpacing) {
+    text.clear();
+    if (method == "spectral") {
+        text = spectral(numBins).extractFeatures(stream, frameSize, hopSize);
+    } else if (method == "maxfreq") {
+        text = maxfreq(numFrequencies, peakSpacing).extractFeatures(stream, frameSize, hopSize);
+    }
+}
+
+void ExtractionContext::extractValues(WAVStream& stream, const string& method, int numFrequencies, int numBins,
+                                      int frameSize, int hopSize, vector<float>& values, int peakSpacing) {
+    values.clear();
+    if ((method != "spectral" && method != "maxfreq") || !stream.setFraming(frameSize, hopSize)) {
+        return;
+    }
+
+    const float* frame;
+    if (method == "spectral") {
+        SpectralExtractor& extractor = spectral(numBins);
+        values.reserve(stream.analysisFrames(frameSize, hopSize) * extractor.getNumBins());
+        while (stream.nextFrame(frame)) {
+            const vector<float>& bins = extractor.extractFrameValues(frame, frameSize);
+            values.insert(values.end(), bins.begin(), bins.end());
+        }
+    } else {
+        MaxFreqExtractor& extractor = maxfreq(numFrequencies, peakSpacing);
+        size_t dims = extractor.getNumFrequencies();
+        values.reserve(stream.analysisFrames(frameSize, hopSize) * dims);
+        while (stream.nextFrame(frame)) {
+            const vector<int>& peaks = extractor.extractFrameValues(frame, frameSize);
+            size_t start = values.size();
+            values.insert(values.end(), peaks.begin(), peaks.end());
+            values.resize(start + dims, 0.0f);
+        }
+    }
+}
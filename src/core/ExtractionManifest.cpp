@@ -0,0 +1,222 @@
+#include "../../include/core/ExtractionManifest.h"
+#include "../../include/core/Buffer.h"
+#include "../../include/core/OutputWriter.h"
+#include "../../include/utils/json.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+constexpr int MANIFEST_VERSION = 1;
+
+bool fileStamp(const string& file, uintmax_t& size, int64_t& mtime) {
+    error_code ec;
+    size = filesystem::file_size(file, ec);
+    if (ec) return false;
+    auto time = filesystem::last_write_time(file, ec);
+    if (ec) return false;
+    mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+string absolutePath(const string& file) {
+    error_code ec;
+    auto path = filesystem::absolute(file, ec);
+    return ec ? file : path.lexically_normal().string();
+}
+
+string fileName(const string& file) {
+    return filesystem::path(file).filename().string();
+}
+
+}
+
+ExtractionManifest::ExtractionManifest(const string& manifestFile, const string& params)
+    : path(manifestFile), params(params) {}
+
+string ExtractionManifest::defaultPath(const string& outFolder) {
+    return (filesystem::path(outFolder) / ".extraction_manifest.json").string();
+}
+
+string ExtractionManifest::describe(const string& method, int numFrequencies, int numBins, int frameSize,
+                                    int hopSize, int peakSpacing, bool useBinary, const string& encoding) {
+    ostringstream out;
+    out << "method=" << method;
+    if (method == "maxfreq") {
+        out << " frequencies=" << numFrequencies << " peakSpacing=" << peakSpacing;
+    } else {
+        out << " bins=" << numBins;
+    }
+    out << " frameSize=" << frameSize << " hopSize=" << hopSize;
+    out << " format=" << (useBinary ? "featbin:" + encoding : "text");
+    return out.str();
+}
+
+bool ExtractionManifest::hashFile(const string& file, string& hash) {
+    Buffer contents;
+    if (!Buffer::fromFile(file, contents)) {
+        return false;
+    }
+
+    // FNV-1a over 64-bit words (8x fewer multiplies than per byte), then the tail bytes
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const uint8_t* p = contents.data();
+    size_t n = contents.size();
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        h = (h ^ word) * prime;
+    }
+    for (; n > 0; p++, n--) {
+        h = (h ^ *p) * prime;
+    }
+    h = (h ^ contents.size()) * prime;
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    hash = hex;
+    return true;
+}
+
+bool ExtractionManifest::load() {
+    lock_guard<mutex> lock(mtx);
+    entries.clear();
+    dirty = false;
+
+    ifstream in(path);
+    if (!in) {
+        return true;  // No manifest yet
+    }
+
+    try {
+        json doc = json::parse(in);
+        if (doc.value("version", 0) != MANIFEST_VERSION) {
+            cerr << "Warning: Ignoring manifest with unknown version: " << path << endl;
+            return true;
+        }
+        for (auto& [output, value] : doc["entries"].items()) {
+            Entry e;
+            e.source = value.at("source").get<string>();
+            e.size = value.at("size").get<uintmax_t>();
+            e.mtime = value.at("mtime").get<int64_t>();
+            e.hash = value.at("hash").get<string>();
+            e.params = value.at("params").get<string>();
+            entries[output] = e;
+        }
+    } catch (const exception& e) {
+        cerr << "Warning: Could not parse manifest file " << path << ": " << e.what() << endl;
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ExtractionManifest::save() {
+    lock_guard<mutex> lock(mtx);
+    if (!dirty) {
+        return true;
+    }
+
+    json doc;
+    doc["version"] = MANIFEST_VERSION;
+    doc["entries"] = json::object();
+    for (const auto& [output, e] : entries) {
+        doc["entries"][output] = {{"source", e.source}, {"size", e.size}, {"mtime", e.mtime},
+                                  {"hash", e.hash}, {"params", e.params}};
+    }
+
+    string text = doc.dump(1);
+    if (!OutputWriter::writeFile(path, reinterpret_cast<const uint8_t*>(text.data()), text.size())) {
+        cerr << "Warning: Could not write manifest file " << path << endl;
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+bool ExtractionManifest::upToDate(const string& wavFile, const string& outputFile) {
+    error_code ec;
+    if (!filesystem::is_regular_file(outputFile, ec)) {
+        return false;
+    }
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    if (!fileStamp(wavFile, size, mtime)) {
+        return false;
+    }
+
+    Entry entry;
+    string name = fileName(outputFile);
+    {
+        lock_guard<mutex> lock(mtx);
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            return false;
+        }
+        entry = it->second;
+    }
+    if (entry.source != absolutePath(wavFile) || entry.params != params || entry.size != size) {
+        return false;
+    }
+    if (entry.mtime == mtime) {
+        return true;
+    }
+
+    // Same size but touched: only the contents decide
+    string hash;
+    if (!hashFile(wavFile, hash) || hash != entry.hash) {
+        return false;
+    }
+    lock_guard<mutex> lock(mtx);
+    entries[name].mtime = mtime;
+    dirty = true;
+    return true;
+}
+
+bool ExtractionManifest::record(const string& wavFile, const string& outputFile) {
+    Entry entry;
+    if (!fileStamp(wavFile, entry.size, entry.mtime) || !hashFile(wavFile, entry.hash)) {
+        return false;
+    }
+    entry.source = absolutePath(wavFile);
+    entry.params = params;
+
+    lock_guard<mutex> lock(mtx);
+    entries[fileName(outputFile)] = entry;
+    dirty = true;
+    return true;
+}
+
+vector<string> ExtractionManifest::removeOrphans(const string& outFolder) {
+    lock_guard<mutex> lock(mtx);
+    vector<string> removed;
+    for (auto it = entries.begin(); it != entries.end();) {
+        // Only what is known to be missing counts (an unreadable path is kept)
+        error_code outputError, sourceError;
+        filesystem::path output = filesystem::path(outFolder) / it->first;
+        bool outputExists = filesystem::exists(output, outputError);
+        bool sourceExists = filesystem::exists(it->second.source, sourceError);
+        if (!outputError && !outputExists) {
+            it = entries.erase(it);
+            dirty = true;
+        } else if (!sourceError && !sourceExists) {
+            error_code ec;
+            if (filesystem::remove(output, ec)) {
+                removed.push_back(it->first);
+            }
+            it = entries.erase(it);
+            dirty = true;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,189 @@
+#include "../../include/core/FFTPlan.h"
+#include <cmath>
+#include <map>
+#include <mutex>
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+mutex plansMutex;
+
+#ifdef HAVE_FFTW
+// The FFTW planner is not thread-safe (executing a plan is)
+mutex fftwPlannerMutex;
+#endif
+
+bool isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+complex<double> rootOfUnity(int k, int n) {
+    double theta = -2.0 * M_PI * k / n;
+    return complex<double>(cos(theta), sin(theta));
+}
+
+}
+
+FFTPlan::FFTPlan(int size) : FFTPlan(size, true) {}
+
+FFTPlan::FFTPlan(int size, bool withRealPath) : n(max(size, 0)), radix2(isPowerOfTwo(size)) {
+    if (radix2) {
+        // Bit-reversal permutation
+        bitReverse.resize(n);
+        int bits = 0;
+        while ((1 << bits) < n) bits++;
+        for (int i = 0; i < n; i++) {
+            int r = 0;
+            for (int b = 0; b < bits; b++) {
+                if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+            }
+            bitReverse[i] = r;
+        }
+
+        twiddles.resize(n / 2);
+        for (int k = 0; k < n / 2; k++) {
+            twiddles[k] = rootOfUnity(k, n);
+        }
+
+        if (withRealPath && n >= 2) {
+            splitTwiddles = twiddles;
+            half.reset(new FFTPlan(n / 2, false));
+        }
+    } else {
+        twiddles.resize(n);
+        for (int k = 0; k < n; k++) {
+            twiddles[k] = rootOfUnity(k, n);
+        }
+    }
+
+#ifdef HAVE_FFTW
+    if (withRealPath && n > 0) {
+        lock_guard<mutex> lock(fftwPlannerMutex);
+        double* in = fftw_alloc_real(n);
+        fftw_complex* out = fftw_alloc_complex(n / 2 + 1);
+        fftwPlan = fftw_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE | FFTW_UNALIGNED);
+        fftw_free(in);
+        fftw_free(out);
+    }
+#endif
+}
+
+FFTPlan::~FFTPlan() {
+#ifdef HAVE_FFTW
+    if (fftwPlan) {
+        lock_guard<mutex> lock(fftwPlannerMutex);
+        fftw_destroy_plan(static_cast<fftw_plan>(fftwPlan));
+    }
+#endif
+}
+
+void FFTPlan::radix2Forward(complex<double>* data) const {
+    for (int i = 0; i < n; i++) {
+        int j = bitReverse[i];
+        if (i < j) {
+            swap(data[i], data[j]);
+        }
+    }
+
+    // Butterflies; a stage of length len uses every (n/len)-th twiddle
+    for (int len = 2; len <= n; len <<= 1) {
+        int halfLen = len >> 1;
+        int stride = n / len;
+        for (int start = 0; start < n; start += len) {
+            for (int k = 0; k < halfLen; k++) {
+                complex<double> t = twiddles[k * stride] * data[start + k + halfLen];
+                complex<double> u = data[start + k];
+                data[start + k] = u + t;
+                data[start + k + halfLen] = u - t;
+            }
+        }
+    }
+}
+
+void FFTPlan::dftForward(complex<double>* data) const {
+    thread_local vector<complex<double>> result;
+    result.assign(n, complex<double>(0, 0));
+    for (int k = 0; k < n; k++) {
+        complex<double> sum(0, 0);
+        long idx = 0;
+        for (int j = 0; j < n; j++) {
+            sum += data[j] * twiddles[idx];
+            idx += k;
+            if (idx >= n) idx -= n;
+        }
+        result[k] = sum;
+    }
+    copy(result.begin(), result.end(), data);
+}
+
+void FFTPlan::forward(complex<double>* data) const {
+    if (radix2) {
+        radix2Forward(data);
+    } else {
+        dftForward(data);
+    }
+}
+
+void FFTPlan::forwardReal(const double* input, vector<complex<double>>& spectrum) const {
+    spectrum.resize(n / 2 + 1);
+    if (n == 0) {
+        return;
+    }
+
+#ifdef HAVE_FFTW
+    if (fftwPlan) {
+        fftw_execute_dft_r2c(static_cast<fftw_plan>(fftwPlan), const_cast<double*>(input),
+                             reinterpret_cast<fftw_complex*>(spectrum.data()));
+        return;
+    }
+#endif
+
+    if (!half) {
+        // Odd or tiny sizes: plain complex transform of the real input
+        thread_local vector<complex<double>> full;
+        full.resize(n);
+        for (int i = 0; i < n; i++) {
+            full[i] = complex<double>(input[i], 0);
+        }
+        forward(full.data());
+        copy(full.begin(), full.begin() + spectrum.size(), spectrum.begin());
+        return;
+    }
+
+    // Pack x[2k] + i*x[2k+1] and transform at half size, in place in the output buffer
+    const int m = n / 2;
+    complex<double>* z = spectrum.data();
+    for (int k = 0; k < m; k++) {
+        z[k] = complex<double>(input[2 * k], input[2 * k + 1]);
+    }
+    half->forward(z);
+
+    // Split: X[k] = E[k] + W^k O[k], with E and O the spectra of the even and odd samples.
+    // Bins k and m-k depend on the same pair of values, so both are updated together.
+    complex<double> z0 = z[0];
+    z[0] = complex<double>(z0.real() + z0.imag(), 0);
+    z[m] = complex<double>(z0.real() - z0.imag(), 0);
+    for (int k = 1; k <= m / 2; k++) {
+        complex<double> a = z[k];
+        complex<double> b = conj(z[m - k]);
+        complex<double> even = 0.5 * (a + b);
+        complex<double> odd = complex<double>(0, -0.5) * (a - b);
+        z[k] = even + splitTwiddles[k] * odd;
+        // Bin m-k: E and O swap to their conjugates, and W^(m-k) = -conj(W^k)
+        z[m - k] = conj(even) - conj(splitTwiddles[k]) * conj(odd);
+    }
+}
+
+shared_ptr<const FFTPlan> FFTPlan::forSize(int size) {
+    static map<int, shared_ptr<const FFTPlan>> plans;
+    lock_guard<mutex> lock(plansMutex);
+    auto& plan = plans[size];
+    if (!plan) {
+        plan = make_shared<FFTPlan>(size);
+    }
+    return plan;
+}
@@ -0,0 +1,273 @@
+#include "../../include/core/FeatureDatabase.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Layout (little-endian):
+//   header (64 bytes): magic "FEATDB\0\0", version, flags (bit 0: .featbin entries,
+//                      bit 1: track segments),
+//                      entry count (uint64), index offset (uint64), index size (uint64),
+//                      number of compressor keys
+//   entries:           file contents, each starting at a 64-byte aligned offset
+//   index:             compressor keys (uint16 length + bytes), then per entry the name
+//                      (uint16 length + bytes), offset, length (uint64) and one int64
+//                      compressed size per key (0 if unknown)
+const char magic[8] = {'F', 'E', 'A', 'T', 'D', 'B', '\0', '\0'};
+const uint32_t version = 1;
+const size_t headerSize = 64;
+const size_t alignment = 64;
+
+void put16(vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+void put64(vector<uint8_t>& out, uint64_t v) {
+    size_t start = out.size();
+    out.resize(start + 8);
+    put64(out.data() + start, v);
+}
+
+void putString(vector<uint8_t>& out, const string& s) {
+    put16(out, static_cast<uint16_t>(s.size()));
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+uint32_t get32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+uint64_t get64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+/**
+ * @brief Bounds-checked reader over the index
+ */
+struct IndexReader {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    bool has(size_t n) const { return static_cast<size_t>(end - p) >= n; }
+
+    bool u64(uint64_t& v) {
+        if (!has(8)) return false;
+        v = get64(p);
+        p += 8;
+        return true;
+    }
+
+    bool str(string& s) {
+        if (!has(2)) return false;
+        size_t n = p[0] | (p[1] << 8);
+        p += 2;
+        if (!has(n)) return false;
+        s.assign(reinterpret_cast<const char*>(p), n);
+        p += n;
+        return true;
+    }
+};
+
+}
+
+bool FeatureDatabase::isPacked(const string& path) {
+    ifstream in(path, ios::binary);
+    char head[sizeof(magic)];
+    return in.read(head, sizeof(head)) && memcmp(head, magic, sizeof(magic)) == 0;
+}
+
+bool FeatureDatabase::Writer::open(const string& file, bool binary, const vector<string>& sizeKeys,
+                                   bool segmented) {
+    path = file;
+    binaryEntries = binary;
+    segmentedEntries = segmented;
+    keys = sizeKeys;
+    entries.clear();
+    tempPath = path + ".tmp";
+    out.open(tempPath, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "Error: Could not open output file: " << tempPath << endl;
+        return false;
+    }
+
+    // Entries first; the header is rewritten once the index position is known
+    uint8_t head[headerSize] = {};
+    out.write(reinterpret_cast<const char*>(head), sizeof(head));
+    position = headerSize;
+    return out.good();
+}
+
+bool FeatureDatabase::Writer::add(const string& name, const uint8_t* data, size_t size, const vector<long>& sizes) {
+    entries.push_back(Entry{name, position, size, sizes});
+    out.write(reinterpret_cast<const char*>(data), size);
+    position += size;
+    const char padding[alignment] = {};
+    size_t pad = (alignment - position % alignment) % alignment;
+    out.write(padding, pad);
+    position += pad;
+    return out.good();
+}
+
+bool FeatureDatabase::Writer::finish() {
+    stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+    vector<uint8_t> index;
+    for (const auto& key : keys) {
+        putString(index, key);
+    }
+    for (const auto& entry : entries) {
+        putString(index, entry.name);
+        put64(index, entry.offset);
+        put64(index, entry.length);
+        for (size_t k = 0; k < keys.size(); k++) {
+            long size = k < entry.sizes.size() ? entry.sizes[k] : 0;
+            put64(index, static_cast<uint64_t>(max(0L, size)));
+        }
+    }
+    out.write(reinterpret_cast<const char*>(index.data()), index.size());
+
+    uint8_t head[headerSize] = {};
+    memcpy(head, magic, sizeof(magic));
+    put32(head + 8, version);
+    put32(head + 12, (binaryEntries ? 1 : 0) | (segmentedEntries ? 2 : 0));
+    put64(head + 16, entries.size());
+    put64(head + 24, position);
+    put64(head + 32, index.size());
+    put32(head + 40, static_cast<uint32_t>(keys.size()));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(head), sizeof(head));
+
+    out.close();
+    if (!out) {
+        cerr << "Error: Could not write output file: " << tempPath << endl;
+        remove(tempPath.c_str());
+        return false;
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        cerr << "Error: Could not rename " << tempPath << " to " << path << endl;
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FeatureDatabase::write(const string& path, const vector<string>& names, const vector<Buffer>& files,
+                            bool binary, const vector<string>& sizeKeys, const vector<vector<long>>& sizes,
+                            bool segmented) {
+    Writer writer;
+    if (!writer.open(path, binary, sizeKeys, segmented)) {
+        return false;
+    }
+    vector<long> entrySizes(sizeKeys.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        for (size_t k = 0; k < sizeKeys.size(); k++) {
+            entrySizes[k] = i < sizes[k].size() ? sizes[k][i] : 0;
+        }
+        if (!writer.add(names[i], files[i].data(), files[i].size(), entrySizes)) {
+            cerr << "Error: Could not write output file: " << path << endl;
+            return false;
+        }
+    }
+    return writer.finish();
+}
+
+string FeatureDatabase::segmentName(const string& track, uint64_t startFrame) {
+    // Zero-padded so a track's segments sort in order
+    char start[24];
+    snprintf(start, sizeof(start), "%08llu", static_cast<unsigned long long>(startFrame));
+    return track + "@" + start;
+}
+
+string FeatureDatabase::trackOf(const string& segmentName) {
+    size_t at = segmentName.rfind('@');
+    return at == string::npos ? segmentName : segmentName.substr(0, at);
+}
+
+bool FeatureDatabase::open(const string& path, FeatureDatabase& db) {
+    db = FeatureDatabase();
+    if (!Buffer::fromFile(path, db.mapping)) {
+        return false;
+    }
+
+    const uint8_t* head = db.mapping.data();
+    if (db.mapping.size() < headerSize || memcmp(head, magic, sizeof(magic)) != 0) {
+        cerr << "Error: Not a packed feature database: " << path << endl;
+        return false;
+    }
+    if (get32(head + 8) != version) {
+        cerr << "Error: Unsupported packed database version " << get32(head + 8) << ": " << path << endl;
+        return false;
+    }
+    db.binaryEntries = (get32(head + 12) & 1) != 0;
+    db.segmentedEntries = (get32(head + 12) & 2) != 0;
+    uint64_t count = get64(head + 16);
+    uint64_t indexOffset = get64(head + 24);
+    uint64_t indexSize = get64(head + 32);
+    uint32_t keyCount = get32(head + 40);
+    if (indexOffset > db.mapping.size() || indexSize > db.mapping.size() - indexOffset) {
+        cerr << "Error: Packed database is truncated: " << path << endl;
+        return false;
+    }
+
+    IndexReader reader{head + indexOffset, head + indexOffset + indexSize};
+    bool ok = true;
+    db.sizeKeys.resize(keyCount);
+    for (uint32_t k = 0; k < keyCount && ok; k++) {
+        ok = reader.str(db.sizeKeys[k]);
+    }
+    // Every entry takes at least 18 index bytes, which bounds the count before reserving
+    ok = ok && count <= indexSize / 18;
+    if (ok) {
+        db.names.reserve(count);
+        db.files.reserve(count);
+        db.sizes.assign(keyCount, vector<long>());
+        for (auto& column : db.sizes) column.reserve(count);
+    }
+    for (uint64_t i = 0; i < count && ok; i++) {
+        string name;
+        uint64_t offset = 0, length = 0;
+        ok = reader.str(name) && reader.u64(offset) && reader.u64(length) &&
+             offset <= indexOffset && length <= indexOffset - offset;
+        for (uint32_t k = 0; k < keyCount && ok; k++) {
+            uint64_t size = 0;
+            ok = reader.u64(size);
+            db.sizes[k].push_back(static_cast<long>(size));
+        }
+        if (ok) {
+            db.names.push_back(move(name));
+            db.files.push_back(db.mapping.view(offset, length));
+        }
+    }
+    if (!ok) {
+        cerr << "Error: Corrupt packed database index: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+const vector<long>* FeatureDatabase::compressedSizes(const string& key) const {
+    auto it = find(sizeKeys.begin(), sizeKeys.end(), key);
+    if (it == sizeKeys.end()) return nullptr;
+    const vector<long>& column = sizes[it - sizeKeys.begin()];
+    // Sizes of 0 were not computed at build time
+    if (find(column.begin(), column.end(), 0L) != column.end()) return nullptr;
+    return &column;
+}
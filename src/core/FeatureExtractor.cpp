@@ -1,13 +1,16 @@
 #include "../../include/core/FeatureExtractor.h"
-#include "../../include/core/SpectralExtractor.h"
-#include "../../include/core/MaxFreqExtractor.h"
-#include "../../include/core/WAVReader.h"
+#include "../../include/core/ExtractionContext.h"
+#include "../../include/core/WAVStream.h"
+#include "../../include/core/BoundedQueue.h"
+#include "../../include/core/Logger.h"
+#include "../../include/core/ThreadPool.h"
 
 #include <iostream>
-#include <fstream>
 #include <filesystem>
 #include <chrono>
 #include <iomanip>
+#include <memory>
+#include <sstream>
 
 namespace FeatureExtractor {
 
@@ -18,55 +21,155 @@ void saveConfig(
     int numBins,
     int frameSize, 
     int hopSize, 
-    int filesProcessed
+    int filesProcessed,
+    int peakSpacing
 ) {
     // Get current time
     auto now = chrono::system_clock::to_time_t(chrono::system_clock::now());
     
     // Create config summary in text format for easy reading
-    ofstream txtConfig(outFolder + "/extraction_config.txt");
-    if (txtConfig) {
-        txtConfig << "Feature Extraction Configuration" << endl;
-        txtConfig << "===============================" << endl;
-        txtConfig << "Date: " << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S") << endl;
-        txtConfig << "Method: " << method << endl;
-        txtConfig << "Format: text" << endl;
-        txtConfig << "Frame size: " << frameSize << " samples" << endl;
-        txtConfig << "Hop size: " << hopSize << " samples" << endl;
-        
-        if (method == "maxfreq") {
-            txtConfig << "Frequencies per frame: " << numFrequencies << endl;
-        } else {
-            txtConfig << "Frequency bins: " << numBins << endl;
+    ostringstream txtConfig;
+    txtConfig << "Feature Extraction Configuration" << endl;
+    txtConfig << "===============================" << endl;
+    txtConfig << "Date: " << put_time(localtime(&now), "%Y-%m-%d %H:%M:%S") << endl;
+    txtConfig << "Method: " << method << endl;
+    txtConfig << "Format: text" << endl;
+    txtConfig << "Frame size: " << frameSize << " samples" << endl;
+    txtConfig << "Hop size: " << hopSize << " samples" << endl;
+    
+    if (method == "maxfreq") {
+        txtConfig << "Frequencies per frame: " << numFrequencies << endl;
+        if (peakSpacing > 0) {
+            txtConfig << "Peak spacing: " << peakSpacing << " bins" << endl;
         }
-        
-        txtConfig << "Files processed: " << filesProcessed << endl;
-        txtConfig.close();
-        
+    } else {
+        txtConfig << "Frequency bins: " << numBins << endl;
+    }
+    
+    txtConfig << "Files processed: " << filesProcessed << endl;
+    string text = txtConfig.str();
+    if (OutputWriter::writeFile(outFolder + "/extraction_config.txt",
+                                reinterpret_cast<const uint8_t*>(text.data()), text.size())) {
         cout << "Configuration saved to " << outFolder << "/extraction_config.txt" << endl;
     }
 }
 
 bool saveFeaturesText(const string& outFile, const string& featData) {
-    ofstream out(outFile + ".feat");
-    if (!out) {
-        cerr << "  Error: Could not open output file: " << outFile << ".feat" << endl;
-        return false;
+    return OutputWriter::writeFile(outFile + ".feat", reinterpret_cast<const uint8_t*>(featData.data()),
+                                   featData.size());
+}
+
+bool saveFeaturesBinary(const string& outFile, const vector<float>& featData,
+                        const FeatureFile::Info& info) {
+    vector<uint8_t> bytes;
+    FeatureFile::serialize(featData, info, bytes);
+    return OutputWriter::writeFile(outFile + ".featbin", bytes.data(), bytes.size());
+}
+
+namespace {
+
+/**
+ * @brief WAV file opened by the I/O stage, waiting for a compute worker
+ */
+struct OpenedFile {
+    string wavFile;
+    unique_ptr<WAVStream> stream;
+};
+
+/**
+ * @brief Features of one extracted file
+ */
+struct ExtractedFile {
+    string wavFile;
+    string outFile;             // Output path without extension
+    string text;
+    vector<float> values;       // Binary features, row-major
+    FeatureFile::Info info;
+    long long extractMillis = 0;
+};
+
+/**
+ * @brief Decode a stream and extract its features (text or binary frames)
+ * @return false on a read error
+ */
+bool extractStream(ExtractionContext& context, WAVStream& stream, const string& method, int numFrequencies,
+                   int numBins, int frameSize, int hopSize, bool useBinary, FeatureFile::Encoding encoding,
+                   int peakSpacing, ExtractedFile& result) {
+    auto extractStart = chrono::high_resolution_clock::now();
+    if (useBinary) {
+        context.extractValues(stream, method, numFrequencies, numBins, frameSize, hopSize, result.values, peakSpacing);
+    } else {
+        context.extractText(stream, method, numFrequencies, numBins, frameSize, hopSize, result.text, peakSpacing);
     }
-    
-    out << featData;
-    out.close();
-    return true;
+    auto extractEnd = chrono::high_resolution_clock::now();
+    result.extractMillis = chrono::duration_cast<chrono::milliseconds>(extractEnd - extractStart).count();
+
+    if (useBinary) {
+        result.info.method = method;
+        result.info.dims = static_cast<uint32_t>(method == "maxfreq" ? numFrequencies : numBins);
+        result.info.encoding = encoding;
+        result.info.scale = FeatureFile::defaultScale(method, encoding, frameSize);
+        result.info.frameSize = static_cast<uint32_t>(frameSize);
+        result.info.hopSize = static_cast<uint32_t>(hopSize);
+        result.info.sampleRate = static_cast<uint32_t>(stream.getSampleRate());
+    }
+    return !stream.failed();
+}
+
+string outputBase(const string& wavFile, const string& outFolder, const string& method) {
+    string base = filesystem::path(wavFile).stem().string();
+    return outFolder + "/" + base + "_" + method;
+}
+
+bool saveExtracted(const ExtractedFile& result, bool useBinary) {
+    return useBinary ? saveFeaturesBinary(result.outFile, result.values, result.info)
+                     : saveFeaturesText(result.outFile, result.text);
+}
+
+/**
+ * @brief Context shared by the single-file calls made from one thread
+ */
+ExtractionContext& threadContext() {
+    thread_local ExtractionContext context;
+    return context;
 }
 
-bool saveFeaturesBinary(const string& outFile, const vector<float>& featData) {
-    ofstream out(outFile + ".featbin", ios::binary);
-    if (!out) {
-        cerr << "  Error: Could not open output file: " << outFile << ".featbin" << endl;
+/**
+ * @brief Whole output file of an extracted file, ready for an OutputWriter
+ */
+Buffer serializeExtracted(ExtractedFile& result, bool useBinary) {
+    if (!useBinary) {
+        return Buffer::fromString(move(result.text));
+    }
+    vector<uint8_t> bytes;
+    FeatureFile::serialize(result.values, result.info, bytes);
+    return Buffer::fromBytes(move(bytes));
+}
+
+}
+
+string outputFile(const string& wavFile, const string& outFolder, const string& method, bool useBinary) {
+    return outputBase(wavFile, outFolder, method) + (useBinary ? ".featbin" : ".feat");
+}
+
+bool extractFeatureFile(
+    WAVStream& stream,
+    const string& method,
+    int numFrequencies,
+    int numBins,
+    int frameSize,
+    int hopSize,
+    bool useBinary,
+    FeatureFile::Encoding encoding,
+    int peakSpacing,
+    Buffer& file
+) {
+    ExtractedFile result;
+    if (!extractStream(threadContext(), stream, method, numFrequencies, numBins, frameSize, hopSize, useBinary, encoding,
+                       peakSpacing, result)) {
         return false;
     }
-    out.write(reinterpret_cast<const char*>(featData.data()), featData.size() * sizeof(float));
-    out.close();
+    file = serializeExtracted(result, useBinary);
     return true;
 }
 
@@ -81,92 +184,140 @@ bool extractFeaturesFromFile(
     mutex& coutMutex,
     atomic<int>& filesProcessed,
     atomic<int>& filesSkipped,
-    bool useBinary
+    bool useBinary,
+    FeatureFile::Encoding encoding,
+    int peakSpacing
 ) {
-    WAVReader reader;
-    SpectralExtractor specExt(numBins);
-    MaxFreqExtractor mfExt(numFrequencies);
+    WAVStream stream;
     
     {
         lock_guard<mutex> lock(coutMutex);
         cout << "Processing: " << wavFile << endl;
     }
     
-    if (!reader.load(wavFile)) {
+    if (!stream.open(wavFile)) {
         lock_guard<mutex> lock(coutMutex);
         cout << "  Skipping due to load error" << endl;
         filesSkipped++;
         return false;
     }
     
-    auto samples = reader.samples();
-    int channels = reader.getChannels();
-    int sampleRate = reader.getSampleRate();
-    
-    // Convert to int16_t for feature extraction
-    vector<int16_t> samples16bit(samples.size());
-    for (size_t j = 0; j < samples.size(); j++) {
-        samples16bit[j] = static_cast<int16_t>(samples[j]);
-    }
-    
-    // Extract features
-    string featData;
-    std::vector<std::vector<float>> featDataBin; // changed from vector<float>
-    auto extractStart = chrono::high_resolution_clock::now();
-    
-    if (method == "spectral") {
-        if (useBinary) {
-            featDataBin = specExt.extractFeaturesBinary(samples16bit, channels, frameSize, hopSize, sampleRate);
-        } else {
-            featData = specExt.extractFeatures(samples16bit, channels, frameSize, hopSize, sampleRate);
-        }
-    } else if (method == "maxfreq") {
-        if (useBinary) {
-            featDataBin = mfExt.extractFeaturesBinary(samples16bit, channels, frameSize, hopSize, sampleRate);
-        } else {
-            featData = mfExt.extractFeatures(samples16bit, channels, frameSize, hopSize, sampleRate);
-        }
+    // Extract features, decoding the audio frame by frame; calls from the same thread
+    // (e.g. one query after another) share the extractors and their buffers
+    ExtractionContext& context = threadContext();
+    ExtractedFile result;
+    result.wavFile = wavFile;
+    result.outFile = outputBase(wavFile, outFolder, method);
+    if (!extractStream(context, stream, method, numFrequencies, numBins, frameSize, hopSize, useBinary, encoding, peakSpacing, result)) {
+        lock_guard<mutex> lock(coutMutex);
+        cout << "  Skipping due to read error" << endl;
+        filesSkipped++;
+        return false;
     }
     
-    auto extractEnd = chrono::high_resolution_clock::now();
-    auto extractTime = chrono::duration_cast<chrono::milliseconds>(extractEnd - extractStart).count();
-    
     {
         lock_guard<mutex> lock(coutMutex);
-        cout << "  Feature extraction took " << extractTime << " ms" << endl;
+        cout << "  Feature extraction took " << result.extractMillis << " ms" << endl;
     }
     
     // Save to output
-    string base = filesystem::path(wavFile).stem().string();
-    string outFile = outFolder + "/" + base + "_" + method;
-    
-    bool saveSuccess = false;
-    if (useBinary) {
-        // Flatten 2D feature vector to 1D for binary saving
-        std::vector<float> flatFeatDataBin;
-        for (const auto& frame : featDataBin) {
-            flatFeatDataBin.insert(flatFeatDataBin.end(), frame.begin(), frame.end());
-        }
-        saveSuccess = saveFeaturesBinary(outFile, flatFeatDataBin);
-    } else {
-        saveSuccess = saveFeaturesText(outFile, featData);
-    }
-    if (!saveSuccess) {
+    if (!saveExtracted(result, useBinary)) {
         filesSkipped++;
         return false;
     }
     
     {
         lock_guard<mutex> lock(coutMutex);
-        if (useBinary) {
-            cout << "  Extracted features to " << outFile << ".featbin" << endl;
-        } else {
-            cout << "  Extracted features to " << outFile << ".feat" << endl;
-        }
+        cout << "  Extracted features to " << result.outFile << (useBinary ? ".featbin" : ".feat") << endl;
     }
     
     filesProcessed++;
     return true;
 }
 
-}
\ No newline at end of file
+void extractFeaturesFromFiles(
+    const vector<string>& wavFiles,
+    const string& outFolder,
+    const string& method,
+    int numFrequencies,
+    int numBins,
+    int frameSize,
+    int hopSize,
+    bool useBinary,
+    FeatureFile::Encoding encoding,
+    unsigned int threadCount,
+    atomic<int>& filesProcessed,
+    atomic<int>& filesSkipped,
+    int peakSpacing,
+    OutputWriter* output,
+    ExtractionManifest* manifest
+) {
+    Logger logger;
+    unique_ptr<OutputWriter> ownWriter;
+    if (!output) {
+        ownWriter = make_unique<OutputWriter>();
+        output = ownWriter.get();
+    }
+    OutputWriter& writer = *output;
+    ThreadPool readers(min<unsigned int>(2, ThreadPool::threadCountFor(threadCount, wavFiles.size())));
+    ThreadPool workers(ThreadPool::threadCountFor(threadCount, wavFiles.size()));
+
+    // Opened streams waiting for a worker (the writer has its own queue); a full queue
+    // holds back the stage that feeds it
+    BoundedQueue<OpenedFile> openedFiles(2 * workers.size());
+    string extension = useBinary ? ".featbin" : ".feat";
+
+    // Compute: decode, extract and serialize, one file per worker at a time; the writer
+    // saves the results in completion order
+    for (unsigned int w = 0; w < workers.size(); w++) {
+        workers.submit([&](unsigned int) {
+            ExtractionContext context;
+            OpenedFile opened;
+            while (openedFiles.pop(opened)) {
+                ExtractedFile result;
+                result.wavFile = opened.wavFile;
+                result.outFile = outputBase(result.wavFile, outFolder, method);
+                if (!extractStream(context, *opened.stream, method, numFrequencies, numBins, frameSize, hopSize,
+                                   useBinary, encoding, peakSpacing, result)) {
+                    logger.log("Skipping " + result.wavFile + " due to read error\n");
+                    filesSkipped++;
+                    continue;
+                }
+                opened.stream.reset();
+                logger.log("Extracted " + result.wavFile + " in " + to_string(result.extractMillis) + " ms\n");
+                string outPath = result.outFile + extension;
+                string wavFile = result.wavFile;
+                writer.write(outPath, serializeExtracted(result, useBinary), [&, outPath, wavFile](bool ok) {
+                    if (ok && manifest) {
+                        manifest->record(wavFile, outPath);
+                    }
+                    if (ok) {
+                        logger.log("  Extracted features to " + outPath + "\n");
+                        filesProcessed++;
+                    } else {
+                        filesSkipped++;
+                    }
+                });
+            }
+        });
+    }
+
+    // I/O: open the files in order, parse their headers and start reading ahead
+    readers.parallelFor(wavFiles.size(), [&](size_t i, unsigned int) {
+        auto stream = make_unique<WAVStream>();
+        if (!stream->open(wavFiles[i], false)) {
+            logger.log("Processing: " + wavFiles[i] + "\n  Skipping due to load error\n");
+            filesSkipped++;
+            return;
+        }
+        stream->prefetch();
+        logger.log("Processing: " + wavFiles[i] + "\n" + stream->describe());
+        openedFiles.push(OpenedFile{wavFiles[i], move(stream)});
+    });
+
+    openedFiles.close();
+    workers.wait();
+    writer.flush();
+}
+
+}
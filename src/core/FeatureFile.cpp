@@ -0,0 +1,459 @@
+#include "../../include/core/FeatureFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Header layout (little-endian):
+//   0  magic "FEATBIN\0"     8  version            12 data offset
+//   16 method (16 bytes, NUL padded)
+//   32 frames (uint64)       40 dims               44 encoding
+//   48 scale (float32)       52 frame size         56 hop size      60 sample rate
+const char magic[8] = {'F', 'E', 'A', 'T', 'B', 'I', 'N', '\0'};
+const size_t methodLength = 16;
+
+void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+uint32_t get32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return v;
+}
+
+uint64_t get64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+uint32_t floatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits) {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief trunc(value * scale) clamped to [0, maxCode]
+ */
+uint32_t quantize(float value, float scale, uint32_t maxCode) {
+    float scaled = value * scale;
+    if (!(scaled > 0.0f)) return 0;
+    if (scaled >= static_cast<float>(maxCode)) return maxCode;
+    return static_cast<uint32_t>(scaled);
+}
+
+}
+
+bool FeatureFile::parseEncoding(const string& name, Encoding& encoding) {
+    if (name == "float32") {
+        encoding = Encoding::Float32;
+    } else if (name == "uint16") {
+        encoding = Encoding::UInt16;
+    } else if (name == "uint8") {
+        encoding = Encoding::UInt8;
+    } else if (name == "delta8") {
+        encoding = Encoding::Delta8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* FeatureFile::encodingName(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::UInt16: return "uint16";
+        case Encoding::UInt8: return "uint8";
+        case Encoding::Delta8: return "delta8";
+        default: return "float32";
+    }
+}
+
+size_t FeatureFile::valueSize(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::UInt16: return 2;
+        case Encoding::UInt8:
+        case Encoding::Delta8: return 1;
+        default: return 4;
+    }
+}
+
+float FeatureFile::defaultScale(const string& method, Encoding encoding, int frameSize) {
+    if (encoding == Encoding::Float32) return 1.0f;
+    if (method == "spectral") {
+        return encoding == Encoding::UInt16 ? 10000.0f : 255.0f;
+    }
+    // maxfreq: bin indices go up to frameSize / 2
+    int maxIndex = max(1, frameSize / 2);
+    if (encoding != Encoding::UInt16 && maxIndex > 255) {
+        return 255.0f / static_cast<float>(maxIndex);
+    }
+    return 1.0f;
+}
+
+void FeatureFile::encodeFrame(const vector<float>& frame, const Info& info, vector<uint8_t>& out) {
+    encodeFrame(frame.data(), frame.size(), info, out);
+}
+
+void FeatureFile::encodeFrame(const float* frame, size_t count, const Info& info, vector<uint8_t>& out) {
+    size_t n = min(count, static_cast<size_t>(info.dims));
+    size_t start = out.size();
+    out.resize(start + info.dims * valueSize(info.encoding), 0);
+    uint8_t* p = out.data() + start;
+
+    switch (info.encoding) {
+        case Encoding::Float32:
+            for (size_t i = 0; i < n; i++, p += 4) put32(p, floatBits(frame[i]));
+            break;
+        case Encoding::UInt16:
+            for (size_t i = 0; i < n; i++, p += 2) {
+                uint32_t code = quantize(frame[i], info.scale, 65535);
+                p[0] = static_cast<uint8_t>(code);
+                p[1] = static_cast<uint8_t>(code >> 8);
+            }
+            break;
+        case Encoding::UInt8:
+        case Encoding::Delta8:
+            for (size_t i = 0; i < n; i++) p[i] = static_cast<uint8_t>(quantize(frame[i], info.scale, 255));
+            break;
+    }
+}
+
+void FeatureFile::deltaEncode(uint8_t* rows, size_t frames, size_t dims) {
+    for (size_t f = frames; f-- > 1;) {
+        uint8_t* row = rows + f * dims;
+        const uint8_t* previous = row - dims;
+        for (size_t d = 0; d < dims; d++) row[d] = static_cast<uint8_t>(row[d] - previous[d]);
+    }
+}
+
+namespace {
+
+/**
+ * @brief Fill the 64-byte header of a version 2 file
+ */
+void encodeHeader(uint8_t* head, uint64_t frames, const FeatureFile::Info& info) {
+    memset(head, 0, FeatureFile::headerSize);
+    memcpy(head, magic, sizeof(magic));
+    put32(head + 8, 2);
+    put32(head + 12, static_cast<uint32_t>(FeatureFile::headerSize));
+    memcpy(head + 16, info.method.data(), min(info.method.size(), methodLength - 1));
+    put64(head + 32, frames);
+    put32(head + 40, info.dims);
+    put32(head + 44, static_cast<uint32_t>(info.encoding));
+    put32(head + 48, floatBits(info.scale));
+    put32(head + 52, info.frameSize);
+    put32(head + 56, info.hopSize);
+    put32(head + 60, info.sampleRate);
+}
+
+bool writeFile(const string& path, const vector<uint8_t>& bytes) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "  Error: Could not open output file: " << path << endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    out.close();
+    if (!out) {
+        cerr << "  Error: Could not write output file: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+void FeatureFile::serialize(const vector<vector<float>>& frames, const Info& info, vector<uint8_t>& out) {
+    // Header and payload go into one buffer, allocated once
+    out.clear();
+    out.reserve(headerSize + frames.size() * info.dims * valueSize(info.encoding));
+    out.resize(headerSize);
+    encodeHeader(out.data(), frames.size(), info);
+    for (const auto& frame : frames) {
+        encodeFrame(frame, info, out);
+    }
+    if (info.encoding == Encoding::Delta8) {
+        deltaEncode(out.data() + headerSize, frames.size(), info.dims);
+    }
+}
+
+void FeatureFile::serialize(const vector<float>& values, const Info& info, vector<uint8_t>& out) {
+    size_t frames = info.dims ? values.size() / info.dims : 0;
+    out.clear();
+    out.reserve(headerSize + frames * info.dims * valueSize(info.encoding));
+    out.resize(headerSize);
+    encodeHeader(out.data(), frames, info);
+    for (size_t f = 0; f < frames; f++) {
+        encodeFrame(values.data() + f * info.dims, info.dims, info, out);
+    }
+    if (info.encoding == Encoding::Delta8) {
+        deltaEncode(out.data() + headerSize, frames, info.dims);
+    }
+}
+
+bool FeatureFile::write(const string& path, const vector<vector<float>>& frames, const Info& info) {
+    vector<uint8_t> bytes;
+    serialize(frames, info, bytes);
+    return writeFile(path, bytes);
+}
+
+bool FeatureFile::write(const string& path, const vector<float>& values, const Info& info) {
+    vector<uint8_t> bytes;
+    serialize(values, info, bytes);
+    return writeFile(path, bytes);
+}
+
+bool FeatureFile::parse(const Buffer& file, const string& path, Info& info, Buffer& payload) {
+    info = Info();
+    if (file.size() < headerSize || memcmp(file.data(), magic, sizeof(magic)) != 0) {
+        // Version 1: raw float32 values
+        info.version = 1;
+        payload = file;
+        return true;
+    }
+
+    const uint8_t* head = file.data();
+    info.version = static_cast<int>(get32(head + 8));
+    uint32_t dataOffset = get32(head + 12);
+    if (info.version != 2) {
+        cerr << "Error: Unsupported feature file version " << info.version << ": " << path << endl;
+        return false;
+    }
+
+    const char* method = reinterpret_cast<const char*>(head + 16);
+    info.method.assign(method, strnlen(method, methodLength));
+    info.frames = get64(head + 32);
+    info.dims = get32(head + 40);
+    uint32_t encoding = get32(head + 44);
+    info.scale = bitsFloat(get32(head + 48));
+    info.frameSize = get32(head + 52);
+    info.hopSize = get32(head + 56);
+    info.sampleRate = get32(head + 60);
+
+    if (encoding > static_cast<uint32_t>(Encoding::Delta8) || dataOffset < headerSize || dataOffset % 64 != 0) {
+        cerr << "Error: Corrupt feature file header: " << path << endl;
+        return false;
+    }
+    info.encoding = static_cast<Encoding>(encoding);
+
+    size_t available = file.size() - min(file.size(), static_cast<size_t>(dataOffset));
+    size_t rowBytes = info.dims * valueSize(info.encoding);
+    if (rowBytes != 0 && info.frames > available / rowBytes) {
+        cerr << "Error: Feature file is truncated: " << path << endl;
+        return false;
+    }
+    payload = file.view(dataOffset, info.frames * rowBytes);
+    return true;
+}
+
+bool FeatureFile::load(const string& path, FeatureFile& file) {
+    Buffer contents;
+    if (!Buffer::fromFile(path, contents)) {
+        return false;
+    }
+    return parse(contents, path, file.header, file.data);
+}
+
+bool FeatureFile::load(const Buffer& contents, const string& name, FeatureFile& file) {
+    return parse(contents, name, file.header, file.data);
+}
+
+bool FeatureFile::loadContent(const string& path, Buffer& content) {
+    Buffer contents;
+    if (!Buffer::fromFile(path, contents)) {
+        return false;
+    }
+    return contentOf(contents, path, content);
+}
+
+bool FeatureFile::contentOf(const Buffer& file, const string& name, Buffer& content) {
+    Info info;
+    return parse(file, name, info, content);
+}
+
+float FeatureFile::value(size_t frame, size_t dim) const {
+    if (header.version != 2 || frame >= header.frames || dim >= header.dims) return 0.0f;
+    size_t index = frame * header.dims + dim;
+    const uint8_t* p = data.data() + index * valueSize(header.encoding);
+    switch (header.encoding) {
+        case Encoding::UInt16: return static_cast<float>(p[0] | (p[1] << 8)) / header.scale;
+        case Encoding::UInt8: return static_cast<float>(p[0]) / header.scale;
+        case Encoding::Delta8: {
+            uint8_t code = 0;
+            for (size_t f = 0; f <= frame; f++) code = static_cast<uint8_t>(code + data.data()[f * header.dims + dim]);
+            return static_cast<float>(code) / header.scale;
+        }
+        default: return bitsFloat(get32(p));
+    }
+}
+
+void FeatureFile::decode(vector<float>& values) const {
+    values.clear();
+    if (header.version != 2) return;
+    size_t dims = header.dims;
+    values.resize(header.frames * dims);
+    const uint8_t* p = data.data();
+    switch (header.encoding) {
+        case Encoding::Float32:
+            for (size_t i = 0; i < values.size(); i++, p += 4) values[i] = bitsFloat(get32(p));
+            break;
+        case Encoding::UInt16:
+            for (size_t i = 0; i < values.size(); i++, p += 2) values[i] = static_cast<float>(p[0] | (p[1] << 8)) / header.scale;
+            break;
+        case Encoding::UInt8:
+            for (size_t i = 0; i < values.size(); i++) values[i] = static_cast<float>(p[i]) / header.scale;
+            break;
+        case Encoding::Delta8: {
+            vector<uint8_t> codes(dims, 0);
+            for (size_t i = 0; i < values.size(); i++) {
+                uint8_t& code = codes[i % dims];
+                code = static_cast<uint8_t>(code + p[i]);
+                values[i] = static_cast<float>(code) / header.scale;
+            }
+            break;
+        }
+    }
+}
+
+namespace {
+
+/**
+ * @brief First frame of every segment: every hop frames, plus one ending with the file
+ */
+vector<uint64_t> segmentStarts(uint64_t frames, double frameRate, double seconds, double hopSeconds,
+                               uint64_t& length) {
+    length = max<uint64_t>(1, static_cast<uint64_t>(llround(seconds * frameRate)));
+    uint64_t hop = max<uint64_t>(1, static_cast<uint64_t>(llround(hopSeconds * frameRate)));
+    if (frames <= length) {
+        length = frames;
+        return {0};
+    }
+    vector<uint64_t> starts;
+    for (uint64_t start = 0; start + length < frames; start += hop) {
+        starts.push_back(start);
+    }
+    if (starts.back() + length < frames) {
+        starts.push_back(frames - length);
+    }
+    return starts;
+}
+
+/**
+ * @brief Value of a numeric "# <label>: <n>" header line of a text feature file
+ */
+bool headerValue(const string& line, const string& label, uint32_t& value) {
+    string prefix = "# " + label + ": ";
+    if (line.compare(0, prefix.size(), prefix) != 0) return false;
+    value = static_cast<uint32_t>(strtoul(line.c_str() + prefix.size(), nullptr, 10));
+    return true;
+}
+
+bool segmentText(const Buffer& file, const string& name, double seconds, double hopSeconds,
+                 vector<Buffer>& segments, vector<uint64_t>& starts) {
+    const char* text = reinterpret_cast<const char*>(file.data());
+    size_t size = file.size();
+
+    // Leading "#" lines are the header, every other line a frame
+    uint32_t hopSize = 0, sampleRate = 0;
+    size_t headerEnd = 0;
+    vector<size_t> lineStarts;
+    for (size_t pos = 0; pos < size;) {
+        const char* newline = static_cast<const char*>(memchr(text + pos, '\n', size - pos));
+        size_t end = newline ? static_cast<size_t>(newline - text) + 1 : size;
+        if (lineStarts.empty() && text[pos] == '#') {
+            string line(text + pos, end - pos);
+            headerValue(line, "Hop size", hopSize);
+            headerValue(line, "Sample rate", sampleRate);
+            headerEnd = end;
+        } else {
+            lineStarts.push_back(pos);
+        }
+        pos = end;
+    }
+    if (hopSize == 0 || sampleRate == 0) {
+        cerr << "Error: Feature file does not state its hop size and sample rate: " << name << endl;
+        return false;
+    }
+    lineStarts.push_back(size);
+
+    uint64_t frames = lineStarts.size() - 1;
+    uint64_t length;
+    starts = segmentStarts(frames, static_cast<double>(sampleRate) / hopSize, seconds, hopSeconds, length);
+    if (starts.size() == 1) {
+        segments.assign(1, file);
+        return true;
+    }
+    segments.clear();
+    for (uint64_t start : starts) {
+        size_t from = lineStarts[start], to = lineStarts[start + length];
+        vector<uint8_t> bytes;
+        bytes.reserve(headerEnd + to - from);
+        bytes.insert(bytes.end(), file.data(), file.data() + headerEnd);
+        bytes.insert(bytes.end(), file.data() + from, file.data() + to);
+        segments.push_back(Buffer::fromBytes(move(bytes)));
+    }
+    return true;
+}
+
+}
+
+bool FeatureFile::segment(const Buffer& file, const string& name, double seconds, double hopSeconds,
+                          vector<Buffer>& segments, vector<uint64_t>& starts) {
+    if (file.size() < headerSize || memcmp(file.data(), magic, sizeof(magic)) != 0) {
+        return segmentText(file, name, seconds, hopSeconds, segments, starts);
+    }
+
+    Info info;
+    Buffer payload;
+    if (!parse(file, name, info, payload)) {
+        return false;
+    }
+    if (info.hopSize == 0 || info.sampleRate == 0 || info.dims == 0) {
+        cerr << "Error: Feature file does not state its frame layout and rate: " << name << endl;
+        return false;
+    }
+    uint64_t length;
+    starts = segmentStarts(info.frames, static_cast<double>(info.sampleRate) / info.hopSize, seconds, hopSeconds,
+                           length);
+    if (starts.size() == 1) {
+        segments.assign(1, file);
+        return true;
+    }
+
+    size_t rowBytes = info.dims * valueSize(info.encoding);
+    vector<uint8_t> codes(info.dims, 0);  // delta8: absolute codes of the frame before cursor
+    uint64_t cursor = 0;
+    segments.clear();
+    for (uint64_t start : starts) {
+        vector<uint8_t> bytes(headerSize);
+        encodeHeader(bytes.data(), length, info);
+        const uint8_t* rows = payload.data() + start * rowBytes;
+        bytes.insert(bytes.end(), rows, rows + length * rowBytes);
+        if (info.encoding == Encoding::Delta8) {
+            for (; cursor <= start; cursor++) {
+                const uint8_t* row = payload.data() + cursor * rowBytes;
+                for (size_t d = 0; d < info.dims; d++) codes[d] = static_cast<uint8_t>(codes[d] + row[d]);
+            }
+            memcpy(bytes.data() + headerSize, codes.data(), info.dims);
+        }
+        segments.push_back(Buffer::fromBytes(move(bytes)));
+    }
+    return true;
+}
@@ -0,0 +1,226 @@
+#include "../../include/core/Identification.h"
+#include "../../include/core/FeatureDatabase.h"
+#include "../../include/core/FeatureFile.h"
+#include "../../include/core/NCD.h"
+#include "../../include/utils/CompressionCache.h"
+#include "../../include/utils/CompressorWrapper.h"
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace Identification {
+
+namespace {
+
+/**
+ * Gather the database feature files (.feat or .featbin) from a directory
+ */
+bool listDatabaseFiles(const string& dbDir, bool useBinary,
+                       vector<string>& dbFiles, vector<string>& dbFilenames) {
+    try {
+        for (auto& entry : filesystem::directory_iterator(dbDir)) {
+            if (entry.is_regular_file()) {
+                string filename = entry.path().filename().string();
+                string extension = entry.path().extension().string();
+                if ((useBinary && extension == ".featbin") || (!useBinary && extension == ".feat")) {
+                    dbFiles.push_back(entry.path().string());
+                    dbFilenames.push_back(filename);
+                }
+            }
+        }
+    } catch (const filesystem::filesystem_error& e) {
+        cerr << "Error reading database directory: " << e.what() << endl;
+        return false;
+    }
+
+    if (dbFiles.empty()) {
+        cerr << "Error: No files found in database directory: " << dbDir << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Index the signatures of the database files (whole files, headers included); without a
+ * usable signature for every entry the database is scanned in full
+ */
+void indexDatabase(const vector<Buffer>& fileContents, Database& db) {
+    vector<vector<uint32_t>> signatures(fileContents.size());
+    size_t tokens = 0;
+    for (size_t i = 0; i < fileContents.size(); ++i) {
+        if (!PrefilterIndex::signatureOf(fileContents[i], db.files[i], signatures[i])) {
+            cerr << "Warning: Prefilter disabled; scanning the whole database" << endl;
+            return;
+        }
+        tokens += signatures[i].size();
+    }
+    db.prefilter.build(signatures);
+    db.indexed = true;
+    cout << "Prefilter index: " << tokens << " landmarks over " << db.prefilter.size() << " entries" << endl;
+}
+
+/**
+ * Load the entries of a packed database (see build_db); compressed sizes stored for the
+ * compressor are used as-is, otherwise the entries are compressed in memory
+ */
+bool loadPackedDatabase(const string& dbFile, bool useBinary, const string& compressor, bool usePrefilter,
+                        Database& db) {
+    FeatureDatabase packed;
+    if (!FeatureDatabase::open(dbFile, packed)) {
+        return false;
+    }
+    if (packed.binary() != useBinary) {
+        cerr << "Error: Packed database holds " << (packed.binary() ? ".featbin" : ".feat")
+             << " files; " << (packed.binary() ? "add" : "drop") << " --binary" << endl;
+        return false;
+    }
+    if (packed.size() == 0) {
+        cerr << "Error: No files found in packed database: " << dbFile << endl;
+        return false;
+    }
+    if (packed.segmented()) {
+        // Segments of a track are stored next to each other (the index is sorted by name)
+        db.tracks.resize(packed.size());
+        for (size_t i = 0; i < packed.size(); ++i) {
+            string track = FeatureDatabase::trackOf(packed.name(i));
+            if (db.trackNames.empty() || db.trackNames.back() != track) db.trackNames.push_back(track);
+            db.tracks[i] = db.trackNames.size() - 1;
+        }
+        cout << "Segmented database: " << packed.size() << " segments of " << db.trackNames.size() << " tracks" << endl;
+    }
+
+    // The buffers share the mapping, which outlives the packed index
+    db.files.resize(packed.size());
+    db.names.resize(packed.size());
+    db.buffers.resize(packed.size());
+    for (size_t i = 0; i < packed.size(); ++i) {
+        db.names[i] = packed.name(i);
+        db.files[i] = dbFile + ":" + packed.name(i);
+        if (!FeatureFile::contentOf(packed.file(i), db.files[i], db.buffers[i])) {
+            return false;
+        }
+    }
+    if (usePrefilter) {
+        vector<Buffer> fileContents(packed.size());
+        for (size_t i = 0; i < packed.size(); ++i) fileContents[i] = packed.file(i);
+        indexDatabase(fileContents, db);
+    }
+
+    string key = CompressorWrapper::sizeKey(compressor);
+    const vector<long>* sizes = packed.compressedSizes(key);
+    if (sizes) {
+        db.sizes = *sizes;
+        return true;
+    }
+
+    cout << "Packed database has no " << key << " sizes; compressing entries" << endl;
+    CompressorWrapper cw;
+    db.sizes.resize(db.buffers.size());
+    for (size_t i = 0; i < db.buffers.size(); ++i) {
+        db.sizes[i] = cw.compressedSize(compressor, db.buffers[i]);
+        if (db.sizes[i] <= 0) {
+            cerr << "Error: Failed to compress database file: " << db.files[i] << endl;
+        }
+    }
+    return true;
+}
+
+}
+
+
+void pushBestSegments(const Database& db, const double* scores, size_t count, const vector<size_t>* entries,
+                      TopK& best) {
+    vector<double> trackBest(db.trackNames.size(), numeric_limits<double>::infinity());
+    for (size_t j = 0; j < count; ++j) {
+        size_t t = db.tracks[entries ? (*entries)[j] : j];
+        trackBest[t] = min(trackBest[t], scores[j]);
+    }
+    for (size_t t = 0; t < trackBest.size(); ++t) {
+        if (trackBest[t] != numeric_limits<double>::infinity()) best.push(db.trackNames[t], trackBest[t]);
+    }
+}
+
+bool loadDatabase(const string& dbDir, bool useBinary, const string& compressor, bool useCache,
+                  bool usePrefilter, Database& db) {
+    if (FeatureDatabase::isPacked(dbDir)) {
+        return loadPackedDatabase(dbDir, useBinary, compressor, usePrefilter, db);
+    }
+    if (!listDatabaseFiles(dbDir, useBinary, db.files, db.names)) {
+        return false;
+    }
+
+    CompressorWrapper cw;
+    CompressionCache cache(CompressionCache::defaultPath(dbDir));
+    if (useCache) {
+        cache.load();
+    }
+
+    db.buffers.resize(db.files.size());
+    db.sizes.resize(db.files.size());
+    vector<Buffer> fileContents(db.files.size());
+    for (size_t i = 0; i < db.files.size(); ++i) {
+        if (!Buffer::fromFile(db.files[i], fileContents[i]) ||
+            !FeatureFile::contentOf(fileContents[i], db.files[i], db.buffers[i])) {
+            return false;
+        }
+        db.sizes[i] = useCache ? cache.compressedSize(db.files[i], db.buffers[i], compressor)
+                               : cw.compressedSize(compressor, db.buffers[i]);
+        if (db.sizes[i] <= 0) {
+            cerr << "Error: Failed to compress database file: " << db.files[i] << endl;
+        }
+    }
+
+    if (useCache) {
+        cout << "Compressed size cache: " << cache.hits() << " hits, " << cache.misses() << " misses" << endl;
+        cache.save();
+    }
+    if (usePrefilter) {
+        indexDatabase(fileContents, db);
+    }
+    return true;
+}
+
+vector<pair<string, double>> rankQuery(const Buffer& query, long Cx, const Database& db,
+                                       const string& compressor, size_t heapSize,
+                                       ThreadPool& pool, bool usePriming,
+                                       const vector<size_t>* entries) {
+    vector<TopK> partialResults(pool.size(), TopK(heapSize));
+    // Each worker primes its own copy of the query state the first time it needs it
+    vector<unique_ptr<PrimedCompressor>> primed(pool.size());
+    vector<char> primedReady(pool.size(), 0);
+
+    size_t count = entries ? entries->size() : db.buffers.size();
+    vector<double> segmentScores(db.segmented() ? count : 0);
+    pool.parallelFor(count, [&](size_t job, unsigned int worker) {
+        size_t i = entries ? (*entries)[job] : job;
+        NCD ncd;
+        Compressor* c = CompressorWrapper::threadCompressor(compressor);
+        if (!c) return;
+        if (usePriming && !primedReady[worker]) {
+            primed[worker] = c->prime(query);
+            primedReady[worker] = 1;
+        }
+        // Entries that cannot beat the worker's K-th best are abandoned part-way
+        double threshold = db.segmented() ? numeric_limits<double>::infinity() : partialResults[worker].threshold();
+        double ncdValue = primed[worker] ? ncd.computeNCD(*primed[worker], db.buffers[i], Cx, db.sizes[i])
+                                         : ncd.computeNCD(query, db.buffers[i], *c, Cx, db.sizes[i], threshold);
+        if (db.segmented()) {
+            segmentScores[job] = ncdValue;
+        } else {
+            partialResults[worker].push(db.names[i], ncdValue);
+        }
+    });
+
+    TopK merged(heapSize);
+    if (db.segmented()) {
+        pushBestSegments(db, segmentScores.data(), count, entries, merged);
+        return merged.sorted();
+    }
+    for (const auto& partial : partialResults) {
+        merged.merge(partial);
+    }
+    return merged.sorted();
+}
+
+}
@@ -0,0 +1,54 @@
+#include "../../include/core/Logger.h"
+#include <chrono>
+
+using namespace std;
+
+Logger::Logger(ostream& out, int flushMillis)
+    : out(out), flushMillis(flushMillis > 0 ? flushMillis : 1) {
+    flusher = thread(&Logger::flushLoop, this);
+}
+
+Logger::~Logger() {
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+    drain();
+}
+
+void Logger::log(string message) {
+    Node* node = new Node{move(message), head.load(memory_order_relaxed)};
+    while (!head.compare_exchange_weak(node->next, node, memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+void Logger::flushLoop() {
+    unique_lock<mutex> lock(wakeMutex);
+    while (!stopping) {
+        wake.wait_for(lock, chrono::milliseconds(flushMillis));
+        drain();
+    }
+}
+
+void Logger::drain() {
+    Node* node = head.exchange(nullptr, memory_order_acquire);
+    if (!node) return;
+
+    // The list is newest first; reverse it to write in logging order
+    Node* ordered = nullptr;
+    while (node) {
+        Node* next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+    while (ordered) {
+        out << ordered->text;
+        Node* done = ordered;
+        ordered = ordered->next;
+        delete done;
+    }
+    out.flush();
+}
@@ -1,58 +1,41 @@
 #include "../../include/core/MaxFreqExtractor.h"
-#include <complex>
+#include "../../include/core/FFTPlan.h"
+#include "../../include/core/Metrics.h"
+#include "../../include/core/PeakSelector.h"
 #include <cmath>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
 #include <numeric>
 
 using namespace std;
 
-MaxFreqExtractor::MaxFreqExtractor(int numFrequencies) : numFreqs(numFrequencies) {
+namespace {
+
+Metrics::Stage& windowStage = Metrics::stage("maxfreq_window");
+Metrics::Stage& fftStage = Metrics::stage("maxfreq_fft");
+Metrics::Stage& peakStage = Metrics::stage("maxfreq_peak_pick");
+Metrics::Stage& serializeStage = Metrics::stage("maxfreq_serialize");
+Metrics::Counter& framesCounter = Metrics::counter("maxfreq_frames");
+
+}
+
+MaxFreqExtractor::MaxFreqExtractor(int numFrequencies, int spacing) : numFreqs(numFrequencies), peakSpacing(spacing) {
     if (numFreqs <= 0) numFreqs = 4;  // Default to 4 frequencies per frame
+    if (peakSpacing < 0) peakSpacing = 0;
 }
 
-void MaxFreqExtractor::computeFFT(const vector<int16_t>& frame, vector<double>& magnitudes) {
-    int N = frame.size();
-    vector<complex<double>> fft(N);
-    
-    // Initialize FFT input
-    for (int i = 0; i < N; i++) {
-        fft[i] = complex<double>(frame[i], 0);
+void MaxFreqExtractor::computeFFT(vector<double>& magnitudes) {
+    Metrics::ScopedTimer timer(fftStage);
+    int N = fftInput.size();
+    if (!plan || plan->size() != N) {
+        plan = FFTPlan::forSize(N);
     }
-    
-    // Cooley-Tukey FFT implementation (bit-reversal + butterfly)
-    // Bit reversal
-    int j = 0;
-    for (int i = 0; i < N-1; i++) {
-        if (i < j) {
-            swap(fft[i], fft[j]);
-        }
-        int k = N >> 1;
-        while (k <= j) {
-            j -= k;
-            k >>= 1;
-        }
-        j += k;
-    }
-    
-    // Butterfly computation
-    for (int step = 1; step < N; step <<= 1) {
-        double theta = -M_PI / step;  // Base angle
-        complex<double> w_m(cos(theta), sin(theta));  // Principal root of unity
-        
-        for (int m = 0; m < step; m++) {
-            complex<double> w(1, 0);  // Start with unity
-            
-            for (int i = m; i < N; i += 2*step) {
-                complex<double> t = w * fft[i + step];
-                complex<double> u = fft[i];
-                fft[i] = u + t;
-                fft[i + step] = u - t;
-                w *= w_m;  // Rotate by the principal root
-            }
-        }
-    }
-    
+
+    // Real-input transform of the windowed frame with the cached plan for this frame size
+    plan->forwardReal(fftInput.data(), spectrum);
+    const vector<complex<double>>& fft = spectrum;
+
     // Calculate magnitudes (only up to Nyquist frequency)
     magnitudes.resize(N/2);
     for (int i = 0; i < N/2; i++) {
@@ -65,40 +48,34 @@ void MaxFreqExtractor::computeFFT(const vector<int16_t>& frame, vector<double>&
     }
 }
 
-void MaxFreqExtractor::applyWindow(vector<int16_t>& frame) {
-    // Hann window function
-    const int size = frame.size();
-    for (int i = 0; i < size; i++) {
-        double window = 0.5 * (1.0 - cos(2.0 * M_PI * i / (size - 1)));
-        frame[i] = static_cast<int16_t>(frame[i] * window);
+void MaxFreqExtractor::applyWindow(const int16_t* frame, int size) {
+    Metrics::ScopedTimer timer(windowStage);
+    // Hann window function, cached per frame size
+    if (!window || static_cast<int>(window->size()) != size) {
+        window = SpectralKernels::hannWindow(size);
     }
+    fftInput.resize(size);
+    SpectralKernels::active().window(frame, window->data(), 1.0, fftInput.data(), size);
 }
 
-vector<int> MaxFreqExtractor::getTopFreqIndices(const vector<double>& magnitudes) {
-    // Create index array
-    vector<int> indices(magnitudes.size());
-    iota(indices.begin(), indices.end(), 0);  // Fill with 0, 1, 2, ...
-    
-    // Skip DC component (0 Hz)
-    indices[0] = -1;
-    
-    // Partial sort to find top N frequencies (much faster than full sort)
-    partial_sort(indices.begin(), indices.begin() + numFreqs, indices.end(),
-                [&magnitudes](int a, int b) {
-                    if (a == -1) return false;
-                    if (b == -1) return true;
-                    return magnitudes[a] > magnitudes[b];
-                });
-    
-    // Return top indices
-    vector<int> result;
-    for (int i = 0; i < numFreqs && i < static_cast<int>(magnitudes.size()); i++) {
-        if (indices[i] > 0) {  // Skip any marked indices (-1)
-            result.push_back(indices[i]);
-        }
+void MaxFreqExtractor::applyWindow(const float* frame, int size) {
+    Metrics::ScopedTimer timer(windowStage);
+    if (!window || static_cast<int>(window->size()) != size) {
+        window = SpectralKernels::hannWindow(size);
     }
-    
-    return result;
+    fftInput.resize(size);
+    SpectralKernels::active().windowFloat(frame, window->data(), 1.0, fftInput.data(), size);
+}
+
+const vector<int>& MaxFreqExtractor::getTopFreqIndices(const vector<double>& magnitudes) {
+    Metrics::ScopedTimer timer(peakStage);
+    framesCounter.add();
+    // One pass over the spectrum, skipping the DC component (0 Hz)
+    topIndices.resize(numFreqs);
+    int count = PeakSelector::select(magnitudes.data(), static_cast<int>(magnitudes.size()), 1, numFreqs,
+                                     peakSpacing, topIndices.data(), indices);
+    topIndices.resize(count);
+    return topIndices;
 }
 
 string MaxFreqExtractor::extractFeatures(const vector<int16_t>& samples, int channels, 
@@ -118,27 +95,19 @@ string MaxFreqExtractor::extractFeatures(const vector<int16_t>& samples, int cha
     stringstream ss;
     
     // Header information
-    ss << "# MaxFreqExtractor features" << endl;
-    ss << "# Channels: " << channels << endl;
-    ss << "# Frame size: " << frameSize << endl;
-    ss << "# Hop size: " << hopSize << endl;
-    ss << "# Sample rate: " << sampleRate << endl;
-    ss << "# Frequencies per frame: " << numFreqs << endl;
+    ss << featureHeader(channels, frameSize, hopSize, sampleRate);
     
     // Process frames
+    vector<double> magnitudes; // Reused between frames
     for (size_t i = 0; i + frameSize <= monoSamples.size(); i += hopSize) {
-        // Extract frame
-        vector<int16_t> frame(monoSamples.begin() + i, monoSamples.begin() + i + frameSize);
-        
-        // Apply window function
-        applyWindow(frame);
+        // Apply window function (straight from the sample buffer)
+        applyWindow(&monoSamples[i], frameSize);
         
         // Compute FFT
-        vector<double> magnitudes;
-        computeFFT(frame, magnitudes);
+        computeFFT(magnitudes);
         
         // Get top frequency indices
-        vector<int> topIndices = getTopFreqIndices(magnitudes);
+        const vector<int>& topIndices = getTopFreqIndices(magnitudes);
         
         // Convert to actual frequencies and output
         for (size_t j = 0; j < topIndices.size(); j++) {
@@ -164,14 +133,77 @@ std::vector<std::vector<float>> MaxFreqExtractor::extractFeaturesBinary(const st
         monoSamples = samples;
     }
     std::vector<std::vector<float>> features;
+    std::vector<double> magnitudes;
     for (size_t i = 0; i + frameSize <= monoSamples.size(); i += hopSize) {
-        std::vector<int16_t> frame(monoSamples.begin() + i, monoSamples.begin() + i + frameSize);
-        applyWindow(frame);
-        std::vector<double> magnitudes;
-        computeFFT(frame, magnitudes);
-        std::vector<int> topIndices = getTopFreqIndices(magnitudes);
+        applyWindow(&monoSamples[i], frameSize);
+        computeFFT(magnitudes);
+        const std::vector<int>& topIndices = getTopFreqIndices(magnitudes);
         std::vector<float> indicesFloat(topIndices.begin(), topIndices.end());
         features.push_back(indicesFloat);
     }
     return features;
-}
\ No newline at end of file
+}
+
+string MaxFreqExtractor::featureHeader(int channels, int frameSize, int hopSize, int sampleRate) const {
+    stringstream ss;
+    ss << "# MaxFreqExtractor features" << endl;
+    ss << "# Channels: " << channels << endl;
+    ss << "# Frame size: " << frameSize << endl;
+    ss << "# Hop size: " << hopSize << endl;
+    ss << "# Sample rate: " << sampleRate << endl;
+    ss << "# Frequencies per frame: " << numFreqs << endl;
+    if (peakSpacing > 0) {
+        ss << "# Peak spacing: " << peakSpacing << endl;
+    }
+    return ss.str();
+}
+
+const vector<int>& MaxFreqExtractor::extractFrameValues(const float* frame, int frameSize) {
+    applyWindow(frame, frameSize);
+    computeFFT(frameMagnitudes);
+    return getTopFreqIndices(frameMagnitudes);
+}
+
+vector<float> MaxFreqExtractor::extractFrameBinary(const float* frame, int frameSize) {
+    const vector<int>& peaks = extractFrameValues(frame, frameSize);
+    return vector<float>(peaks.begin(), peaks.end());
+}
+
+void MaxFreqExtractor::appendIndices(const vector<int>& peaks, string& out) {
+    char digits[16];
+    for (size_t j = 0; j < peaks.size(); j++) {
+        if (j > 0) out += ' ';
+        char* end = to_chars(digits, digits + sizeof(digits), peaks[j]).ptr;
+        out.append(digits, end);
+    }
+}
+
+string MaxFreqExtractor::extractFrame(const float* frame, int frameSize) {
+    const vector<int>& peaks = extractFrameValues(frame, frameSize);
+    Metrics::ScopedTimer timer(serializeStage);
+    string line;
+    appendIndices(peaks, line);
+    return line;
+}
+
+void MaxFreqExtractor::appendFrame(const float* frame, int frameSize, string& out) {
+    const vector<int>& peaks = extractFrameValues(frame, frameSize);
+    Metrics::ScopedTimer timer(serializeStage);
+    appendIndices(peaks, out);
+    out += '\n';
+}
+
+string MaxFreqExtractor::extractFeatures(WAVStream& stream, int frameSize, int hopSize) {
+    if (!stream.setFraming(frameSize, hopSize)) {
+        return "";
+    }
+
+    string text = featureHeader(stream.getChannels(), frameSize, hopSize, stream.getSampleRate());
+    // Bin indices below frameSize / 2 and a separator per peak
+    text.reserve(text.size() + stream.analysisFrames(frameSize, hopSize) * numFreqs * (to_string(frameSize / 2).size() + 1));
+    const float* frame;
+    while (stream.nextFrame(frame)) {
+        appendFrame(frame, frameSize, text);
+    }
+    return text;
+}
@@ -0,0 +1,184 @@
+#include "../../include/core/Metrics.h"
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+namespace Metrics {
+
+atomic<bool> active{false};
+
+namespace {
+
+mutex registryMutex;
+
+map<string, unique_ptr<Stage>>& stages() {
+    static map<string, unique_ptr<Stage>> registry;
+    return registry;
+}
+
+map<string, unique_ptr<Counter>>& counters() {
+    static map<string, unique_ptr<Counter>> registry;
+    return registry;
+}
+
+string exportPath;
+
+void writeAtExit() {
+    if (!write(exportPath)) {
+        cerr << "Error: Could not write metrics to " << exportPath << endl;
+    } else {
+        cout << "Metrics written to " << exportPath << endl;
+    }
+}
+
+uint64_t bucketBound(int b) {
+    return uint64_t(1) << b;
+}
+
+void writeJson(ostream& out) {
+    out << "{\n  \"stages\": [";
+    bool first = true;
+    for (const auto& [name, stage] : stages()) {
+        uint64_t count = stage->count();
+        if (count == 0) continue;
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << name << "\", \"count\": " << count
+            << ", \"total_ns\": " << stage->totalNanos()
+            << ", \"mean_ns\": " << stage->totalNanos() / count
+            << ", \"min_ns\": " << stage->minNanos()
+            << ", \"max_ns\": " << stage->maxNanos()
+            << ", \"p50_ns\": " << stage->quantileNanos(0.5)
+            << ", \"p90_ns\": " << stage->quantileNanos(0.9)
+            << ", \"p99_ns\": " << stage->quantileNanos(0.99)
+            << ", \"buckets\": [";
+        bool firstBucket = true;
+        for (int b = 0; b < Stage::BUCKETS; b++) {
+            uint64_t n = stage->bucket(b);
+            if (n == 0) continue;
+            out << (firstBucket ? "" : ", ") << "{\"le_ns\": ";
+            if (b + 1 < Stage::BUCKETS) {
+                out << bucketBound(b);
+            } else {
+                out << "null";
+            }
+            out << ", \"count\": " << n << "}";
+            firstBucket = false;
+        }
+        out << "]}";
+    }
+    out << (first ? "" : "\n  ") << "],\n  \"counters\": {";
+    first = true;
+    for (const auto& [name, counter] : counters()) {
+        out << (first ? "\n" : ",\n") << "    \"" << name << "\": " << counter->value();
+        first = false;
+    }
+    out << (first ? "" : "\n  ") << "}\n}\n";
+}
+
+void writePrometheus(ostream& out) {
+    out << "# HELP stage_duration_seconds Time spent in an instrumented stage\n";
+    out << "# TYPE stage_duration_seconds histogram\n";
+    for (const auto& [name, stage] : stages()) {
+        uint64_t count = stage->count();
+        if (count == 0) continue;
+        uint64_t cumulative = 0;
+        for (int b = 0; b + 1 < Stage::BUCKETS; b++) {
+            cumulative += stage->bucket(b);
+            // Only the buckets from the first call up to the longest one
+            if (cumulative == 0 || bucketBound(b) / 2 > stage->maxNanos()) continue;
+            out << "stage_duration_seconds_bucket{stage=\"" << name << "\",le=\"" << setprecision(6)
+                << bucketBound(b) * 1e-9 << "\"} " << cumulative << "\n";
+        }
+        out << "stage_duration_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} " << count << "\n";
+        out << "stage_duration_seconds_sum{stage=\"" << name << "\"} " << setprecision(9)
+            << stage->totalNanos() * 1e-9 << "\n";
+        out << "stage_duration_seconds_count{stage=\"" << name << "\"} " << count << "\n";
+    }
+    for (const auto& [name, counter] : counters()) {
+        out << "# TYPE " << name << "_total counter\n";
+        out << name << "_total " << counter->value() << "\n";
+    }
+}
+
+}
+
+Stage::Stage(const string& name) : stageName(name) {}
+
+void Stage::record(uint64_t nanos) {
+    int b = 0;
+    while (b + 1 < BUCKETS && nanos >= bucketBound(b)) b++;
+    buckets[b].fetch_add(1, memory_order_relaxed);
+    calls.fetch_add(1, memory_order_relaxed);
+    total.fetch_add(nanos, memory_order_relaxed);
+
+    uint64_t seen = shortest.load(memory_order_relaxed);
+    while (nanos < seen && !shortest.compare_exchange_weak(seen, nanos, memory_order_relaxed)) {
+    }
+    seen = longest.load(memory_order_relaxed);
+    while (nanos > seen && !longest.compare_exchange_weak(seen, nanos, memory_order_relaxed)) {
+    }
+}
+
+uint64_t Stage::quantileNanos(double q) const {
+    uint64_t n = count();
+    if (n == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (n - 1)) + 1;
+    uint64_t cumulative = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        cumulative += bucket(b);
+        if (cumulative >= rank) {
+            return b + 1 < BUCKETS ? min(bucketBound(b), maxNanos()) : maxNanos();
+        }
+    }
+    return maxNanos();
+}
+
+Stage& stage(const string& name) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& entry = stages()[name];
+    if (!entry) entry = make_unique<Stage>(name);
+    return *entry;
+}
+
+Counter& counter(const string& name) {
+    lock_guard<mutex> lock(registryMutex);
+    auto& entry = counters()[name];
+    if (!entry) entry = make_unique<Counter>(name);
+    return *entry;
+}
+
+void enable(const string& exportFile) {
+    // Touch the registries first so they outlive the exit handler
+    stages();
+    counters();
+    bool registered = !exportPath.empty();
+    exportPath = exportFile;
+    active.store(true, memory_order_relaxed);
+    if (!registered) atexit(writeAtExit);
+}
+
+bool write(const string& path) {
+    lock_guard<mutex> lock(registryMutex);
+    ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    size_t dot = path.rfind('.');
+    string extension = dot == string::npos ? "" : path.substr(dot);
+    if (extension == ".prom" || extension == ".txt") {
+        writePrometheus(out);
+    } else {
+        writeJson(out);
+    }
+    return out.good();
+}
+
+}
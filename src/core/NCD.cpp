@@ -1,90 +1,132 @@
 #include "../../include/core/NCD.h"
+#include "../../include/core/FeatureFile.h"
+#include "../../include/core/Metrics.h"
+#include "../../include/core/NCDMatrix.h"
 #include "../../include/utils/CompressorWrapper.h"
-#include <filesystem>
 #include <iostream>
-#include <fstream>
+#include <climits>
 #include <cmath>
 
 using namespace std;
 
+namespace {
+
+Metrics::Stage& loadStage = Metrics::stage("ncd_load");
+Metrics::Stage& cxStage = Metrics::stage("ncd_cx");
+Metrics::Stage& cyStage = Metrics::stage("ncd_cy");
+Metrics::Stage& cxyStage = Metrics::stage("ncd_cxy");
+Metrics::Stage& primedStage = Metrics::stage("ncd_cxy_primed");
+Metrics::Counter& pairsCounter = Metrics::counter("ncd_pairs");
+
+/**
+ * @brief Load the feature content of both files
+ */
+bool loadPair(const string& file1, const string& file2, Buffer& x, Buffer& y) {
+    Metrics::ScopedTimer timer(loadStage);
+    return FeatureFile::loadContent(file1, x) && FeatureFile::loadContent(file2, y);
+}
+
+}
+
 double NCD::computeNCD(const string& file1, const string& file2, const string& compressor) {
-    CompressorWrapper cw;
-    
+    Compressor* c = CompressorWrapper::threadCompressor(compressor);
+    Buffer x, y;
+    if (!c || !loadPair(file1, file2, x, y)) {
+        return 1.0; // Maximum distance on error
+    }
+    return computeNCD(x, y, *c);
+}
+
+double NCD::computeNCD(const string& file1, const string& file2, const string& compressor, long Cx, long Cy) {
+    Compressor* c = CompressorWrapper::threadCompressor(compressor);
+    Buffer x, y;
+    if (!c || !loadPair(file1, file2, x, y)) {
+        return 1.0;
+    }
+    return computeNCD(x, y, *c, Cx, Cy);
+}
+
+double NCD::computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor) {
     // Compute compressed sizes with error checking
-    long Cx = cw.compressAndGetSize(compressor, file1);
+    long Cx;
+    {
+        Metrics::ScopedTimer timer(cxStage);
+        Cx = compressor.compressedSize(x);
+    }
     if (Cx <= 0) {
-        cerr << "Error: Failed to compress file1: " << file1 << endl;
+        cerr << "Error: Failed to compress first input" << endl;
         return 1.0; // Maximum distance on error
     }
     
-    long Cy = cw.compressAndGetSize(compressor, file2);
+    long Cy;
+    {
+        Metrics::ScopedTimer timer(cyStage);
+        Cy = compressor.compressedSize(y);
+    }
     if (Cy <= 0) {
-        cerr << "Error: Failed to compress file2: " << file2 << endl;
+        cerr << "Error: Failed to compress second input" << endl;
         return 1.0;
     }
-    
-    // Create a unique temporary filename
-    string catFile = filesystem::temp_directory_path().string() + "/tmp_cat_" + 
-                    to_string(chrono::system_clock::now().time_since_epoch().count());
-    
-    // Improved concatenation with error checking
-    bool concatenationSuccess = false;
+
+    return computeNCD(x, y, compressor, Cx, Cy);
+}
+
+double NCD::computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor, long Cx, long Cy) {
+    // x and y are fed as one stream, so nothing is copied or written to disk
+    long Cxy;
     {
-        ofstream out(catFile, ios::binary);
-        if (!out) {
-            cerr << "Error: Could not create temporary file " << catFile << endl;
-            return 1.0;
-        }
-        
-        ifstream in1(file1, ios::binary);
-        if (!in1) {
-            cerr << "Error: Could not open file " << file1 << endl;
-            return 1.0;
-        }
-        
-        ifstream in2(file2, ios::binary);
-        if (!in2) {
-            cerr << "Error: Could not open file " << file2 << endl;
-            return 1.0;
-        }
-        
-        // Read and write complete files
-        out << in1.rdbuf();
-        out << in2.rdbuf();
-        
-        // Make sure everything was written
-        concatenationSuccess = out.good() && !out.fail();
-        
-        // Explicitly close to ensure data is flushed
-        out.close();
+        Metrics::ScopedTimer timer(cxyStage);
+        Cxy = compressor.compressedSize(x, y);
     }
-    
-    if (!concatenationSuccess) {
-        cerr << "Error: File concatenation failed" << endl;
-        filesystem::remove(catFile);
+    pairsCounter.add();
+    if (Cxy <= 0) {
+        cerr << "Error: Failed to compress concatenated input." << endl;
         return 1.0;
     }
-    
-    // Compress concatenated file
-    long Cxy = cw.compressAndGetSize(compressor, catFile);
-    
-    // Clean up temporary file
-    bool removed = false;
-    try {
-        removed = filesystem::remove(catFile);
-    } catch (const filesystem::filesystem_error& e) {
-        cerr << "Warning: Could not remove temp file: " << e.what() << endl;
+
+    return fromSizes(Cx, Cy, Cxy);
+}
+
+double NCD::computeNCD(const Buffer& x, const Buffer& y, Compressor& compressor, long Cx, long Cy,
+                       double threshold) {
+    long limit = sizeAbove(Cx, Cy, threshold);
+    if (limit == LONG_MAX) {
+        return computeNCD(x, y, compressor, Cx, Cy);
     }
-    
-    if (!removed) {
-        cerr << "Warning: Failed to remove temporary file " << catFile << endl;
+    long Cxy;
+    {
+        Metrics::ScopedTimer timer(cxyStage);
+        Cxy = compressor.compressedSize(x, y, limit);
     }
-    
+    pairsCounter.add();
     if (Cxy <= 0) {
-        cerr << "Error: Failed to compress concatenated file." << endl;
+        cerr << "Error: Failed to compress concatenated input." << endl;
         return 1.0;
     }
-    
+
+    return fromSizes(Cx, Cy, Cxy);
+}
+
+double NCD::computeNCD(PrimedCompressor& primedX, const Buffer& y, long Cx, long Cy) {
+    long Cxy;
+    {
+        Metrics::ScopedTimer timer(primedStage);
+        Cxy = primedX.compressedSizeWith(y);
+    }
+    pairsCounter.add();
+    if (Cxy <= 0) {
+        cerr << "Error: Failed to compress concatenated input." << endl;
+        return 1.0;
+    }
+
+    return fromSizes(Cx, Cy, Cxy);
+}
+
+double NCD::fromSizes(long Cx, long Cy, long Cxy) {
+    if (Cx <= 0 || Cy <= 0 || Cxy <= 0) {
+        return 1.0; // Maximum distance on error
+    }
+
     // Compute NCD
     long Cmin = min(Cx, Cy);
     long Cmax = max(Cx, Cy);
@@ -101,28 +143,28 @@ double NCD::computeNCD(const string& file1, const string& file2, const string& c
     return max(0.0, min(1.0, ncd));
 }
 
-vector<vector<double>> NCD::computeMatrix(const vector<string>& files, const string& compressor) {
-    int n = files.size();
-    vector<vector<double>> mat(n, vector<double>(n, 0.0));
-
-    // Extract base filenames for display
-    vector<string> baseNames;
-    for (const auto& file : files) {
-        baseNames.push_back(filesystem::path(file).filename().string());
+long NCD::sizeAbove(long Cx, long Cy, double threshold) {
+    // NCDs are clamped to 1, so nothing exceeds a threshold of 1 or more
+    if (Cx <= 0 || Cy <= 0 || !(threshold < 1.0)) {
+        return LONG_MAX;
     }
+    long Cmin = min(Cx, Cy);
+    long Cmax = max(Cx, Cy);
+    double estimate = floor(max(0.0, threshold) * double(Cmax)) + double(Cmin) + 1.0;
+    long limit = max(1L, static_cast<long>(estimate));
+    // Correct the rounding of the estimate against the exact formula
+    while (fromSizes(Cx, Cy, limit) <= threshold) limit++;
+    while (limit > 1 && fromSizes(Cx, Cy, limit - 1) > threshold) limit--;
+    return limit;
+}
 
-    cout << "Computing NCD matrix for " << n << " files using " << compressor << " compressor..." << endl;
-
-    // Compute upper triangular matrix (diagonal is 0)
-    for (int i = 0; i < n; ++i) {
-        mat[i][i] = 0.0;
-        for (int j = i+1; j < n; ++j) {
-            double d = computeNCD(files[i], files[j], compressor);
-            mat[i][j] = mat[j][i] = d;
-            cout << "NCD(" << baseNames[i] << "," << baseNames[j] << ") = " << d << endl;
-        }
-        // Show progress
-        cout << "Completed " << i+1 << "/" << n << " files" << endl;
+vector<vector<double>> NCD::computeMatrix(const vector<string>& files, const string& compressor,
+                                          unsigned int threadCount) {
+    NCDMatrix matrix;
+    NCDMatrix::Options options;
+    options.threadCount = threadCount;
+    if (!matrix.compute(files, compressor, options)) {
+        return {};
     }
-    return mat;
+    return matrix.rows();
 }
@@ -0,0 +1,162 @@
+#include "../../include/core/NCDMatrix.h"
+#include "../../include/core/FeatureFile.h"
+#include "../../include/core/NCD.h"
+#include "../../include/core/ProgressReporter.h"
+#include "../../include/core/ThreadPool.h"
+#include "../../include/utils/CompressorWrapper.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+bool NCDMatrix::compute(const vector<string>& files, const string& compressor, const Options& options) {
+    size_t n = files.size();
+    names.resize(n);
+    values.assign(n * n, 0.0);
+
+    vector<Buffer> contents(n);
+    for (size_t i = 0; i < n; ++i) {
+        names[i] = filesystem::path(files[i]).filename().string();
+        if (!FeatureFile::loadContent(files[i], contents[i])) {
+            return false;
+        }
+    }
+    if (n < 2) return true;
+
+    ThreadPool pool(options.threadCount);
+    cout << "Computing NCD matrix for " << n << " files using " << compressor << " compressor ("
+         << pool.size() << " threads)..." << endl;
+
+    // C(x) once per file instead of once per pair
+    vector<long> sizes(n, 0);
+    atomic<bool> failed(false);
+    pool.parallelFor(n, [&](size_t i, unsigned int) {
+        Compressor* c = CompressorWrapper::threadCompressor(compressor);
+        sizes[i] = c ? c->compressedSize(contents[i]) : 0;
+        if (sizes[i] <= 0) failed = true;
+    });
+    if (failed) {
+        cerr << "Error: Failed to compress the input files with " << compressor << endl;
+        return false;
+    }
+
+    // Upper-triangle tiles, row-major; diagonal tiles only hold the pairs above the diagonal
+    size_t tile = max<size_t>(1, options.tileSize);
+    size_t blocks = (n + tile - 1) / tile;
+    vector<pair<size_t, size_t>> tiles;
+    for (size_t bi = 0; bi < blocks; ++bi) {
+        for (size_t bj = bi; bj < blocks; ++bj) {
+            tiles.emplace_back(bi, bj);
+        }
+    }
+
+    size_t totalPairs = n * (n - 1) / 2;
+    ProgressReporter progress("Pairs", totalPairs);
+
+    pool.parallelFor(tiles.size(), [&](size_t t, unsigned int) {
+        NCD ncd;
+        Compressor* c = CompressorWrapper::threadCompressor(compressor);
+        if (!c) return;
+        size_t rowBegin = tiles[t].first * tile, rowEnd = min(n, rowBegin + tile);
+        size_t colBegin = tiles[t].second * tile, colEnd = min(n, colBegin + tile);
+
+        size_t pairsDone = 0;
+        for (size_t i = rowBegin; i < rowEnd; ++i) {
+            size_t first = max(colBegin, i + 1);
+            if (first >= colEnd) continue;
+            unique_ptr<PrimedCompressor> primed = options.usePriming ? c->prime(contents[i]) : nullptr;
+            for (size_t j = first; j < colEnd; ++j) {
+                double d = primed ? ncd.computeNCD(*primed, contents[j], sizes[i], sizes[j])
+                                  : ncd.computeNCD(contents[i], contents[j], *c, sizes[i], sizes[j]);
+                values[i * n + j] = values[j * n + i] = d;
+            }
+            pairsDone += colEnd - first;
+        }
+        if (options.showProgress) progress.add(pairsDone);
+    });
+    if (options.showProgress) progress.finish();
+    return true;
+}
+
+vector<vector<double>> NCDMatrix::rows() const {
+    size_t n = names.size();
+    vector<vector<double>> mat(n);
+    for (size_t i = 0; i < n; ++i) {
+        mat[i].assign(values.begin() + i * n, values.begin() + (i + 1) * n);
+    }
+    return mat;
+}
+
+bool NCDMatrix::writeCSV(const string& path) const {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Error: Could not open output file for writing: " << path << endl;
+        return false;
+    }
+
+    size_t n = names.size();
+    out << "File";
+    for (const auto& name : names) {
+        out << "," << name;
+    }
+    out << "\n" << fixed << setprecision(6);
+    for (size_t i = 0; i < n; ++i) {
+        out << names[i];
+        for (size_t j = 0; j < n; ++j) {
+            out << "," << values[i * n + j];
+        }
+        out << "\n";
+    }
+
+    out.close();
+    if (!out) {
+        cerr << "Error: Could not write output file: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool NCDMatrix::writeBinary(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        cerr << "Error: Could not open output file for writing: " << path << endl;
+        return false;
+    }
+
+    vector<uint8_t> head = {'N', 'C', 'D', 'M', 'A', 'T', 0, 0};
+    auto put = [&head](uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) head.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    };
+    put(1, 4);
+    put(names.size(), 4);
+    for (const auto& name : names) {
+        put(name.size(), 2);
+        head.insert(head.end(), name.begin(), name.end());
+    }
+    head.resize((head.size() + 7) / 8 * 8, 0);
+    out.write(reinterpret_cast<const char*>(head.data()), head.size());
+
+    // One row at a time, as little-endian float64
+    size_t n = names.size();
+    vector<uint8_t> row(n * 8);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            uint64_t bits;
+            memcpy(&bits, &values[i * n + j], sizeof(bits));
+            for (int b = 0; b < 8; b++) row[j * 8 + b] = static_cast<uint8_t>(bits >> (8 * b));
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+
+    out.close();
+    if (!out) {
+        cerr << "Error: Could not write output file: " << path << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+#include "../../include/core/OutputWriter.h"
+#include "../../include/core/FeatureFile.h"
+#include "../../include/core/Metrics.h"
+#include "../../include/utils/CompressorWrapper.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+Metrics::Stage& writeStage = Metrics::stage("feature_write");
+Metrics::Counter& bytesCounter = Metrics::counter("feature_bytes_written");
+
+// Files taken off the queue at once by a writer thread
+const size_t batchSize = 16;
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}
+
+OutputWriter::OutputWriter(unsigned int threadCount, size_t queueSize)
+    : jobs(queueSize > 0 ? queueSize : 4 * (threadCount > 0 ? threadCount : 4)) {
+    if (threadCount == 0) threadCount = 4;
+    for (unsigned int t = 0; t < threadCount; t++) {
+        writers.emplace_back([this]() { run(); });
+    }
+}
+
+OutputWriter::~OutputWriter() {
+    finish();
+}
+
+bool OutputWriter::openPacked(const string& path, bool binary, const vector<string>& packCompressors) {
+    vector<string> sizeKeys;
+    for (const auto& compressor : packCompressors) {
+        sizeKeys.push_back(CompressorWrapper::sizeKey(compressor));
+    }
+    if (!pack.open(path, binary, sizeKeys)) {
+        return false;
+    }
+    compressors = packCompressors;
+    isPacked = true;
+    return true;
+}
+
+void OutputWriter::write(const string& path, Buffer data, Callback done) {
+    {
+        lock_guard<mutex> lock(pendingMutex);
+        pending++;
+    }
+    if (!jobs.push(Job{path, move(data), move(done), {}})) {
+        // Already finished: the file is lost
+        failed = true;
+        lock_guard<mutex> lock(pendingMutex);
+        pending--;
+    }
+}
+
+void OutputWriter::flush() {
+    unique_lock<mutex> lock(pendingMutex);
+    allDone.wait(lock, [this]() { return pending == 0; });
+}
+
+bool OutputWriter::finish() {
+    if (finished) {
+        return !failed;
+    }
+    finished = true;
+    jobs.close();
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    if (isPacked && !pack.finish()) {
+        failed = true;
+    }
+    return !failed;
+}
+
+void OutputWriter::sizeJob(Job& job) {
+    // Sizes of the NCD content (text, or the decoded values of a .featbin), as build_db stores
+    Buffer content;
+    job.sizes.assign(compressors.size(), 0);
+    if (!FeatureFile::contentOf(job.data, job.path, content)) {
+        return;
+    }
+    thread_local CompressorWrapper cw;
+    for (size_t k = 0; k < compressors.size(); k++) {
+        job.sizes[k] = cw.compressedSize(compressors[k], content);
+    }
+}
+
+void OutputWriter::run() {
+    vector<Job> batch;
+    vector<bool> results;
+    while (jobs.popBatch(batch, batchSize)) {
+        results.assign(batch.size(), false);
+        if (isPacked) {
+            // Compress in parallel, then append the whole batch under one lock
+            for (auto& job : batch) {
+                sizeJob(job);
+            }
+            lock_guard<mutex> lock(packMutex);
+            for (size_t i = 0; i < batch.size(); i++) {
+                Metrics::ScopedTimer timer(writeStage);
+                string name = filesystem::path(batch[i].path).filename().string();
+                results[i] = pack.add(name, batch[i].data.data(), batch[i].data.size(), batch[i].sizes);
+                if (results[i]) bytesCounter.add(batch[i].data.size());
+            }
+        } else {
+            for (size_t i = 0; i < batch.size(); i++) {
+                results[i] = writeFile(batch[i].path, batch[i].data.data(), batch[i].data.size());
+            }
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!results[i]) failed = true;
+            if (batch[i].done) batch[i].done(results[i]);
+        }
+        {
+            lock_guard<mutex> lock(pendingMutex);
+            pending -= batch.size();
+        }
+        allDone.notify_all();
+    }
+}
+
+bool OutputWriter::writeFile(const string& path, const uint8_t* data, size_t size) {
+    Metrics::ScopedTimer timer(writeStage);
+    string tempPath = path + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        cerr << "  Error: Could not open output file: " << tempPath << " (" << strerror(errno) << ")" << endl;
+        return false;
+    }
+    bool ok = writeAll(fd, data, size);
+    ok = ::close(fd) == 0 && ok;
+    if (!ok) {
+        cerr << "  Error: Could not write output file: " << tempPath << " (" << strerror(errno) << ")" << endl;
+        ::unlink(tempPath.c_str());
+        return false;
+    }
+    if (::rename(tempPath.c_str(), path.c_str()) != 0) {
+        cerr << "  Error: Could not rename " << tempPath << " to " << path << " (" << strerror(errno) << ")" << endl;
+        ::unlink(tempPath.c_str());
+        return false;
+    }
+    bytesCounter.add(size);
+    return true;
+}
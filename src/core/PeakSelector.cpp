@@ -0,0 +1,70 @@
+#include "../../include/core/PeakSelector.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Check that no bin within the spacing outranks bin i (ties go to the lower bin)
+ */
+inline bool isPeak(const double* magnitudes, int n, int first, int i, int spacing) {
+    double value = magnitudes[i];
+    for (int j = max(first, i - spacing); j < i; j++) {
+        if (magnitudes[j] >= value) return false;
+    }
+    for (int j = i + 1; j <= i + spacing && j < n; j++) {
+        if (magnitudes[j] > value) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Selection for large K: collect the candidates, then partially sort them
+ */
+int selectLarge(const double* magnitudes, int n, int first, int k, int spacing, int* out, vector<int>& scratch) {
+    scratch.clear();
+    for (int i = first; i < n; i++) {
+        if (spacing == 0 || isPeak(magnitudes, n, first, i, spacing)) scratch.push_back(i);
+    }
+    int count = min(k, static_cast<int>(scratch.size()));
+    partial_sort(scratch.begin(), scratch.begin() + count, scratch.end(), [magnitudes](int a, int b) {
+        return magnitudes[a] > magnitudes[b] || (magnitudes[a] == magnitudes[b] && a < b);
+    });
+    copy(scratch.begin(), scratch.begin() + count, out);
+    return count;
+}
+
+}
+
+namespace PeakSelector {
+
+int select(const double* magnitudes, int n, int first, int k, int spacing, int* out, vector<int>& scratch) {
+    if (k <= 0 || first >= n) {
+        return 0;
+    }
+    if (k > MAX_PEAKS) {
+        return selectLarge(magnitudes, n, first, k, spacing, out, scratch);
+    }
+
+    double values[MAX_PEAKS];
+    int count = 0;
+    for (int i = first; i < n; i++) {
+        double value = magnitudes[i];
+        // A later bin must be strictly stronger to displace the K-th
+        if (count == k && !(value > values[k - 1])) continue;
+        if (spacing > 0 && !isPeak(magnitudes, n, first, i, spacing)) continue;
+
+        int pos = count < k ? count++ : k - 1;
+        while (pos > 0 && values[pos - 1] < value) {
+            values[pos] = values[pos - 1];
+            out[pos] = out[pos - 1];
+            pos--;
+        }
+        values[pos] = value;
+        out[pos] = i;
+    }
+    return count;
+}
+
+}
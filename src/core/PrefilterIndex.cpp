@@ -0,0 +1,202 @@
+#include "../../include/core/PrefilterIndex.h"
+#include "../../include/core/FeatureFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+/**
+ * @brief Landmark token: 14 bits per peak bin and 4 bits of frame distance, so tokens
+ * are exact (no hash collisions) for frame sizes up to 32768
+ */
+uint32_t landmark(int first, int second, size_t distance) {
+    return (static_cast<uint32_t>(first) & 0x3FFF) << 18 |
+           (static_cast<uint32_t>(second) & 0x3FFF) << 4 |
+           (static_cast<uint32_t>(distance) & 0xF);
+}
+
+/**
+ * @brief Parse the frame lines of a text feature file (integers separated by spaces)
+ */
+bool textSignature(const Buffer& file, const string& name, vector<uint32_t>& tokens) {
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+
+    const char spectralTag[] = "# SpectralExtractor";
+    const char maxfreqTag[] = "# MaxFreqExtractor";
+    bool spectral;
+    if (file.size() >= sizeof(spectralTag) - 1 && memcmp(p, spectralTag, sizeof(spectralTag) - 1) == 0) {
+        spectral = true;
+    } else if (file.size() >= sizeof(maxfreqTag) - 1 && memcmp(p, maxfreqTag, sizeof(maxfreqTag) - 1) == 0) {
+        spectral = false;
+    } else {
+        cerr << "Error: Unknown feature file layout: " << name << endl;
+        return false;
+    }
+
+    PrefilterIndex::SignatureBuilder builder(spectral);
+    vector<float> values;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        if (*p != '#') {
+            values.clear();
+            const char* q = p;
+            while (q < lineEnd) {
+                while (q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+                if (q == lineEnd) break;
+                bool negative = *q == '-';
+                if (negative) q++;
+                long value = 0;
+                while (q < lineEnd && *q >= '0' && *q <= '9') value = value * 10 + (*q++ - '0');
+                // Skip a fractional part, if any
+                while (q < lineEnd && *q != ' ' && *q != '\t' && *q != '\r') q++;
+                values.push_back(static_cast<float>(negative ? -value : value));
+            }
+            if (!values.empty()) builder.addFrame(values);
+        }
+        p = lineEnd + 1;
+    }
+    tokens = builder.tokens();
+    return true;
+}
+
+}
+
+PrefilterIndex::SignatureBuilder::SignatureBuilder(bool spectral)
+    : spectral(spectral), recent(fanout) {}
+
+void PrefilterIndex::SignatureBuilder::addFrame(const float* values, size_t dims) {
+    peaks.clear();
+    if (spectral) {
+        // Strongest local maxima across the bins; the lower bin wins a tie
+        order.clear();
+        for (size_t i = 0; i < dims; i++) {
+            bool aboveLeft = i == 0 || values[i] > values[i - 1];
+            bool aboveRight = i + 1 == dims || values[i] >= values[i + 1];
+            if (aboveLeft && aboveRight) order.push_back(static_cast<int>(i));
+        }
+        size_t count = min(peaksPerSpectralFrame, order.size());
+        partial_sort(order.begin(), order.begin() + count, order.end(), [values](int a, int b) {
+            return values[a] > values[b] || (values[a] == values[b] && a < b);
+        });
+        peaks.assign(order.begin(), order.begin() + count);
+    } else {
+        for (size_t i = 0; i < dims; i++) {
+            peaks.push_back(static_cast<int>(lround(values[i])));
+        }
+    }
+
+    // Pair every earlier peak within the fanout with every peak of this frame
+    for (size_t distance = 1; distance <= fanout && distance <= framesAdded; distance++) {
+        const vector<int>& earlier = recent[(framesAdded - distance) % fanout];
+        for (int first : earlier) {
+            for (int second : peaks) {
+                collected.push_back(landmark(first, second, distance));
+            }
+        }
+    }
+    recent[framesAdded % fanout] = peaks;
+    framesAdded++;
+
+    // Stationary passages repeat the same landmarks; keep the list short as it grows
+    if (collected.size() >= 1 << 16) {
+        sort(collected.begin(), collected.end());
+        collected.erase(unique(collected.begin(), collected.end()), collected.end());
+        collected.reserve(collected.size() * 2);
+    }
+}
+
+vector<uint32_t> PrefilterIndex::SignatureBuilder::tokens() const {
+    vector<uint32_t> result(collected);
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+bool PrefilterIndex::signatureOf(const Buffer& file, const string& name, vector<uint32_t>& tokens) {
+    tokens.clear();
+    const char magic[] = "FEATBIN";
+    if (file.size() < sizeof(magic) || memcmp(file.data(), magic, sizeof(magic)) != 0) {
+        if (file.size() > 0 && file.data()[0] == '#') {
+            return textSignature(file, name, tokens);
+        }
+        cerr << "Error: Feature file has no frame layout (version 1 or unknown format): " << name << endl;
+        return false;
+    }
+
+    FeatureFile features;
+    if (!FeatureFile::load(file, name, features)) {
+        return false;
+    }
+    const FeatureFile::Info& info = features.info();
+    SignatureBuilder builder(info.method != "maxfreq");
+    vector<float> values;
+    features.decode(values);
+    for (size_t f = 0; f < info.frames; f++) {
+        builder.addFrame(values.data() + f * info.dims, info.dims);
+    }
+    tokens = builder.tokens();
+    return true;
+}
+
+void PrefilterIndex::build(const vector<vector<uint32_t>>& signatures) {
+    entryCount = signatures.size();
+
+    // (token, entry) pairs sorted by token, then grouped into posting lists
+    vector<uint64_t> pairs;
+    size_t total = 0;
+    for (const auto& signature : signatures) total += signature.size();
+    pairs.reserve(total);
+    for (size_t e = 0; e < signatures.size(); e++) {
+        for (uint32_t token : signatures[e]) {
+            pairs.push_back(static_cast<uint64_t>(token) << 32 | e);
+        }
+    }
+    sort(pairs.begin(), pairs.end());
+
+    tokens.clear();
+    firstPosting.clear();
+    postings.resize(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        uint32_t token = static_cast<uint32_t>(pairs[i] >> 32);
+        if (tokens.empty() || tokens.back() != token) {
+            tokens.push_back(token);
+            firstPosting.push_back(static_cast<uint32_t>(i));
+        }
+        postings[i] = static_cast<uint32_t>(pairs[i]);
+    }
+    firstPosting.push_back(static_cast<uint32_t>(postings.size()));
+}
+
+vector<size_t> PrefilterIndex::candidates(const vector<uint32_t>& query, size_t k) const {
+    vector<double> scores(entryCount, 0.0);
+    double n = static_cast<double>(entryCount);
+    for (uint32_t token : query) {
+        auto it = lower_bound(tokens.begin(), tokens.end(), token);
+        if (it == tokens.end() || *it != token) continue;
+        size_t t = it - tokens.begin();
+        uint32_t begin = firstPosting[t], end = firstPosting[t + 1];
+        // Landmarks found in every track carry no information
+        double weight = log(n / (end - begin));
+        if (weight <= 0.0) continue;
+        for (uint32_t i = begin; i < end; i++) {
+            scores[postings[i]] += weight;
+        }
+    }
+
+    vector<size_t> ranked;
+    for (size_t e = 0; e < entryCount; e++) {
+        if (scores[e] > 0.0) ranked.push_back(e);
+    }
+    size_t count = min(k, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [&scores](size_t a, size_t b) {
+        return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+    });
+    ranked.resize(count);
+    return ranked;
+}
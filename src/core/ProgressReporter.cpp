@@ -0,0 +1,55 @@
+#include "../../include/core/ProgressReporter.h"
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+ProgressReporter::ProgressReporter(const string& label, size_t total, double intervalSeconds)
+    : label(label), total(total),
+      interval(chrono::duration_cast<Clock::duration>(chrono::duration<double>(intervalSeconds))),
+      start(Clock::now()),
+      nextReport((start + interval).time_since_epoch().count()) {
+}
+
+void ProgressReporter::add(size_t count) {
+    size_t now = done += count;
+    Clock::rep due = nextReport.load(memory_order_relaxed);
+    Clock::rep tick = Clock::now().time_since_epoch().count();
+    if (tick < due) return;
+
+    // Only the worker that moves the deadline forward prints
+    if (!nextReport.compare_exchange_strong(due, tick + interval.count())) return;
+    unique_lock<mutex> lock(printMutex, try_to_lock);
+    if (lock.owns_lock() && !finished) {
+        print(now, false);
+    }
+}
+
+void ProgressReporter::finish() {
+    lock_guard<mutex> lock(printMutex);
+    if (finished) return;
+    finished = true;
+    print(done.load(), true);
+}
+
+void ProgressReporter::print(size_t count, bool last) {
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    double rate = elapsed > 0 ? count / elapsed : 0.0;
+    ios_base::fmtflags flags = cout.flags();
+    streamsize precision = cout.precision();
+
+    cout << label << ": " << count << "/" << total;
+    if (total > 0) {
+        cout << " (" << fixed << setprecision(1) << 100.0 * count / total << "%";
+        cout << ", " << setprecision(0) << rate << "/s";
+        if (!last && rate > 0) {
+            cout << ", " << setprecision(0) << (total - count) / rate << " s left";
+        } else if (last) {
+            cout << ", " << setprecision(1) << elapsed << " s";
+        }
+        cout << ")";
+    }
+    cout << (last ? "\n" : "    \r") << flush;
+    cout.flags(flags);
+    cout.precision(precision);
+}
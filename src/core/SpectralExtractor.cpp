@@ -1,84 +1,71 @@
 #include "../../include/core/SpectralExtractor.h"
-#include <complex>
+#include "../../include/core/FFTPlan.h"
+#include "../../include/core/Metrics.h"
 #include <cmath>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
 #include <numeric>
-#include <cstring>
 
 using namespace std;
 
-SpectralExtractor::SpectralExtractor(int bins) : numBins(bins) {
+namespace {
+
+Metrics::Stage& windowStage = Metrics::stage("spectral_window");
+Metrics::Stage& fftStage = Metrics::stage("spectral_fft");
+Metrics::Stage& binningStage = Metrics::stage("spectral_binning");
+Metrics::Stage& serializeStage = Metrics::stage("spectral_serialize");
+Metrics::Counter& framesCounter = Metrics::counter("spectral_frames");
+
+}
+
+SpectralExtractor::SpectralExtractor(int bins) : numBins(bins), kernels(&SpectralKernels::active()) {
     if (numBins <= 0) numBins = 32;  // Default to 32 frequency bins
 }
 
-void SpectralExtractor::computeFFT(const vector<int16_t>& frame, vector<double>& magnitudes) {
-    int N = frame.size();
-    vector<complex<double>> fft(N);
-    
-    // Initialize FFT input
-    for (int i = 0; i < N; i++) {
-        fft[i] = complex<double>(frame[i] / 32768.0, 0); // Normalize to [-1, 1]
+void SpectralExtractor::computeFFT(vector<float>& magnitudes) {
+    Metrics::ScopedTimer timer(fftStage);
+    int N = fftInput.size();
+    if (!plan || plan->size() != N) {
+        plan = FFTPlan::forSize(N);
     }
-    
-    // Cooley-Tukey FFT implementation (bit-reversal + butterfly)
-    // Bit reversal
-    int j = 0;
-    for (int i = 0; i < N-1; i++) {
-        if (i < j) {
-            swap(fft[i], fft[j]);
-        }
-        int k = N >> 1;
-        while (k <= j) {
-            j -= k;
-            k >>= 1;
-        }
-        j += k;
-    }
-    
-    // Butterfly computation
-    for (int step = 1; step < N; step <<= 1) {
-        double theta = -M_PI / step;  // Base angle
-        complex<double> w_m(cos(theta), sin(theta));  // Principal root of unity
-        
-        for (int m = 0; m < step; m++) {
-            complex<double> w(1, 0);  // Start with unity
-            
-            for (int i = m; i < N; i += 2*step) {
-                complex<double> t = w * fft[i + step];
-                complex<double> u = fft[i];
-                fft[i] = u + t;
-                fft[i + step] = u - t;
-                w *= w_m;  // Rotate by the principal root
-            }
-        }
-    }
-    
+
+    // Real-input transform of the windowed frame with the cached plan for this frame size
+    plan->forwardReal(fftInput.data(), spectrum);
+
     // Calculate magnitudes (only up to Nyquist frequency)
     // Use more frequency bins for better resolution
     int usefulBins = min(N/2, N/4 + numBins * 8); // Adaptive number of bins
     magnitudes.resize(usefulBins);
-    for (int i = 0; i < usefulBins; i++) {
-        magnitudes[i] = abs(fft[i]);
-    }
-    
-    // Apply logarithmic scaling for better perceptual representation
-    for (auto& mag : magnitudes) {
-        mag = log1p(mag); // log(1 + x) for numerical stability
+
+    // Apply logarithmic scaling for better perceptual representation: log(1 + |X|)
+    kernels->logMagnitude(spectrum.data(), magnitudes.data(), usefulBins);
+}
+
+void SpectralExtractor::applyWindow(const int16_t* frame, int size) {
+    Metrics::ScopedTimer timer(windowStage);
+    // Hann window function, cached per frame size; samples are normalized to [-1, 1]
+    if (!window || static_cast<int>(window->size()) != size) {
+        window = SpectralKernels::hannWindow(size);
     }
+    fftInput.resize(size);
+    kernels->window(frame, window->data(), 1.0 / 32768.0, fftInput.data(), size);
 }
 
-void SpectralExtractor::applyWindow(vector<int16_t>& frame) {
-    // Hann window function
-    const int size = frame.size();
-    for (int i = 0; i < size; i++) {
-        double window = 0.5 * (1.0 - cos(2.0 * M_PI * i / (size - 1)));
-        frame[i] = static_cast<int16_t>(frame[i] * window);
+void SpectralExtractor::applyWindow(const float* frame, int size) {
+    Metrics::ScopedTimer timer(windowStage);
+    if (!window || static_cast<int>(window->size()) != size) {
+        window = SpectralKernels::hannWindow(size);
     }
+    fftInput.resize(size);
+    kernels->windowFloat(frame, window->data(), 1.0 / 32768.0, fftInput.data(), size);
 }
 
-vector<double> SpectralExtractor::getBinnedSpectrum(const vector<double>& magnitudes) {
-    vector<double> binned(numBins, 0.0);
+const vector<float>& SpectralExtractor::getBinnedSpectrum(const vector<float>& magnitudes) {
+    Metrics::ScopedTimer timer(binningStage);
+    framesCounter.add();
+    vector<float>& binned = frameBins;
+    binned.assign(numBins, 0.0f);
     
     // Use linear frequency bins for better distribution and faster computation
     // Skip the DC component (i=0) and use only meaningful frequency range
@@ -93,20 +80,15 @@ vector<double> SpectralExtractor::getBinnedSpectrum(const vector<double>& magnit
         endIdx = min(endIdx, endBin);
         
         // Use RMS (energy)
-        double energy = 0.0;
-        int count = 0;
-        for (int i = startIdx; i < endIdx; i++) {
-            energy += magnitudes[i] * magnitudes[i];
-            count++;
-        }
-        
+        int count = endIdx - startIdx;
         if (count > 0) {
+            float energy = kernels->sumSquares(magnitudes.data() + startIdx, count);
             binned[bin] = sqrt(energy / count); // RMS value
         }
     }
     
     // Normalize to prevent overflow and improve NCD performance
-    double maxVal = *max_element(binned.begin(), binned.end());
+    float maxVal = *max_element(binned.begin(), binned.end());
     if (maxVal > 0) {
         for (auto& val : binned) {
             val /= maxVal;
@@ -133,28 +115,19 @@ string SpectralExtractor::extractFeatures(const vector<int16_t>& samples, int ch
     stringstream ss;
     
     // Header information
-    ss << "# SpectralExtractor features" << endl;
-    ss << "# Channels: " << channels << endl;
-    ss << "# Frame size: " << frameSize << endl;
-    ss << "# Hop size: " << hopSize << endl;
-    ss << "# Sample rate: " << sampleRate << endl;
-    ss << "# Frequency bins: " << numBins << endl;
+    ss << featureHeader(channels, frameSize, hopSize, sampleRate);
     
     // Process frames
-    vector<int16_t> frame(frameSize); // Pre-allocate frame buffer
+    vector<float> magnitudes; // Reused between frames
     for (size_t i = 0; i + frameSize <= monoSamples.size(); i += hopSize) {
-        // Copy frame data (more efficient than creating new vector)
-        memcpy(frame.data(), &monoSamples[i], frameSize * sizeof(int16_t));
-        
-        // Apply window function
-        applyWindow(frame);
+        // Apply window function (straight from the sample buffer)
+        applyWindow(&monoSamples[i], frameSize);
         
         // Compute FFT
-        vector<double> magnitudes;
-        computeFFT(frame, magnitudes);
+        computeFFT(magnitudes);
         
         // Get binned spectrum
-        vector<double> bins = getBinnedSpectrum(magnitudes);
+        const vector<float>& bins = getBinnedSpectrum(magnitudes);
         
         // Output binned spectrum
         for (size_t j = 0; j < bins.size(); j++) {
@@ -181,15 +154,72 @@ std::vector<std::vector<float>> SpectralExtractor::extractFeaturesBinary(const s
         monoSamples = samples;
     }
     std::vector<std::vector<float>> features;
-    std::vector<int16_t> frame(frameSize);
+    std::vector<float> magnitudes;
     for (size_t i = 0; i + frameSize <= monoSamples.size(); i += hopSize) {
-        memcpy(frame.data(), &monoSamples[i], frameSize * sizeof(int16_t));
-        applyWindow(frame);
-        std::vector<double> magnitudes;
-        computeFFT(frame, magnitudes);
-        std::vector<double> bins = getBinnedSpectrum(magnitudes);
-        std::vector<float> binsFloat(bins.begin(), bins.end());
-        features.push_back(binsFloat);
+        applyWindow(&monoSamples[i], frameSize);
+        computeFFT(magnitudes);
+        features.push_back(getBinnedSpectrum(magnitudes));
     }
     return features;
-}
\ No newline at end of file
+}
+
+string SpectralExtractor::featureHeader(int channels, int frameSize, int hopSize, int sampleRate) const {
+    stringstream ss;
+    ss << "# SpectralExtractor features" << endl;
+    ss << "# Channels: " << channels << endl;
+    ss << "# Frame size: " << frameSize << endl;
+    ss << "# Hop size: " << hopSize << endl;
+    ss << "# Sample rate: " << sampleRate << endl;
+    ss << "# Frequency bins: " << numBins << endl;
+    return ss.str();
+}
+
+const vector<float>& SpectralExtractor::extractFrameValues(const float* frame, int frameSize) {
+    applyWindow(frame, frameSize);
+    computeFFT(frameMagnitudes);
+    return getBinnedSpectrum(frameMagnitudes);
+}
+
+vector<float> SpectralExtractor::extractFrameBinary(const float* frame, int frameSize) {
+    return extractFrameValues(frame, frameSize);
+}
+
+void SpectralExtractor::appendBins(const vector<float>& bins, string& out) {
+    char digits[16];
+    for (size_t j = 0; j < bins.size(); j++) {
+        if (j > 0) out += ' ';
+        // Use fixed-point representation
+        char* end = to_chars(digits, digits + sizeof(digits), static_cast<int>(bins[j] * 10000)).ptr;
+        out.append(digits, end);
+    }
+}
+
+string SpectralExtractor::extractFrame(const float* frame, int frameSize) {
+    const vector<float>& bins = extractFrameValues(frame, frameSize);
+    Metrics::ScopedTimer timer(serializeStage);
+    string line;
+    appendBins(bins, line);
+    return line;
+}
+
+void SpectralExtractor::appendFrame(const float* frame, int frameSize, string& out) {
+    const vector<float>& bins = extractFrameValues(frame, frameSize);
+    Metrics::ScopedTimer timer(serializeStage);
+    appendBins(bins, out);
+    out += '\n';
+}
+
+string SpectralExtractor::extractFeatures(WAVStream& stream, int frameSize, int hopSize) {
+    if (!stream.setFraming(frameSize, hopSize)) {
+        return "";
+    }
+
+    string text = featureHeader(stream.getChannels(), frameSize, hopSize, stream.getSampleRate());
+    // Up to 5 digits and a separator per bin
+    text.reserve(text.size() + stream.analysisFrames(frameSize, hopSize) * numBins * 6);
+    const float* frame;
+    while (stream.nextFrame(frame)) {
+        appendFrame(frame, frameSize, text);
+    }
+    return text;
+}
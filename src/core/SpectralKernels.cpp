@@ -0,0 +1,360 @@
+#include "../../include/core/SpectralKernels.h"
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SPECTRAL_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#define SPECTRAL_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// log(1 + v) for v >= 0: split 1 + v into exponent and mantissa in [sqrt(1/2), sqrt(2)) and
+// evaluate the Cephes logf polynomial on the mantissa. Every kernel uses these constants in
+// the same order of operations.
+constexpr float SQRT_HALF = 0.707106781186547524f;
+constexpr float LOG_C[9] = {
+    7.0376836292E-2f, -1.1514610310E-1f, 1.1676998740E-1f,
+    -1.2420140846E-1f, 1.4249322787E-1f, -1.6668057665E-1f,
+    2.0000714765E-1f, -2.4999993993E-1f, 3.3333331174E-1f
+};
+constexpr float LOG_Q1 = -2.12194440e-4f;
+constexpr float LOG_Q2 = 0.693359375f;
+
+// Sums of squares are accumulated in this many interleaved lanes (one AVX2 register)
+constexpr size_t LANES = 8;
+
+float log1pScalar(float v) {
+    float x = 1.0f + v;
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int32_t e = static_cast<int32_t>((bits >> 23) & 0xff) - 126;
+    bits = (bits & 0x807fffffu) | 0x3f000000u;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    float ef = static_cast<float>(e);
+    float low = 0.0f;
+    if (m < SQRT_HALF) {
+        ef = ef - 1.0f;
+        low = m;
+    }
+    m = (m - 1.0f) + low;
+
+    float z = m * m;
+    float y = LOG_C[0];
+    for (int c = 1; c < 9; c++) {
+        y = y * m + LOG_C[c];
+    }
+    y = y * m;
+    y = y * z;
+    y = y + ef * LOG_Q1;
+    y = y - z * 0.5f;
+    float result = m + y;
+    return result + ef * LOG_Q2;
+}
+
+void windowScalar(const int16_t* samples, const float* window, double scale, double* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float product = static_cast<float>(samples[i]) * window[i];
+        out[i] = static_cast<double>(static_cast<int32_t>(product)) * scale;
+    }
+}
+
+void windowFloatScalar(const float* samples, const float* window, double scale, double* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float product = samples[i] * window[i];
+        out[i] = static_cast<double>(static_cast<int32_t>(product)) * scale;
+    }
+}
+
+void logMagnitudeScalar(const complex<double>* spectrum, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        double re = spectrum[i].real();
+        double im = spectrum[i].imag();
+        float power = static_cast<float>(re * re + im * im);
+        out[i] = log1pScalar(sqrtf(power));
+    }
+}
+
+float sumSquaresScalar(const float* values, size_t n) {
+    float lanes[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            lanes[l] = lanes[l] + values[i + l] * values[i + l];
+        }
+    }
+    float total = 0.0f;
+    for (size_t l = 0; l < LANES; l++) {
+        total += lanes[l];
+    }
+    for (; i < n; i++) {
+        total += values[i] * values[i];
+    }
+    return total;
+}
+
+const SpectralKernels::Kernels SCALAR_KERNELS = {
+    "scalar", windowScalar, windowFloatScalar, logMagnitudeScalar, sumSquaresScalar
+};
+
+#ifdef SPECTRAL_KERNELS_AVX2
+
+__attribute__((target("avx2")))
+__m256 log1pAvx2(__m256 v) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 x = _mm256_add_ps(v, one);
+    __m256i bits = _mm256_castps_si256(x);
+    __m256i e = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xff)),
+                                 _mm256_set1_epi32(126));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(static_cast<int>(0x807fffffu))),
+                           _mm256_set1_epi32(0x3f000000));
+    __m256 m = _mm256_castsi256_ps(bits);
+
+    __m256 ef = _mm256_cvtepi32_ps(e);
+    __m256 mask = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    ef = _mm256_sub_ps(ef, _mm256_and_ps(mask, one));
+    m = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(mask, m));
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(LOG_C[0]);
+    for (int c = 1; c < 9; c++) {
+        y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(LOG_C[c]));
+    }
+    y = _mm256_mul_ps(y, m);
+    y = _mm256_mul_ps(y, z);
+    y = _mm256_add_ps(y, _mm256_mul_ps(ef, _mm256_set1_ps(LOG_Q1)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+    __m256 result = _mm256_add_ps(m, y);
+    return _mm256_add_ps(result, _mm256_mul_ps(ef, _mm256_set1_ps(LOG_Q2)));
+}
+
+__attribute__((target("avx2")))
+void windowAvx2(const int16_t* samples, const float* window, double scale, double* out, size_t n) {
+    const __m256d scaleVec = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        __m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s16));
+        __m256i truncated = _mm256_cvttps_epi32(_mm256_mul_ps(s, _mm256_loadu_ps(window + i)));
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(truncated));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(truncated, 1));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(lo, scaleVec));
+        _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(hi, scaleVec));
+    }
+    windowScalar(samples + i, window + i, scale, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void windowFloatAvx2(const float* samples, const float* window, double scale, double* out, size_t n) {
+    const __m256d scaleVec = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s = _mm256_loadu_ps(samples + i);
+        __m256i truncated = _mm256_cvttps_epi32(_mm256_mul_ps(s, _mm256_loadu_ps(window + i)));
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(truncated));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(truncated, 1));
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(lo, scaleVec));
+        _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(hi, scaleVec));
+    }
+    windowFloatScalar(samples + i, window + i, scale, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+__m128 powerAvx2(const complex<double>* spectrum) {
+    // [re0 im0 re1 im1] and [re2 im2 re3 im3] -> hadd gives [p0 p2 p1 p3]
+    const double* d = reinterpret_cast<const double*>(spectrum);
+    __m256d a = _mm256_loadu_pd(d);
+    __m256d b = _mm256_loadu_pd(d + 4);
+    __m256d sums = _mm256_hadd_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+    return _mm256_cvtpd_ps(_mm256_permute4x64_pd(sums, 0xd8));
+}
+
+__attribute__((target("avx2")))
+void logMagnitudeAvx2(const complex<double>* spectrum, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 power = _mm256_set_m128(powerAvx2(spectrum + i + 4), powerAvx2(spectrum + i));
+        _mm256_storeu_ps(out + i, log1pAvx2(_mm256_sqrt_ps(power)));
+    }
+    logMagnitudeScalar(spectrum + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+float sumSquaresAvx2(const float* values, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        __m256 v = _mm256_loadu_ps(values + i);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(v, v));
+    }
+    float lanes[LANES];
+    _mm256_storeu_ps(lanes, acc);
+    float total = 0.0f;
+    for (size_t l = 0; l < LANES; l++) {
+        total += lanes[l];
+    }
+    for (; i < n; i++) {
+        total += values[i] * values[i];
+    }
+    return total;
+}
+
+const SpectralKernels::Kernels AVX2_KERNELS = {
+    "avx2", windowAvx2, windowFloatAvx2, logMagnitudeAvx2, sumSquaresAvx2
+};
+
+#endif
+
+#ifdef SPECTRAL_KERNELS_NEON
+
+float32x4_t log1pNeon(float32x4_t v) {
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t x = vaddq_f32(v, one);
+    uint32x4_t bits = vreinterpretq_u32_f32(x);
+    int32x4_t e = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(bits, 23), vdupq_n_u32(0xff))),
+                            vdupq_n_s32(126));
+    bits = vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x807fffffu)), vdupq_n_u32(0x3f000000u));
+    float32x4_t m = vreinterpretq_f32_u32(bits);
+
+    float32x4_t ef = vcvtq_f32_s32(e);
+    uint32x4_t mask = vcltq_f32(m, vdupq_n_f32(SQRT_HALF));
+    ef = vsubq_f32(ef, vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(one))));
+    m = vaddq_f32(vsubq_f32(m, one), vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(m))));
+
+    float32x4_t z = vmulq_f32(m, m);
+    float32x4_t y = vdupq_n_f32(LOG_C[0]);
+    for (int c = 1; c < 9; c++) {
+        y = vaddq_f32(vmulq_f32(y, m), vdupq_n_f32(LOG_C[c]));
+    }
+    y = vmulq_f32(y, m);
+    y = vmulq_f32(y, z);
+    y = vaddq_f32(y, vmulq_f32(ef, vdupq_n_f32(LOG_Q1)));
+    y = vsubq_f32(y, vmulq_f32(z, vdupq_n_f32(0.5f)));
+    float32x4_t result = vaddq_f32(m, y);
+    return vaddq_f32(result, vmulq_f32(ef, vdupq_n_f32(LOG_Q2)));
+}
+
+void windowNeon(const int16_t* samples, const float* window, double scale, double* out, size_t n) {
+    const float64x2_t scaleVec = vdupq_n_f64(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t s16 = vld1q_s16(samples + i);
+        float32x4_t s[2] = {vcvtq_f32_s32(vmovl_s16(vget_low_s16(s16))),
+                            vcvtq_f32_s32(vmovl_high_s16(s16))};
+        for (int h = 0; h < 2; h++) {
+            int32x4_t truncated = vcvtq_s32_f32(vmulq_f32(s[h], vld1q_f32(window + i + 4 * h)));
+            float32x4_t t = vcvtq_f32_s32(truncated);
+            vst1q_f64(out + i + 4 * h, vmulq_f64(vcvt_f64_f32(vget_low_f32(t)), scaleVec));
+            vst1q_f64(out + i + 4 * h + 2, vmulq_f64(vcvt_high_f64_f32(t), scaleVec));
+        }
+    }
+    windowScalar(samples + i, window + i, scale, out + i, n - i);
+}
+
+void windowFloatNeon(const float* samples, const float* window, double scale, double* out, size_t n) {
+    const float64x2_t scaleVec = vdupq_n_f64(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32x4_t truncated = vcvtq_s32_f32(vmulq_f32(vld1q_f32(samples + i), vld1q_f32(window + i)));
+        float32x4_t t = vcvtq_f32_s32(truncated);
+        vst1q_f64(out + i, vmulq_f64(vcvt_f64_f32(vget_low_f32(t)), scaleVec));
+        vst1q_f64(out + i + 2, vmulq_f64(vcvt_high_f64_f32(t), scaleVec));
+    }
+    windowFloatScalar(samples + i, window + i, scale, out + i, n - i);
+}
+
+float32x2_t powerNeon(const complex<double>* spectrum) {
+    float64x2x2_t v = vld2q_f64(reinterpret_cast<const double*>(spectrum));
+    float64x2_t power = vaddq_f64(vmulq_f64(v.val[0], v.val[0]), vmulq_f64(v.val[1], v.val[1]));
+    return vcvt_f32_f64(power);
+}
+
+void logMagnitudeNeon(const complex<double>* spectrum, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t power = vcombine_f32(powerNeon(spectrum + i), powerNeon(spectrum + i + 2));
+        vst1q_f32(out + i, log1pNeon(vsqrtq_f32(power)));
+    }
+    logMagnitudeScalar(spectrum + i, out + i, n - i);
+}
+
+float sumSquaresNeon(const float* values, size_t n) {
+    float32x4_t acc[2] = {vdupq_n_f32(0.0f), vdupq_n_f32(0.0f)};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int h = 0; h < 2; h++) {
+            float32x4_t v = vld1q_f32(values + i + 4 * h);
+            acc[h] = vaddq_f32(acc[h], vmulq_f32(v, v));
+        }
+    }
+    float lanes[LANES];
+    vst1q_f32(lanes, acc[0]);
+    vst1q_f32(lanes + 4, acc[1]);
+    float total = 0.0f;
+    for (size_t l = 0; l < LANES; l++) {
+        total += lanes[l];
+    }
+    for (; i < n; i++) {
+        total += values[i] * values[i];
+    }
+    return total;
+}
+
+const SpectralKernels::Kernels NEON_KERNELS = {
+    "neon", windowNeon, windowFloatNeon, logMagnitudeNeon, sumSquaresNeon
+};
+
+#endif
+
+const SpectralKernels::Kernels& detectKernels() {
+#ifdef SPECTRAL_KERNELS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2_KERNELS;
+    }
+#endif
+#ifdef SPECTRAL_KERNELS_NEON
+    return NEON_KERNELS;
+#endif
+    return SCALAR_KERNELS;
+}
+
+mutex windowsMutex;
+
+}
+
+namespace SpectralKernels {
+
+const Kernels& active() {
+    static const Kernels& kernels = detectKernels();
+    return kernels;
+}
+
+const Kernels& scalar() {
+    return SCALAR_KERNELS;
+}
+
+shared_ptr<const vector<float>> hannWindow(int size) {
+    static map<int, shared_ptr<const vector<float>>> windows;
+    lock_guard<mutex> lock(windowsMutex);
+    auto& window = windows[size];
+    if (!window) {
+        vector<float> w(max(size, 0), 1.0f);
+        for (int i = 0; size > 1 && i < size; i++) {
+            w[i] = static_cast<float>(0.5 * (1.0 - cos(2.0 * M_PI * i / (size - 1))));
+        }
+        window = make_shared<const vector<float>>(move(w));
+    }
+    return window;
+}
+
+}
@@ -0,0 +1,91 @@
+#include "../../include/core/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    unsigned int count = threadCountFor(threadCount);
+    workers.reserve(count);
+    for (unsigned int w = 0; w < count; w++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, w);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+unsigned int ThreadPool::threadCountFor(unsigned int requested, size_t jobs) {
+    unsigned int count = requested > 0 ? requested : thread::hardware_concurrency();
+    if (count == 0) count = 2;  // Default if detection fails
+    if (jobs > 0 && jobs < count) count = static_cast<unsigned int>(jobs);
+    return count;
+}
+
+void ThreadPool::submit(function<void(unsigned int worker)> task) {
+    {
+        lock_guard<mutex> lock(mtx);
+        tasks.push_back(move(task));
+        pending++;
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lock(mtx);
+    allDone.wait(lock, [this]() { return pending == 0; });
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t index, unsigned int worker)>& body) {
+    if (count == 0) return;
+
+    // One task per worker, each pulling the next index until none are left
+    atomic<size_t> next(0);
+    size_t remaining = min<size_t>(count, workers.size());
+    mutex doneMutex;
+    condition_variable done;
+
+    size_t tasksToStart = remaining;
+    for (size_t t = 0; t < tasksToStart; t++) {
+        submit([&](unsigned int worker) {
+            for (size_t i = next++; i < count; i = next++) {
+                body(i, worker);
+            }
+            lock_guard<mutex> lock(doneMutex);
+            if (--remaining == 0) done.notify_one();
+        });
+    }
+
+    unique_lock<mutex> lock(doneMutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+}
+
+void ThreadPool::workerLoop(unsigned int worker) {
+    while (true) {
+        function<void(unsigned int)> task;
+        {
+            unique_lock<mutex> lock(mtx);
+            taskReady.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;  // Stopping and drained
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task(worker);
+
+        bool idle;
+        {
+            lock_guard<mutex> lock(mtx);
+            idle = --pending == 0;
+        }
+        if (idle) allDone.notify_all();
+    }
+}
@@ -0,0 +1,58 @@
+#include "../../include/core/TopK.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+// Orders entries from best to worst; used as the heap comparator so the root is the worst kept
+bool better(const pair<string, double>& a, const pair<string, double>& b) {
+    if (a.second != b.second) return a.second < b.second;
+    return a.first < b.first;
+}
+
+}
+
+TopK::TopK(size_t k) : k(k) {
+    if (k > 0) heap.reserve(k);
+}
+
+void TopK::push(const string& name, double score) {
+    if (k == 0 || heap.size() < k) {
+        heap.emplace_back(name, score);
+        push_heap(heap.begin(), heap.end(), better);
+        return;
+    }
+
+    pair<string, double> candidate(name, score);
+    if (!better(candidate, heap.front())) {
+        return;
+    }
+    pop_heap(heap.begin(), heap.end(), better);
+    heap.back() = move(candidate);
+    push_heap(heap.begin(), heap.end(), better);
+}
+
+void TopK::merge(const TopK& other) {
+    for (const auto& entry : other.heap) {
+        push(entry.first, entry.second);
+    }
+}
+
+bool TopK::accepts(double score) const {
+    return k == 0 || heap.size() < k || score <= heap.front().second;
+}
+
+double TopK::threshold() const {
+    if (k == 0 || heap.size() < k) {
+        return numeric_limits<double>::infinity();
+    }
+    return heap.front().second;
+}
+
+vector<pair<string, double>> TopK::sorted() const {
+    vector<pair<string, double>> result(heap);
+    sort(result.begin(), result.end(), better);
+    return result;
+}
@@ -1,4 +1,5 @@
 #include "../../include/core/WAVReader.h"
+#include "../../include/core/Metrics.h"
 #include <fstream>
 #include <iostream>
 #include <string.h>
@@ -6,7 +7,14 @@
 
 using namespace std;
 
+namespace {
+
+Metrics::Stage& loadStage = Metrics::stage("wav_load");
+
+}
+
 bool WAVReader::load(const string& filename) {
+    Metrics::ScopedTimer timer(loadStage);
     ifstream in(filename, ios::binary);
     if (!in) {
         cerr << "Failed to open WAV file: " << filename << endl;
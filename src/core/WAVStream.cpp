@@ -0,0 +1,429 @@
+#include "../../include/core/WAVStream.h"
+#include "../../include/core/Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Bytes of the data chunk read per fill(), rounded down to whole sample frames
+constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+Metrics::Stage& openStage = Metrics::stage("wav_open");
+Metrics::Stage& readStage = Metrics::stage("wav_read");
+Metrics::Stage& decodeStage = Metrics::stage("wav_decode");
+Metrics::Counter& bytesCounter = Metrics::counter("wav_bytes_read");
+
+uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Integer sample value for 8/16-bit PCM, in the 16-bit range
+int32_t decodeInt16Range(const uint8_t* p, int bitsPerSample) {
+    if (bitsPerSample == 8) {
+        return (static_cast<int32_t>(p[0]) - 128) * 256;  // Unsigned 8-bit, scaled to 16-bit
+    }
+    return static_cast<int16_t>(readU16(p));
+}
+
+}
+
+WAVStream::~WAVStream() {
+    closeFd();
+}
+
+void WAVStream::closeFd() {
+    if (ownsFd && fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+    ownsFd = false;
+}
+
+void WAVStream::reset() {
+    closeFd();
+    seekable = false;
+    unbounded = false;
+    samplerate = 0;
+    channels = 0;
+    bitsPerSample = 0;
+    isFloat = false;
+    blockAlign = 0;
+    dataStart = 0;
+    dataBytes = 0;
+    bytesRead = 0;
+    readError = false;
+    endOfInput = false;
+    frameSize = 0;
+    hopSize = 0;
+    started = false;
+    block.clear();
+    pending.clear();
+    frameStart = 0;
+}
+
+bool WAVStream::open(const string& filename, bool verbose) {
+    Metrics::ScopedTimer timer(openStage);
+    reset();
+    path = filename;
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Failed to open WAV file: " << filename << endl;
+        return false;
+    }
+    ownsFd = true;
+
+    struct stat st;
+    seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    uint8_t riff[12];
+    if (!readExact(riff, sizeof(riff)) || !parseHeader(riff)) {
+        cerr << "Failed to parse WAV header: " << filename << endl;
+        return false;
+    }
+    if (verbose) cout << describe() << flush;
+    return true;
+}
+
+bool WAVStream::openFd(int inputFd, int rawSampleRate, int rawChannels, int rawBitsPerSample) {
+    reset();
+    path = "<stream>";
+    fd = inputFd;
+
+    struct stat st;
+    seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    // Sniff for a RIFF header; otherwise the bytes already read are the first samples
+    uint8_t riff[12];
+    size_t got = 0;
+    while (got < 4 && !readError) {
+        size_t n = readSome(riff + got, 4 - got);
+        if (n == 0) break;
+        got += n;
+    }
+    if (readError) {
+        return false;
+    }
+
+    if (got == 4 && memcmp(riff, "RIFF", 4) == 0) {
+        if (!readExact(riff + 4, 8) || !parseHeader(riff)) {
+            cerr << "Failed to parse WAV header: " << path << endl;
+            return false;
+        }
+    } else {
+        samplerate = rawSampleRate;
+        channels = rawChannels;
+        bitsPerSample = rawBitsPerSample;
+        if (!validateFormat()) {
+            return false;
+        }
+        unbounded = true;
+        block.assign(riff, riff + got);
+        bytesRead = got;
+        if (seekable) {
+            dataStart = lseek(fd, 0, SEEK_CUR) - static_cast<int64_t>(got);
+        }
+    }
+    cout << describe() << flush;
+    return true;
+}
+
+string WAVStream::describe() const {
+    string info = "Loaded WAV file: " + path + "\n";
+    info += "  Sample rate: " + to_string(samplerate) + " Hz\n";
+    info += "  Channels: " + to_string(channels) + "\n";
+    info += "  Bits per sample: " + to_string(bitsPerSample) + "\n";
+    if (unbounded) {
+        info += "  Total samples: unknown (live input)\n";
+    } else {
+        info += "  Total samples: " + to_string(frameCount() * channels) + "\n";
+    }
+    return info;
+}
+
+void WAVStream::prefetch() const {
+    if (fd >= 0 && seekable && bytesRead < dataBytes) {
+        posix_fadvise(fd, dataStart + static_cast<int64_t>(bytesRead), dataBytes - bytesRead, POSIX_FADV_WILLNEED);
+    }
+}
+
+size_t WAVStream::readSome(uint8_t* buffer, size_t size) {
+    while (true) {
+        ssize_t n = ::read(fd, buffer, size);
+        if (n >= 0) {
+            return static_cast<size_t>(n);
+        }
+        if (errno != EINTR) {
+            cerr << "Error reading WAV data: " << path << ": " << strerror(errno) << endl;
+            readError = true;
+            return 0;
+        }
+    }
+}
+
+bool WAVStream::readExact(uint8_t* buffer, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        size_t n = readSome(buffer + got, size - got);
+        if (n == 0) return false;
+        got += n;
+    }
+    return true;
+}
+
+bool WAVStream::skipBytes(size_t size) {
+    if (seekable) {
+        return lseek(fd, static_cast<off_t>(size), SEEK_CUR) >= 0;
+    }
+    uint8_t scratch[4096];
+    while (size > 0) {
+        size_t n = readSome(scratch, min(size, sizeof(scratch)));
+        if (n == 0) return false;
+        size -= n;
+    }
+    return true;
+}
+
+bool WAVStream::validateFormat() {
+    if (channels < 1) {
+        cerr << "Invalid number of channels: " << channels << endl;
+        return false;
+    }
+    if (bitsPerSample != 8 && bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32) {
+        cerr << "Unsupported bits per sample: " << bitsPerSample << endl;
+        return false;
+    }
+    if (isFloat && bitsPerSample != 32) {
+        cerr << "Unsupported float sample size: " << bitsPerSample << endl;
+        return false;
+    }
+    blockAlign = static_cast<size_t>(channels) * (bitsPerSample / 8);
+    return true;
+}
+
+bool WAVStream::parseHeader(const uint8_t* riff) {
+    if (memcmp(riff, "RIFF", 4) != 0) {
+        cerr << "Not a RIFF file" << endl;
+        return false;
+    }
+    if (memcmp(riff + 8, "WAVE", 4) != 0) {
+        cerr << "Not a WAVE file" << endl;
+        return false;
+    }
+
+    // fmt and data chunks can be in any order; stop at the data chunk once fmt is known
+    bool foundFmt = false;
+    while (true) {
+        uint8_t header[8];
+        if (!readExact(header, sizeof(header))) {
+            cerr << (foundFmt ? "No data chunk found" : "No format chunk found") << endl;
+            return false;
+        }
+        uint32_t chunkSize = readU32(header + 4);
+
+        if (memcmp(header, "fmt ", 4) == 0) {
+            vector<uint8_t> fmt(max<uint32_t>(chunkSize, 16));
+            if (chunkSize < 16 || !readExact(fmt.data(), chunkSize)) {
+                cerr << "Error reading format chunk" << endl;
+                return false;
+            }
+            if (chunkSize & 1) skipBytes(1);
+            foundFmt = true;
+
+            // Audio format (1 = PCM, 3 = IEEE float, 0xFFFE = extensible, with the real
+            // format in the first two bytes of the sub-format GUID)
+            uint16_t audioFormat = readU16(fmt.data());
+            if (audioFormat == 0xFFFE && chunkSize >= 26) {
+                audioFormat = readU16(fmt.data() + 24);
+            }
+            channels = readU16(fmt.data() + 2);
+            samplerate = static_cast<int>(readU32(fmt.data() + 4));
+            bitsPerSample = readU16(fmt.data() + 14);
+            isFloat = audioFormat == 3;
+
+            if (audioFormat != 1 && !isFloat) {
+                // Try to continue anyway - some files report wrong format
+                cout << "Note: Non-PCM format detected (" << audioFormat << "), attempting to read anyway" << endl;
+            }
+            if (!validateFormat()) {
+                return false;
+            }
+        } else if (memcmp(header, "data", 4) == 0) {
+            if (!foundFmt) {
+                cerr << "Data chunk found before format chunk" << endl;
+                return false;
+            }
+            if (seekable) {
+                // Truncated files: only decode what is actually there
+                dataStart = lseek(fd, 0, SEEK_CUR);
+                int64_t fileSize = lseek(fd, 0, SEEK_END);
+                lseek(fd, dataStart, SEEK_SET);
+                dataBytes = min<size_t>(chunkSize, static_cast<size_t>(max<int64_t>(fileSize - dataStart, 0)));
+            } else if (chunkSize == 0 || chunkSize == 0xFFFFFFFFu) {
+                // Streamed WAV (e.g. ffmpeg -f wav -) does not know its length up front
+                unbounded = true;
+            } else {
+                dataBytes = chunkSize;
+            }
+            dataBytes -= dataBytes % blockAlign;
+            return true;
+        } else {
+            // Skip unknown chunk (chunks are padded to an even size)
+            if (!skipBytes(static_cast<size_t>(chunkSize) + (chunkSize & 1))) {
+                cerr << "Error skipping chunk" << endl;
+                return false;
+            }
+        }
+    }
+}
+
+bool WAVStream::setFraming(int newFrameSize, int newHopSize) {
+    if (newFrameSize <= 0 || newHopSize <= 0) {
+        cerr << "Invalid frame size (" << newFrameSize << ") or hop size (" << newHopSize << ")" << endl;
+        return false;
+    }
+    if (fd < 0) {
+        cerr << "Error: WAV stream is not open" << endl;
+        return false;
+    }
+
+    if (seekable) {
+        if (lseek(fd, dataStart, SEEK_SET) < 0) {
+            cerr << "Error seeking in WAV file: " << path << endl;
+            return false;
+        }
+        bytesRead = 0;
+        block.clear();
+        endOfInput = false;
+        readError = false;
+    } else if (started) {
+        cerr << "Error: Live input cannot be restarted" << endl;
+        return false;
+    }
+
+    frameSize = newFrameSize;
+    hopSize = newHopSize;
+    started = false;
+    pending.clear();
+    frameStart = 0;
+    return true;
+}
+
+bool WAVStream::fill() {
+    if (readError) {
+        return false;
+    }
+
+    if (!endOfInput) {
+        size_t limit = max(BLOCK_BYTES / blockAlign, size_t(1)) * blockAlign;
+        if (!unbounded) {
+            limit = min(limit, dataBytes - bytesRead);
+        }
+        if (limit == 0) {
+            endOfInput = true;
+        } else {
+            // Live input returns whatever has arrived, which keeps latency at one read
+            size_t carry = block.size();
+            block.resize(carry + limit);
+            size_t got;
+            {
+                Metrics::ScopedTimer timer(readStage);
+                got = readSome(block.data() + carry, limit);
+            }
+            bytesCounter.add(got);
+            block.resize(carry + got);
+            bytesRead += got;
+            if (readError) {
+                return false;
+            }
+            if (got == 0) {
+                endOfInput = true;
+            }
+        }
+    }
+
+    size_t count = block.size() / blockAlign;
+    if (count == 0) {
+        // Only part of a sample frame so far: read again unless the input is over
+        return !endOfInput;
+    }
+    decode(block.data(), count);
+    block.erase(block.begin(), block.begin() + count * blockAlign);
+    return true;
+}
+
+void WAVStream::decode(const uint8_t* p, size_t count) {
+    Metrics::ScopedTimer timer(decodeStage);
+    const size_t bytesPerSample = bitsPerSample / 8;
+    const size_t base = pending.size();
+    pending.resize(base + count);
+
+    if (bitsPerSample <= 16) {
+        for (size_t i = 0; i < count; i++, p += blockAlign) {
+            int32_t sum = 0;
+            for (int c = 0; c < channels; c++) {
+                sum += decodeInt16Range(p + c * bytesPerSample, bitsPerSample);
+            }
+            pending[base + i] = static_cast<float>(sum / channels);
+        }
+    } else {
+        const float mix = 1.0f / channels;
+        for (size_t i = 0; i < count; i++, p += blockAlign) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                sum += decodeSample(p + c * bytesPerSample);
+            }
+            pending[base + i] = channels == 1 ? sum : sum * mix;
+        }
+    }
+}
+
+float WAVStream::decodeSample(const uint8_t* p) const {
+    if (bitsPerSample == 24) {
+        int32_t sample = static_cast<int32_t>(p[0] | (p[1] << 8) | (p[2] << 16));
+        if (sample & 0x800000) {
+            sample |= static_cast<int32_t>(0xFF000000);  // Sign extend
+        }
+        return sample / 256.0f;
+    }
+    if (isFloat) {
+        float sample;
+        memcpy(&sample, p, sizeof(sample));
+        return sample * 32768.0f;
+    }
+    int32_t sample = static_cast<int32_t>(readU32(p));
+    return sample / 65536.0f;
+}
+
+bool WAVStream::nextFrame(const float*& frame) {
+    if (frameSize <= 0) {
+        return false;
+    }
+    if (started) {
+        frameStart += hopSize;
+    }
+    started = true;
+
+    while (pending.size() < frameStart + frameSize) {
+        // Drop samples before the frame start before decoding the next block
+        size_t drop = min(frameStart, pending.size());
+        pending.erase(pending.begin(), pending.begin() + drop);
+        frameStart -= drop;
+        if (!fill()) {
+            return false;
+        }
+    }
+    frame = pending.data() + frameStart;
+    return true;
+}
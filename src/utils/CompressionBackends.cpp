@@ -0,0 +1,635 @@
+#include "../../include/utils/CompressionBackends.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace CompressionBackends {
+
+#ifdef HAVE_ZLIB
+/**
+ * @brief Deflate with a gzip wrapper; sizes match `gzip -n` at the same level (bare 10-byte header)
+ */
+class GzipCompressor : public Compressor {
+public:
+    GzipCompressor(int level, int windowBits) : level(level), windowBits(windowBits) {}
+    ~GzipCompressor() override {
+        if (initialized) deflateEnd(&strm);
+    }
+
+    string name() const override { return "gzip"; }
+
+    unique_ptr<PrimedCompressor> prime(ByteSpan prefix) override;
+
+    bool begin(size_t) override {
+        if (!initialized) {
+            strm = z_stream{};
+            // windowBits + 16 selects the gzip header/trailer
+            if (deflateInit2(&strm, level, Z_DEFLATED, windowBits + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                cerr << "Error: deflateInit2 failed" << endl;
+                return false;
+            }
+            initialized = true;
+        } else if (deflateReset(&strm) != Z_OK) {
+            cerr << "Error: deflateReset failed" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool feed(ByteSpan input) override {
+        while (input.size > 0) {
+            uInt chunk = static_cast<uInt>(min<size_t>(input.size, UINT_MAX));
+            strm.next_in = const_cast<Bytef*>(input.data);
+            strm.avail_in = chunk;
+            while (strm.avail_in > 0) {
+                if (!drain(Z_NO_FLUSH)) return false;
+            }
+            input.data += chunk;
+            input.size -= chunk;
+        }
+        return true;
+    }
+
+    long finish() override {
+        strm.next_in = nullptr;
+        strm.avail_in = 0;
+        int ret;
+        do {
+            strm.next_out = scratch();
+            strm.avail_out = SCRATCH_SIZE;
+            ret = deflate(&strm, Z_FINISH);
+            if (ret == Z_STREAM_ERROR) {
+                cerr << "Error: gzip compression failed" << endl;
+                return 0;
+            }
+        } while (ret != Z_STREAM_END);
+        return static_cast<long>(strm.total_out);
+    }
+
+    long outputSoFar() const override { return static_cast<long>(strm.total_out); }
+
+private:
+    int level;
+    int windowBits;
+    z_stream strm{};
+    bool initialized = false;
+
+    bool drain(int flush) {
+        strm.next_out = scratch();
+        strm.avail_out = SCRATCH_SIZE;
+        if (deflate(&strm, flush) == Z_STREAM_ERROR) {
+            cerr << "Error: gzip compression failed" << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Deflate state after the prefix; every suffix continues from a deflateCopy of it
+ */
+class PrimedGzip : public PrimedCompressor {
+public:
+    ~PrimedGzip() override {
+        if (initialized) deflateEnd(&base);
+    }
+
+    bool init(int level, int windowBits, ByteSpan prefix) {
+        if (deflateInit2(&base, level, Z_DEFLATED, windowBits + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            cerr << "Error: deflateInit2 failed" << endl;
+            return false;
+        }
+        initialized = true;
+        return run(base, prefix, Z_NO_FLUSH);
+    }
+
+    long compressedSizeWith(ByteSpan suffix) override {
+        z_stream work;
+        if (deflateCopy(&work, &base) != Z_OK) {
+            cerr << "Error: deflateCopy failed" << endl;
+            return 0;
+        }
+        bool ok = run(work, suffix, Z_FINISH);
+        long total = ok ? static_cast<long>(work.total_out) : 0;
+        deflateEnd(&work);
+        return total;
+    }
+
+private:
+    z_stream base{};
+    bool initialized = false;
+
+    static bool run(z_stream& strm, ByteSpan input, int flush) {
+        alignas(64) thread_local uint8_t sink[64 * 1024];
+        strm.next_in = const_cast<Bytef*>(input.data);
+        strm.avail_in = static_cast<uInt>(input.size);
+        int ret;
+        do {
+            strm.next_out = sink;
+            strm.avail_out = sizeof(sink);
+            ret = deflate(&strm, flush);
+            if (ret == Z_STREAM_ERROR) {
+                cerr << "Error: gzip compression failed" << endl;
+                return false;
+            }
+        } while (strm.avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+        return true;
+    }
+};
+
+unique_ptr<PrimedCompressor> GzipCompressor::prime(ByteSpan prefix) {
+    if (prefix.size > UINT_MAX) return nullptr;
+    auto primed = make_unique<PrimedGzip>();
+    if (!primed->init(level, windowBits, prefix)) return nullptr;
+    return primed;
+}
+
+unique_ptr<Compressor> makeGzip(const CompressorSpec& spec) {
+    return make_unique<GzipCompressor>(spec.level, spec.windowLog ? spec.windowLog : 15);
+}
+#endif
+
+#ifdef HAVE_BZIP2
+/**
+ * @brief bzip2; the level is the block size in 100k units (level 9 matches bzip2 -9)
+ */
+class Bzip2Compressor : public Compressor {
+public:
+    explicit Bzip2Compressor(int blockSize) : blockSize(blockSize) {}
+    ~Bzip2Compressor() override {
+        if (active) BZ2_bzCompressEnd(&strm);
+    }
+
+    string name() const override { return "bzip2"; }
+
+    bool begin(size_t) override {
+        // libbzip2 has no reset, so each stream gets a fresh state
+        if (active) BZ2_bzCompressEnd(&strm);
+        strm = bz_stream{};
+        active = BZ2_bzCompressInit(&strm, blockSize, 0, 0) == BZ_OK;
+        if (!active) {
+            cerr << "Error: bzip2 initialization failed" << endl;
+        }
+        return active;
+    }
+
+    bool feed(ByteSpan input) override {
+        while (input.size > 0) {
+            unsigned int chunk = static_cast<unsigned int>(min<size_t>(input.size, UINT_MAX));
+            strm.next_in = const_cast<char*>(reinterpret_cast<const char*>(input.data));
+            strm.avail_in = chunk;
+            while (strm.avail_in > 0) {
+                strm.next_out = reinterpret_cast<char*>(scratch());
+                strm.avail_out = SCRATCH_SIZE;
+                if (BZ2_bzCompress(&strm, BZ_RUN) != BZ_RUN_OK) {
+                    cerr << "Error: bzip2 compression failed" << endl;
+                    return false;
+                }
+            }
+            input.data += chunk;
+            input.size -= chunk;
+        }
+        return true;
+    }
+
+    long finish() override {
+        int ret;
+        do {
+            strm.next_out = reinterpret_cast<char*>(scratch());
+            strm.avail_out = SCRATCH_SIZE;
+            ret = BZ2_bzCompress(&strm, BZ_FINISH);
+            if (ret != BZ_FINISH_OK && ret != BZ_STREAM_END) {
+                cerr << "Error: bzip2 compression failed (" << ret << ")" << endl;
+                return 0;
+            }
+        } while (ret != BZ_STREAM_END);
+        long total = (static_cast<long>(strm.total_out_hi32) << 32) | strm.total_out_lo32;
+        BZ2_bzCompressEnd(&strm);
+        active = false;
+        return total;
+    }
+
+    long outputSoFar() const override {
+        return active ? (static_cast<long>(strm.total_out_hi32) << 32) | strm.total_out_lo32 : 0;
+    }
+
+private:
+    int blockSize;
+    bz_stream strm{};
+    bool active = false;
+};
+
+unique_ptr<Compressor> makeBzip2(const CompressorSpec& spec) { return make_unique<Bzip2Compressor>(spec.level); }
+#endif
+
+#ifdef HAVE_LZMA
+/**
+ * @brief LZMA_alone (.lzma) stream at a preset (preset 9 matches lzma -9), optionally
+ * with a smaller or larger dictionary than the preset's
+ */
+class LzmaCompressor : public Compressor {
+public:
+    LzmaCompressor(int preset, int windowLog) : preset(preset), windowLog(windowLog) {}
+    ~LzmaCompressor() override { lzma_end(&strm); }
+
+    string name() const override { return "lzma"; }
+
+    bool begin(size_t totalSize) override {
+        lzma_options_lzma opt;
+        if (lzma_lzma_preset(&opt, static_cast<uint32_t>(preset))) {
+            cerr << "Error: lzma preset " << preset << " is not supported" << endl;
+            return false;
+        }
+        if (windowLog) opt.dict_size = 1U << windowLog;
+        // A dictionary larger than the input does not change the output,
+        // it only costs memory (preset 9 would allocate ~670 MiB per stream)
+        if (totalSize > 0) {
+            uint32_t dictSize = LZMA_DICT_SIZE_MIN;
+            while (dictSize < totalSize && dictSize < opt.dict_size) dictSize <<= 1;
+            opt.dict_size = dictSize;
+        }
+        // Re-initializing the same stream lets liblzma reuse its allocations
+        if (lzma_alone_encoder(&strm, &opt) != LZMA_OK) {
+            cerr << "Error: lzma encoder initialization failed" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool feed(ByteSpan input) override {
+        strm.next_in = input.data;
+        strm.avail_in = input.size;
+        while (strm.avail_in > 0) {
+            strm.next_out = scratch();
+            strm.avail_out = SCRATCH_SIZE;
+            if (lzma_code(&strm, LZMA_RUN) != LZMA_OK) {
+                cerr << "Error: lzma compression failed" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    long finish() override {
+        lzma_ret ret;
+        do {
+            strm.next_out = scratch();
+            strm.avail_out = SCRATCH_SIZE;
+            ret = lzma_code(&strm, LZMA_FINISH);
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+                cerr << "Error: lzma compression failed (" << ret << ")" << endl;
+                return 0;
+            }
+        } while (ret != LZMA_STREAM_END);
+        return static_cast<long>(strm.total_out);
+    }
+
+    long outputSoFar() const override { return static_cast<long>(strm.total_out); }
+
+private:
+    int preset;
+    int windowLog;
+    lzma_stream strm = LZMA_STREAM_INIT;
+};
+
+unique_ptr<Compressor> makeLzma(const CompressorSpec& spec) {
+    return make_unique<LzmaCompressor>(spec.level, spec.windowLog);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief zstd at a level (level 19 matches zstd -19), optionally with a fixed window
+ * and worker threads
+ */
+class ZstdCompressor : public Compressor {
+public:
+    explicit ZstdCompressor(const CompressorSpec& spec)
+        : cctx(ZSTD_createCCtx()), level(spec.level), windowLog(spec.windowLog), threads(spec.threads) {}
+    ~ZstdCompressor() override { ZSTD_freeCCtx(cctx); }
+
+    string name() const override { return "zstd"; }
+
+    unique_ptr<PrimedCompressor> prime(ByteSpan prefix) override;
+
+    bool begin(size_t totalSize) override {
+        if (!cctx) {
+            cerr << "Error: could not create zstd context" << endl;
+            return false;
+        }
+        ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+        if (windowLog) ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, windowLog);
+        // Worker threads need a multithreaded libzstd; without one the stream stays single-threaded
+        if (threads && ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads)) && !warnedThreads) {
+            cerr << "Warning: libzstd was built without thread support, ignoring the thread count" << endl;
+            warnedThreads = true;
+        }
+        // The zstd tool writes a content checksum by default
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+        // Pledging the size makes zstd pick the same parameters as a one-shot compression
+        if (totalSize > 0) {
+            ZSTD_CCtx_setPledgedSrcSize(cctx, totalSize);
+        }
+        produced = 0;
+        return true;
+    }
+
+    bool feed(ByteSpan input) override {
+        ZSTD_inBuffer in{input.data, input.size, 0};
+        while (in.pos < in.size) {
+            ZSTD_outBuffer out{scratch(), SCRATCH_SIZE, 0};
+            size_t ret = ZSTD_compressStream2(cctx, &out, &in, ZSTD_e_continue);
+            if (ZSTD_isError(ret)) {
+                cerr << "Error: zstd compression failed: " << ZSTD_getErrorName(ret) << endl;
+                return false;
+            }
+            produced += out.pos;
+        }
+        return true;
+    }
+
+    long finish() override {
+        ZSTD_inBuffer in{nullptr, 0, 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out{scratch(), SCRATCH_SIZE, 0};
+            remaining = ZSTD_compressStream2(cctx, &out, &in, ZSTD_e_end);
+            if (ZSTD_isError(remaining)) {
+                cerr << "Error: zstd compression failed: " << ZSTD_getErrorName(remaining) << endl;
+                return 0;
+            }
+            produced += out.pos;
+        } while (remaining != 0);
+        return static_cast<long>(produced);
+    }
+
+    long outputSoFar() const override { return static_cast<long>(produced); }
+
+    int compressionLevel() const { return level; }
+    int windowLogBits() const { return windowLog; }
+    int workerThreads() const { return threads; }
+
+private:
+    ZSTD_CCtx* cctx;
+    int level;
+    int windowLog;
+    int threads;
+    bool warnedThreads = false;
+    size_t produced = 0;
+};
+
+/**
+ * @brief zstd with the prefix loaded once as a raw-content dictionary.
+ * C(prefix+suffix) is estimated as C(prefix) + C(suffix | prefix); the suffix frame is
+ * written without checksum, dictionary ID or content size so it only adds payload bytes.
+ * The window and worker threads of the spec are applied to every frame, as in ZstdCompressor.
+ */
+class PrimedZstd : public PrimedCompressor {
+public:
+    ~PrimedZstd() override {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeCCtx(cctx);
+    }
+
+    bool init(ZstdCompressor& plain, ByteSpan prefix) {
+        prefixSize = plain.compressedSize(prefix);
+        cctx = ZSTD_createCCtx();
+        cdict = ZSTD_createCDict(prefix.data, prefix.size, plain.compressionLevel());
+        windowLog = plain.windowLogBits();
+        threads = plain.workerThreads();
+        if (prefixSize <= 0 || !cctx || !cdict) {
+            cerr << "Error: could not prime zstd" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    long compressedSizeWith(ByteSpan suffix) override {
+        ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_refCDict(cctx, cdict);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 0);
+        // The reset dropped the parameters; explicit ones override those of the dictionary
+        if (windowLog) ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, windowLog);
+        // Without thread support ZstdCompressor::begin() has already warned
+        if (threads) ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
+
+        alignas(64) thread_local uint8_t sink[64 * 1024];
+        ZSTD_inBuffer in{suffix.data, suffix.size, 0};
+        size_t produced = 0;
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out{sink, sizeof(sink), 0};
+            remaining = ZSTD_compressStream2(cctx, &out, &in, ZSTD_e_end);
+            if (ZSTD_isError(remaining)) {
+                cerr << "Error: zstd compression failed: " << ZSTD_getErrorName(remaining) << endl;
+                return 0;
+            }
+            produced += out.pos;
+        } while (remaining != 0);
+        return prefixSize + static_cast<long>(produced);
+    }
+
+private:
+    ZSTD_CCtx* cctx = nullptr;
+    ZSTD_CDict* cdict = nullptr;
+    long prefixSize = 0;
+    int windowLog = 0;
+    int threads = 0;
+};
+
+unique_ptr<PrimedCompressor> ZstdCompressor::prime(ByteSpan prefix) {
+    auto primed = make_unique<PrimedZstd>();
+    if (!primed->init(*this, prefix)) return nullptr;
+    return primed;
+}
+
+unique_ptr<Compressor> makeZstd(const CompressorSpec& spec) { return make_unique<ZstdCompressor>(spec); }
+#endif
+
+/**
+ * @brief Order-k finite-context model over bytes, kept in hashed count tables.
+ * Each symbol is charged what an arithmetic coder driven by the model would spend on it,
+ * -log2((n(c, s) + 1/64) / (n(c) + 256/64)), and the counts are updated afterwards; no
+ * output is produced. The small additive estimator lets a context become confident after a
+ * few occurrences, which suits the repetitive feature streams. Only the table entries a
+ * stream touched are cleared for the next one, so a run costs time proportional to its
+ * input, not to the table size.
+ */
+class FiniteContextModel {
+public:
+    explicit FiniteContextModel(int order)
+        : order(max(1, min(order, 8))),
+          historyMask(this->order == 8 ? ~0ULL : (1ULL << (8 * this->order)) - 1),
+          symbolCounts(size_t(1) << SYMBOL_BITS, 0),
+          contextCounts(size_t(1) << CONTEXT_BITS, 0) {}
+
+    /**
+     * @brief Forget every count and the context of the previous stream
+     */
+    void clear() {
+        for (uint32_t i : touchedSymbols) symbolCounts[i] = 0;
+        for (uint32_t i : touchedContexts) contextCounts[i] = 0;
+        touchedSymbols.clear();
+        touchedContexts.clear();
+        history = 0;
+    }
+
+    /**
+     * @brief Charge and learn the next bytes of the stream
+     * @param undoable Log the updates so undo() can take them back (priming)
+     * @return Cost of the bytes in bits
+     */
+    double code(ByteSpan input, bool undoable) {
+        if (undoable) {
+            undoSymbols.clear();
+            undoContexts.clear();
+            undoHistory = history;
+        }
+        // The probabilities are multiplied, moving the exponent out now and then, so
+        // there is no logarithm per symbol
+        double probability = 1.0;
+        long exponent = 0;
+        for (size_t i = 0; i < input.size; i++) {
+            uint8_t symbol = input.data[i];
+            uint64_t hash = ((history & historyMask) + 1) * 0x9E3779B97F4A7C15ULL;
+            uint32_t context = static_cast<uint32_t>(hash >> (64 - CONTEXT_BITS));
+            uint32_t entry = static_cast<uint32_t>(((hash >> (64 - SYMBOL_BITS)) + symbol * 0x9E3779B1U) &
+                                                   ((1U << SYMBOL_BITS) - 1));
+
+            uint32_t n = symbolCounts[entry];
+            probability *= (ALPHA_DEN * n + 1.0) / (ALPHA_DEN * contextCounts[context] + 256.0);
+            if (probability < 0x1p-500) {
+                int e;
+                probability = frexp(probability, &e);
+                exponent += e;
+            }
+
+            // Saturated entries stop counting, and their context total with them
+            if (n < UINT16_MAX) {
+                if (n == 0 && !undoable) touchedSymbols.push_back(entry);
+                if (contextCounts[context] == 0 && !undoable) touchedContexts.push_back(context);
+                symbolCounts[entry] = static_cast<uint16_t>(n + 1);
+                contextCounts[context]++;
+                if (undoable) {
+                    undoSymbols.push_back(entry);
+                    undoContexts.push_back(context);
+                }
+            }
+            history = (history << 8) | symbol;
+        }
+        return -(static_cast<double>(exponent) + log2(probability));
+    }
+
+    /**
+     * @brief Take back the updates of the last undoable code() call
+     */
+    void undo() {
+        for (uint32_t i : undoSymbols) symbolCounts[i]--;
+        for (uint32_t i : undoContexts) contextCounts[i]--;
+        undoSymbols.clear();
+        undoContexts.clear();
+        history = undoHistory;
+    }
+
+private:
+    static constexpr double ALPHA_DEN = 64;
+    static constexpr int SYMBOL_BITS = 20;   // 1M (context, symbol) counts
+    static constexpr int CONTEXT_BITS = 18;  // 256K context totals
+
+    int order;
+    uint64_t historyMask;
+    uint64_t history = 0;                   // Last 8 bytes, newest in the low byte
+    vector<uint16_t> symbolCounts;
+    vector<uint32_t> contextCounts;
+    vector<uint32_t> touchedSymbols;
+    vector<uint32_t> touchedContexts;
+    vector<uint32_t> undoSymbols;
+    vector<uint32_t> undoContexts;
+    uint64_t undoHistory = 0;
+};
+
+/**
+ * @brief Estimated compressed size of a cost in bits
+ */
+long fcmBytes(double bits) {
+    return max(1L, static_cast<long>(ceil(bits / 8.0)));
+}
+
+/**
+ * @brief Model state after the prefix; each suffix is coded on top of it and then undone
+ */
+class PrimedFcm : public PrimedCompressor {
+public:
+    PrimedFcm(int order, ByteSpan prefix) : model(order) {
+        prefixBits = model.code(prefix, false);
+    }
+
+    long compressedSizeWith(ByteSpan suffix) override {
+        double bits = prefixBits + model.code(suffix, true);
+        model.undo();
+        return fcmBytes(bits);
+    }
+
+private:
+    FiniteContextModel model;
+    double prefixBits = 0.0;
+};
+
+/**
+ * @brief Built-in order-k finite-context model that only estimates the coded size.
+ * Much cheaper than the general-purpose compressors, and priming is exact.
+ */
+class FcmCompressor : public Compressor {
+public:
+    explicit FcmCompressor(int order) : order(order), model(order) {}
+
+    string name() const override { return "fcm"; }
+
+    bool begin(size_t) override {
+        model.clear();
+        bits = 0.0;
+        return true;
+    }
+
+    bool feed(ByteSpan input) override {
+        bits += model.code(input, false);
+        return true;
+    }
+
+    long finish() override {
+        return fcmBytes(bits);
+    }
+
+    unique_ptr<PrimedCompressor> prime(ByteSpan prefix) override {
+        return make_unique<PrimedFcm>(order, prefix);
+    }
+
+private:
+    int order;
+    FiniteContextModel model;
+    double bits = 0.0;
+};
+
+unique_ptr<Compressor> makeFcm(const CompressorSpec& spec) { return make_unique<FcmCompressor>(spec.level); }
+
+}
@@ -0,0 +1,160 @@
+#include "../../include/utils/CompressionCache.h"
+#include "../../include/utils/CompressorWrapper.h"
+#include "../../include/utils/json.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+constexpr int CACHE_VERSION = 1;
+
+bool fileStamp(const string& file, uintmax_t& size, int64_t& mtime) {
+    error_code ec;
+    size = filesystem::file_size(file, ec);
+    if (ec) return false;
+    auto time = filesystem::last_write_time(file, ec);
+    if (ec) return false;
+    mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+}
+
+CompressionCache::CompressionCache(const string& cacheFile) : path(cacheFile) {
+    baseDir = filesystem::path(cacheFile).parent_path().string();
+}
+
+string CompressionCache::defaultPath(const string& dbDir) {
+    return (filesystem::path(dbDir) / ".ncd_cache.json").string();
+}
+
+string CompressionCache::relativeKey(const string& file) const {
+    error_code ec;
+    auto rel = filesystem::relative(file, baseDir.empty() ? "." : baseDir, ec);
+    return ec || rel.empty() ? file : rel.generic_string();
+}
+
+bool CompressionCache::load() {
+    lock_guard<mutex> lock(mtx);
+    entries.clear();
+    dirty = false;
+
+    ifstream in(path);
+    if (!in) {
+        return true;  // No cache yet
+    }
+
+    try {
+        json doc = json::parse(in);
+        if (doc.value("version", 0) != CACHE_VERSION) {
+            cerr << "Warning: Ignoring cache with unknown version: " << path << endl;
+            return true;
+        }
+        for (auto& [compressorKey, files] : doc["entries"].items()) {
+            auto& table = entries[compressorKey];
+            for (auto& [file, value] : files.items()) {
+                Entry e;
+                e.fileSize = value.at("size").get<uintmax_t>();
+                e.mtime = value.at("mtime").get<int64_t>();
+                e.compressed = value.at("compressed").get<long>();
+                table[file] = e;
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Warning: Could not parse cache file " << path << ": " << e.what() << endl;
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CompressionCache::save() {
+    lock_guard<mutex> lock(mtx);
+    if (!dirty) {
+        return true;
+    }
+
+    json doc;
+    doc["version"] = CACHE_VERSION;
+    doc["entries"] = json::object();
+    for (const auto& [compressorKey, files] : entries) {
+        json table = json::object();
+        for (const auto& [file, e] : files) {
+            table[file] = {{"size", e.fileSize}, {"mtime", e.mtime}, {"compressed", e.compressed}};
+        }
+        doc["entries"][compressorKey] = table;
+    }
+
+    // Write to a temporary name and rename, so concurrent readers never see a partial file
+    string tempPath = path + ".tmp";
+    {
+        ofstream out(tempPath);
+        if (!out) {
+            cerr << "Warning: Could not write cache file " << path << endl;
+            return false;
+        }
+        out << doc.dump();
+        if (!out.good()) {
+            cerr << "Warning: Could not write cache file " << path << endl;
+            return false;
+        }
+    }
+    error_code ec;
+    filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        cerr << "Warning: Could not replace cache file " << path << ": " << ec.message() << endl;
+        filesystem::remove(tempPath, ec);
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+long CompressionCache::compressedSize(const string& file, const string& compressor) {
+    return cachedSize(file, compressor, [&]() {
+        CompressorWrapper cw;
+        return cw.compressAndGetSize(compressor, file);
+    });
+}
+
+long CompressionCache::compressedSize(const string& file, ByteSpan content, const string& compressor) {
+    return cachedSize(file, compressor, [&]() {
+        CompressorWrapper cw;
+        return cw.compressedSize(compressor, content);
+    });
+}
+
+long CompressionCache::cachedSize(const string& file, const string& compressor, const function<long()>& compress) {
+    uintmax_t fileSize = 0;
+    int64_t mtime = 0;
+    bool stamped = fileStamp(file, fileSize, mtime);
+
+    string compressorKey = CompressorWrapper::sizeKey(compressor);
+    string key = relativeKey(file);
+
+    if (stamped) {
+        lock_guard<mutex> lock(mtx);
+        auto table = entries.find(compressorKey);
+        if (table != entries.end()) {
+            auto it = table->second.find(key);
+            if (it != table->second.end() && it->second.fileSize == fileSize && it->second.mtime == mtime) {
+                hitCount++;
+                return it->second.compressed;
+            }
+        }
+    }
+
+    long compressed = compress();
+
+    lock_guard<mutex> lock(mtx);
+    missCount++;
+    if (stamped && compressed > 0) {
+        entries[compressorKey][key] = Entry{fileSize, mtime, compressed};
+        dirty = true;
+    }
+    return compressed;
+}
@@ -1,36 +1,210 @@
 #include "../../include/utils/CompressorWrapper.h"
+#include "../../include/utils/CompressionBackends.h"
+#include "../../include/core/Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
-#include <sstream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
 
 using namespace std;
 
-long CompressorWrapper::compressAndGetSize(const string& compressor, const string& inputFile) {
-    // Generate unique temporary output filename
+namespace {
+
+Metrics::Stage& compressStage = Metrics::stage("compress");
+Metrics::Stage& fileStage = Metrics::stage("compress_file");
+Metrics::Stage& fileReadStage = Metrics::stage("compress_file_read");
+Metrics::Stage& tempIoStage = Metrics::stage("compress_temp_io");
+Metrics::Stage& spawnStage = Metrics::stage("compress_spawn");
+Metrics::Stage& toolStage = Metrics::stage("compress_tool");
+Metrics::Stage& statStage = Metrics::stage("compress_stat");
+Metrics::Counter& callsCounter = Metrics::counter("compress_calls");
+Metrics::Counter& bytesCounter = Metrics::counter("compress_input_bytes");
+Metrics::Counter& spawnsCounter = Metrics::counter("compress_spawns");
+Metrics::Counter& abandonedCounter = Metrics::counter("compress_abandoned");
+
+// Input fed between two checks of a bounded compression
+const size_t boundCheckBytes = 16 * 1024;
+
+/**
+ * @brief Parameter ranges of a compressor (a window range of 0-0 means no window parameter)
+ */
+struct SpecLimits {
+    const char* name;
+    int minLevel, maxLevel, defaultLevel;
+    int minWindow, maxWindow;
+    bool threads;
+};
+
+const SpecLimits specLimits[] = {
+    {"gzip", 1, 9, 9, 9, 15, false},
+    {"bzip2", 1, 9, 9, 0, 0, false},
+    {"lzma", 0, 9, 9, 12, 30, false},
+    {"zstd", 1, 22, 19, 10, 31, true},
+    {"fcm", 1, 8, 6, 0, 0, false},  // Level is the context order
+};
+
+const SpecLimits* limitsFor(const string& name) {
+    for (const auto& limits : specLimits) {
+        if (name == limits.name) return &limits;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Compressor name of a spec (the text before the first ':')
+ */
+string specName(const string& compressor) {
+    return compressor.substr(0, compressor.find(':'));
+}
+
+/**
+ * @brief Registry of in-process backend factories, seeded with the compiled-in ones
+ */
+map<string, CompressorWrapper::BackendFactory>& backendRegistry() {
+    static map<string, CompressorWrapper::BackendFactory> registry = [] {
+        map<string, CompressorWrapper::BackendFactory> builtins;
+        builtins["fcm"] = CompressionBackends::makeFcm;
+#ifdef HAVE_ZLIB
+        builtins["gzip"] = CompressionBackends::makeGzip;
+#endif
+#ifdef HAVE_BZIP2
+        builtins["bzip2"] = CompressionBackends::makeBzip2;
+#endif
+#ifdef HAVE_LZMA
+        builtins["lzma"] = CompressionBackends::makeLzma;
+#endif
+#ifdef HAVE_ZSTD
+        builtins["zstd"] = CompressionBackends::makeZstd;
+#endif
+        return builtins;
+    }();
+    return registry;
+}
+
+mutex registryMutex;
+
+/**
+ * @brief Stream a file through a backend in fixed-size chunks
+ */
+long streamFile(Compressor& backend, const string& path) {
+    constexpr size_t CHUNK_SIZE = 256 * 1024;
+    thread_local vector<uint8_t> chunk(CHUNK_SIZE);
+
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) {
+        cerr << "Error: Could not open file " << path << endl;
+        return 0;
+    }
+    size_t total = static_cast<size_t>(in.tellg());
+    in.seekg(0, ios::beg);
+
+    if (!backend.begin(total)) {
+        return 0;
+    }
+    while (in) {
+        streamsize got;
+        {
+            Metrics::ScopedTimer timer(fileReadStage);
+            in.read(reinterpret_cast<char*>(chunk.data()), CHUNK_SIZE);
+            got = in.gcount();
+        }
+        bytesCounter.add(got > 0 ? static_cast<uint64_t>(got) : 0);
+        if (got <= 0) break;
+        if (!backend.feed(ByteSpan(chunk.data(), static_cast<size_t>(got)))) {
+            return 0;
+        }
+    }
+    if (in.bad()) {
+        cerr << "Error: Could not read file " << path << endl;
+        return 0;
+    }
+    return backend.finish();
+}
+
+string uniqueTempPath(const string& suffix) {
+    // Random part plus a process-wide counter, so concurrent threads never share a name
+    static atomic<unsigned long> counter(0);
     random_device rd;
     mt19937 gen(rd());
     uniform_int_distribution<> distrib(10000, 99999);
-    string tempOut = filesystem::temp_directory_path().string() + "/tmp_" + to_string(distrib(gen)) + "_compressed";
-
-    string cmd;
-    if (compressor == "gzip") {
-        cmd = "gzip -c -9 \"" + inputFile + "\" > \"" + tempOut + "\"";
-    } else if (compressor == "bzip2") {
-        cmd = "bzip2 -z -9 -c \"" + inputFile + "\" > \"" + tempOut + "\"";
-    } else if (compressor == "lzma") {
-        cmd = "lzma -9 -c \"" + inputFile + "\" > \"" + tempOut + "\"";
-    } else if (compressor == "zstd") {
-        cmd = "zstd -19 -q -c \"" + inputFile + "\" > \"" + tempOut + "\"";
+    return filesystem::temp_directory_path().string() + "/tmp_" + to_string(distrib(gen)) + "_" +
+           to_string(getpid()) + "_" + to_string(counter++) + suffix;
+}
+
+/**
+ * @brief Run a command through /bin/sh, timing the fork/exec apart from the command itself
+ * @return Exit status of the command, or -1 if it could not be run
+ */
+int runShell(const string& cmd) {
+    const char* argv[] = {"sh", "-c", cmd.c_str(), nullptr};
+    pid_t pid;
+    {
+        Metrics::ScopedTimer timer(spawnStage);
+        if (posix_spawn(&pid, "/bin/sh", nullptr, nullptr, const_cast<char* const*>(argv), environ) != 0) {
+            return -1;
+        }
+    }
+    spawnsCounter.add();
+
+    Metrics::ScopedTimer timer(toolStage);
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * @brief Run the external compressor tool on a file and stat its output
+ */
+long shellCompressAndGetSize(const string& compressor, const string& inputFile) {
+    CompressorSpec spec;
+    if (!CompressorSpec::parse(compressor, spec)) {
+        return 0;
+    }
+
+    // Generate unique temporary output filename
+    string tempOut = uniqueTempPath("_compressed");
+
+    string level = to_string(spec.level);
+    string tool;
+    if (spec.name == "gzip") {
+        // The gzip tool always uses a 32 KiB window; -n omits the file name and mtime from the
+        // header so sizes match the in-process backend (both share the cache key)
+        if (spec.windowLog && spec.windowLog != 15) {
+            cerr << "Warning: gzip tool ignores the window size of " << compressor << endl;
+        }
+        tool = "gzip -n -c -" + level;
+    } else if (spec.name == "bzip2") {
+        tool = "bzip2 -z -" + level + " -c";
+    } else if (spec.name == "lzma") {
+        tool = spec.windowLog ? "lzma -c --lzma1=preset=" + level + ",dict=" + to_string(1UL << spec.windowLog)
+                              : "lzma -" + level + " -c";
+    } else if (spec.name == "zstd") {
+        tool = "zstd -" + level + (spec.level > 19 ? " --ultra" : "") + " -q -c";
+        if (spec.windowLog) tool += " --zstd=wlog=" + to_string(spec.windowLog);
+        if (spec.threads) tool += " -T" + to_string(spec.threads);
     } else {
         cerr << "Unknown compressor: " << compressor << endl;
         return 0;
     }
+    string cmd = tool + " \"" + inputFile + "\" > \"" + tempOut + "\"";
 
-    int ret = system(cmd.c_str());
+    int ret = runShell(cmd);
     long size = 0;
 
+    Metrics::ScopedTimer timer(statStage);
     if (ret != 0) {
         cerr << "Compression failed with command: " << cmd << endl;
     } else {
@@ -53,4 +227,261 @@ long CompressorWrapper::compressAndGetSize(const string& compressor, const strin
     }
 
     return size;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Fallback compressor that streams its input into a temporary file for the external tool
+ */
+class ShellCompressor : public Compressor {
+public:
+    explicit ShellCompressor(const string& compressor) : compressor(compressor) {}
+    ~ShellCompressor() override { discard(); }
+
+    string name() const override { return compressor; }
+
+    bool begin(size_t) override {
+        Metrics::ScopedTimer timer(tempIoStage);
+        discard();
+        tempIn = uniqueTempPath("_input");
+        out.open(tempIn, ios::binary);
+        if (!out) {
+            cerr << "Error: Could not create temporary file " << tempIn << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool feed(ByteSpan input) override {
+        Metrics::ScopedTimer timer(tempIoStage);
+        out.write(reinterpret_cast<const char*>(input.data), input.size);
+        return out.good();
+    }
+
+    long finish() override {
+        bool written;
+        {
+            Metrics::ScopedTimer timer(tempIoStage);
+            out.close();
+            written = !out.fail();
+        }
+        long size = written ? shellCompressAndGetSize(compressor, tempIn) : 0;
+        Metrics::ScopedTimer timer(tempIoStage);
+        discard();
+        return size;
+    }
+
+private:
+    string compressor;
+    string tempIn;
+    ofstream out;
+
+    void discard() {
+        if (out.is_open()) out.close();
+        if (!tempIn.empty()) {
+            error_code ec;
+            filesystem::remove(tempIn, ec);
+            tempIn.clear();
+        }
+    }
+};
+
+}
+
+uint8_t* Compressor::scratch() {
+    alignas(64) thread_local uint8_t buffer[SCRATCH_SIZE];
+    return buffer;
+}
+
+long Compressor::compressedSize(ByteSpan input) {
+    Metrics::ScopedTimer timer(compressStage);
+    callsCounter.add();
+    bytesCounter.add(input.size);
+    if (!begin(input.size) || !feed(input)) {
+        return 0;
+    }
+    return finish();
+}
+
+long Compressor::compressedSize(ByteSpan first, ByteSpan second) {
+    Metrics::ScopedTimer timer(compressStage);
+    callsCounter.add();
+    bytesCounter.add(first.size + second.size);
+    if (!begin(first.size + second.size) || !feed(first) || !feed(second)) {
+        return 0;
+    }
+    return finish();
+}
+
+long Compressor::compressedSize(ByteSpan first, ByteSpan second, long limit) {
+    Metrics::ScopedTimer timer(compressStage);
+    callsCounter.add();
+    if (!begin(first.size + second.size) || !feed(first)) {
+        return 0;
+    }
+    if (outputSoFar() < 0) {
+        bytesCounter.add(first.size + second.size);
+        return feed(second) ? finish() : 0;
+    }
+    for (size_t pos = 0; pos < second.size; pos += boundCheckBytes) {
+        long reached = outputSoFar();
+        if (reached >= limit) {
+            // The next begin() discards the unfinished stream
+            bytesCounter.add(first.size + pos);
+            abandonedCounter.add();
+            return reached;
+        }
+        if (!feed(ByteSpan(second.data + pos, min(boundCheckBytes, second.size - pos)))) {
+            return 0;
+        }
+    }
+    bytesCounter.add(first.size + second.size);
+    return finish();
+}
+
+unique_ptr<PrimedCompressor> Compressor::prime(ByteSpan) {
+    return nullptr;
+}
+
+bool CompressorSpec::parse(const string& text, CompressorSpec& spec) {
+    spec = CompressorSpec();
+    spec.name = specName(text);
+    const SpecLimits* limits = limitsFor(spec.name);
+    if (!limits && spec.name == text && CompressorWrapper::hasBackend(spec.name)) {
+        return true;  // Registered backend without parameters
+    }
+    if (!limits) {
+        cerr << "Error: Invalid compressor: " << spec.name << endl;
+        cerr << "Valid options: gzip, bzip2, lzma, zstd, fcm (as name[:level][:w<window log>][:t<threads>])" << endl;
+        return false;
+    }
+    spec.level = limits->defaultLevel;
+
+    // Fields after the name: the level first, then w<n> and t<n> in any order
+    size_t pos = spec.name.size();
+    bool first = true;
+    while (pos < text.size()) {
+        size_t end = text.find(':', pos + 1);
+        string field = text.substr(pos + 1, end == string::npos ? string::npos : end - pos - 1);
+        pos = end == string::npos ? text.size() : end;
+
+        char kind = !field.empty() && (field[0] == 'w' || field[0] == 't') ? field[0] : 'l';
+        string digits = kind == 'l' ? field : field.substr(1);
+        if (digits.empty() || digits.size() > 3 || digits.find_first_not_of("0123456789") != string::npos ||
+            (kind == 'l' && !first)) {
+            cerr << "Error: Invalid compressor parameter '" << field << "' in " << text << endl;
+            return false;
+        }
+        int value = stoi(digits);
+        first = false;
+
+        if (kind == 'l') {
+            if (value < limits->minLevel || value > limits->maxLevel) {
+                cerr << "Error: " << spec.name << " level must be between " << limits->minLevel
+                     << " and " << limits->maxLevel << ": " << text << endl;
+                return false;
+            }
+            spec.level = value;
+        } else if (kind == 'w') {
+            if (limits->maxWindow == 0) {
+                cerr << "Error: " << spec.name << " has no window parameter: " << text << endl;
+                return false;
+            }
+            if (value < limits->minWindow || value > limits->maxWindow) {
+                cerr << "Error: " << spec.name << " window log must be between " << limits->minWindow
+                     << " and " << limits->maxWindow << ": " << text << endl;
+                return false;
+            }
+            spec.windowLog = value;
+        } else {
+            if (!limits->threads || value < 1) {
+                cerr << "Error: " << spec.name << " takes no thread count here: " << text << endl;
+                return false;
+            }
+            spec.threads = value;
+        }
+    }
+    return true;
+}
+
+string CompressorSpec::key() const {
+    string result = name + ":" + to_string(level);
+    if (windowLog) result += ":w" + to_string(windowLog);
+    if (threads) result += ":t" + to_string(threads);
+    return result;
+}
+
+int CompressorWrapper::defaultLevel(const string& compressor) {
+    const SpecLimits* limits = limitsFor(specName(compressor));
+    return limits ? limits->defaultLevel : 9;
+}
+
+string CompressorWrapper::sizeKey(const string& compressor) {
+    CompressorSpec spec;
+    return CompressorSpec::parse(compressor, spec) ? spec.key() : compressor;
+}
+
+unique_ptr<Compressor> CompressorWrapper::createBackend(const string& compressor) {
+    CompressorSpec spec;
+    if (!CompressorSpec::parse(compressor, spec)) {
+        return nullptr;
+    }
+    lock_guard<mutex> lock(registryMutex);
+    auto& registry = backendRegistry();
+    auto it = registry.find(spec.name);
+    if (it == registry.end()) {
+        return nullptr;
+    }
+    return it->second(spec);
+}
+
+bool CompressorWrapper::hasBackend(const string& compressor) {
+    lock_guard<mutex> lock(registryMutex);
+    return backendRegistry().count(specName(compressor)) > 0;
+}
+
+void CompressorWrapper::registerBackend(const string& compressor, BackendFactory factory) {
+    lock_guard<mutex> lock(registryMutex);
+    backendRegistry()[compressor] = move(factory);
+}
+
+Compressor* CompressorWrapper::threadBackend(const string& compressor) {
+    // Backends keep their contexts between calls, so each thread owns its own set
+    thread_local map<string, unique_ptr<Compressor>> backends;
+    auto it = backends.find(compressor);
+    if (it == backends.end()) {
+        it = backends.emplace(compressor, createBackend(compressor)).first;
+    }
+    return it->second.get();
+}
+
+Compressor* CompressorWrapper::threadCompressor(const string& compressor) {
+    Compressor* backend = threadBackend(compressor);
+    if (backend) {
+        return backend;
+    }
+    CompressorSpec spec;
+    if (!CompressorSpec::parse(compressor, spec)) {
+        return nullptr;
+    }
+    thread_local map<string, unique_ptr<Compressor>> fallbacks;
+    auto& fallback = fallbacks[compressor];
+    if (!fallback) {
+        fallback = make_unique<ShellCompressor>(compressor);
+    }
+    return fallback.get();
+}
+
+long CompressorWrapper::compressAndGetSize(const string& compressor, const string& inputFile) {
+    Metrics::ScopedTimer timer(fileStage);
+    callsCounter.add();
+    Compressor* backend = threadBackend(compressor);
+    if (!backend) {
+        return shellCompressAndGetSize(compressor, inputFile);
+    }
+    return streamFile(*backend, inputFile);
+}
+
+long CompressorWrapper::compressedSize(const string& compressor, ByteSpan input) {
+    Compressor* c = threadCompressor(compressor);
+    return c ? c->compressedSize(input) : 0;
+}